@@ -0,0 +1,654 @@
+// bench.c : accuracy and cost of the hot paths of the app, run natively
+//
+// usage: bench [fixes] [trace] [-j file]
+//
+// Every measurement is printed, and with -j also written to the file as a line of json, so that
+// runs can be compared: {"bench": name, "ops": n, "ns": per op, "cycles": per op} for the costs,
+// {"check": name, "value": v, "unit": u} for the accuracy, where smaller is better. Cycles are
+// time stamp counter ticks, null where the host has none. The random inputs come from fixed
+// seeds, so two runs of the same code do exactly the same work and get the same checks.
+//
+// Accuracy: random hops of up to 10 km, both ends within GEO_FRAME_REFRESH of the frame origin,
+// compared with haversine distance and initial bearing on the same sphere. The sin/cos/atan2
+// lookups are the host stand-ins, which are exact to their 16 bit results.
+//
+// Cost: ns per call on this machine, the best of BENCH_RUNS runs, of the kernel and of the double
+// precision formulas it replaces. Only the ratios mean anything for the watch, where doubles are
+// soft-float and everything is some ten times slower.
+//
+// Kalman filter: a walk with stops, turns and hills is recorded through a receiver model with
+// slow wander, jitter and changing satellites, both scaled by the hdop it reports, then replayed
+// through the filter with the hdop and with the satellites alone. Position error, distance,
+// elevation gain and speed are compared with the walk itself, raw and filtered. A trace file, one
+// fix per line as "time,lat,lon,speed,alt,fix,sat" like gps_fix, is replayed the same way without
+// hdop; with three more columns of the true lat, lon and alt it is compared with those too.
+//
+// App: the formatting, the read decode chain from prv_did_read down to the text layers, and the
+// codecs, with the app running against the fake strap as in sim_main.c. The app translation unit
+// is included directly so that its static functions can be called.
+
+#include "sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define main xadow_main
+#include "../src/xadow_window.c"
+#undef main
+
+#define EARTH_RADIUS_M  6371008.8
+#define RAD_PER_UNIT    (M_PI / 180.0 / 1e7)
+#define BENCH_RUNS      5
+#define BENCH_APP_AT    3000    // ms, once the app is connected to the fake strap
+#define BENCH_INPUTS    64      // different inputs the app benchmarks cycle through
+
+typedef void (*BenchBody)(int ops);
+
+static FILE *s_json;
+
+#define BENCH_SEED      0x9e3779b97f4a7c15ULL
+
+static uint64_t s_rng = BENCH_SEED;
+
+static uint32_t prv_random(void)
+{
+	s_rng ^= s_rng << 13;
+	s_rng ^= s_rng >> 7;
+	s_rng ^= s_rng << 17;
+	return (uint32_t)(s_rng >> 16);
+}
+
+static double prv_uniform(double lo, double hi)
+{
+	return lo + (hi - lo) * (prv_random() / 4294967296.0);
+}
+
+static double prv_haversine_m(geo_point a, geo_point b)
+{
+	double lat1 = a.lat * RAD_PER_UNIT, lat2 = b.lat * RAD_PER_UNIT;
+	double dlat = lat2 - lat1, dlon = (double)(b.lon - a.lon) * RAD_PER_UNIT;
+	double h = sin(dlat / 2) * sin(dlat / 2) + cos(lat1) * cos(lat2) * sin(dlon / 2) * sin(dlon / 2);
+	return 2 * EARTH_RADIUS_M * asin(sqrt(h));
+}
+
+static double prv_bearing_deg(geo_point a, geo_point b)
+{
+	double lat1 = a.lat * RAD_PER_UNIT, lat2 = b.lat * RAD_PER_UNIT;
+	double dlon = (double)(b.lon - a.lon) * RAD_PER_UNIT;
+	double y = sin(dlon) * cos(lat2);
+	double x = cos(lat1) * sin(lat2) - sin(lat1) * cos(lat2) * cos(dlon);
+	return fmod(atan2(y, x) * 180.0 / M_PI + 360.0, 360.0);
+}
+
+static geo_point prv_offset(geo_point p, double north_m, double east_m)
+{
+	double metres_per_unit = EARTH_RADIUS_M * RAD_PER_UNIT;
+	geo_point q = {
+		.lat = p.lat + (int32_t)lround(north_m / metres_per_unit),
+		.lon = p.lon + (int32_t)lround(east_m / metres_per_unit / cos(p.lat * RAD_PER_UNIT)),
+	};
+	return q;
+}
+
+static double prv_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t prv_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// the cost of ops calls, the fastest of BENCH_RUNS runs, the others having been interrupted
+static void prv_time(const char *name, BenchBody body, int ops)
+{
+	double best_ns = 0;
+	uint64_t best_cycles = 0;
+
+	for (int run = 0; run < BENCH_RUNS; run++) {
+		double start = prv_now_ns();
+		uint64_t cycles = prv_cycles();
+		body(ops);
+		cycles = prv_cycles() - cycles;
+		double ns = prv_now_ns() - start;
+		if (!run || ns < best_ns) {
+			best_ns = ns;
+			best_cycles = cycles;
+		}
+	}
+	printf("%-24s %10.1f ns", name, best_ns / ops);
+	if (best_cycles) {
+		printf(" %10.1f cycles", (double)best_cycles / ops);
+	}
+	printf("\n");
+	if (s_json) {
+		fprintf(s_json, "{\"bench\": \"%s\", \"ops\": %d, \"ns\": %.2f, \"cycles\": ", name, ops, best_ns / ops);
+		if (best_cycles) {
+			fprintf(s_json, "%.2f}\n", (double)best_cycles / ops);
+		}
+		else {
+			fprintf(s_json, "null}\n");
+		}
+	}
+}
+
+// a measure of accuracy, smaller is better
+static void prv_check(const char *name, double value, const char *unit)
+{
+	if (s_json) {
+		fprintf(s_json, "{\"check\": \"%s\", \"value\": %.6g, \"unit\": \"%s\"}\n", name, value, unit);
+	}
+}
+
+static void prv_accuracy(int samples, double max_lat)
+{
+	double worst_rel = 0, worst_abs = 0, worst_bearing = 0;
+	double frame_m = GEO_FRAME_REFRESH * EARTH_RADIUS_M * RAD_PER_UNIT;
+
+	for (int i = 0; i < samples; i++) {
+		geo_point origin = {
+			.lat = (int32_t)(prv_uniform(-max_lat, max_lat) * 1e7),
+			.lon = (int32_t)(prv_uniform(-180, 180) * 1e7),
+		};
+		geo_frame frame;
+		geo_frame_init(&frame, origin);
+
+		// one end anywhere the frame is still used for, the other up to 10 km away in any direction
+		geo_point a = prv_offset(origin, prv_uniform(-frame_m, frame_m) * 0.99, prv_uniform(-frame_m, frame_m));
+		double length = exp(prv_uniform(log(1.0), log(10000.0)));
+		double heading = prv_uniform(0, 2 * M_PI);
+		geo_point b = prv_offset(a, length * cos(heading), length * sin(heading));
+		if (!geo_frame_near(&frame, b)) {
+			b = prv_offset(a, -length * cos(heading), length * sin(heading));
+		}
+
+		double reference = prv_haversine_m(a, b);
+		double error = fabs(geo_distance(&frame, a, b) / 100.0 - reference);
+		double rel = reference > 1000 ? error / reference : 0;
+		worst_rel = fmax(worst_rel, rel);
+		worst_abs = fmax(worst_abs, reference <= 1000 ? error : 0);
+
+		if (reference > 10) {
+			double bearing = geo_bearing(&frame, a, b) * 360.0 / TRIG_MAX_ANGLE;
+			double diff = fabs(bearing - prv_bearing_deg(a, b));
+			worst_bearing = fmax(worst_bearing, fmin(diff, 360 - diff));
+		}
+	}
+	printf("below %2.0f deg: distance %.1f cm (hops <= 1 km), %.4f%% (hops > 1 km), bearing %.3f deg\n",
+		max_lat, worst_abs * 100, worst_rel * 100, worst_bearing);
+
+	char name[40];
+	snprintf(name, sizeof(name), "geo_distance_%.0f_cm", max_lat);
+	prv_check(name, worst_abs * 100, "cm");
+	snprintf(name, sizeof(name), "geo_distance_%.0f_pct", max_lat);
+	prv_check(name, worst_rel * 100, "%");
+	snprintf(name, sizeof(name), "geo_bearing_%.0f", max_lat);
+	prv_check(name, worst_bearing, "deg");
+}
+
+static geo_point *s_track;
+static geo_frame s_frame;
+static volatile uint32_t s_sink;
+static volatile double s_dsink;
+
+static void prv_body_odometer(int ops)
+{
+	geo_odometer odometer;
+	geo_odometer_reset(&odometer);
+	for (int i = 0; i < ops; i++) {
+		geo_odometer_add(&odometer, i, s_track[i]);
+	}
+	s_sink = odometer.distance;
+}
+
+static void prv_body_distance(int ops)
+{
+	for (int i = 1; i < ops; i++) {
+		s_sink += geo_distance(&s_frame, s_track[i - 1], s_track[i]);
+	}
+}
+
+static void prv_body_bearing(int ops)
+{
+	for (int i = 1; i < ops; i++) {
+		s_sink += geo_bearing(&s_frame, s_track[0], s_track[i]);
+	}
+}
+
+static void prv_body_haversine(int ops)
+{
+	for (int i = 1; i < ops; i++) {
+		s_dsink += prv_haversine_m(s_track[i - 1], s_track[i]);
+	}
+}
+
+static void prv_body_double_bearing(int ops)
+{
+	for (int i = 1; i < ops; i++) {
+		s_dsink += prv_bearing_deg(s_track[0], s_track[i]);
+	}
+}
+
+static void prv_cost(int fixes)
+{
+	s_track = malloc(sizeof(geo_point) * fixes);
+	geo_point p = { 473000000, 85000000 };
+	for (int i = 0; i < fixes; i++) {
+		p = prv_offset(p, prv_uniform(-3, 3), prv_uniform(-3, 3));
+		s_track[i] = p;
+	}
+	geo_frame_init(&s_frame, s_track[0]);
+
+	prv_time("geo_odometer_add", prv_body_odometer, fixes);
+	prv_time("geo_distance", prv_body_distance, fixes);
+	prv_time("haversine_double", prv_body_haversine, fixes);
+	prv_time("geo_bearing", prv_body_bearing, fixes);
+	prv_time("bearing_double", prv_body_double_bearing, fixes);
+	free(s_track);
+}
+
+typedef struct {
+	double   error;     // m^2, summed
+	double   speed_error;
+	uint32_t errors;
+	uint32_t gain;      // cm
+	uint16_t last_alt;
+	geo_odometer odometer;
+} ReplayTotals;
+
+static void prv_replay_fix(ReplayTotals *totals, const gps_fix *fix, const gps_fix *truth)
+{
+	if (totals->odometer.started && fix->alt > totals->last_alt) {
+		totals->gain += fix->alt - totals->last_alt;
+	}
+	totals->last_alt = fix->alt;
+	geo_odometer_add(&totals->odometer, fix->time, (geo_point){ fix->lat, fix->lon });
+	if (truth) {
+		double north = (fix->lat - truth->lat) / (double)GEO_UNITS_PER_METRE;
+		double east = (fix->lon - truth->lon) * cos(truth->lat * RAD_PER_UNIT) / GEO_UNITS_PER_METRE;
+		double speed = (fix->speed - truth->speed) / 100.0;
+		totals->error += north * north + east * east;
+		totals->speed_error += speed * speed;
+		totals->errors++;
+	}
+}
+
+static void prv_replay_line(const char *name, const ReplayTotals *totals)
+{
+	printf("  %-9s distance %8.1f m, gain %6.1f m", name, totals->odometer.distance / 100.0, totals->gain / 100.0);
+	if (totals->errors) {
+		printf(", position %.2f m rms, speed %.2f m/s rms", sqrt(totals->error / totals->errors),
+			sqrt(totals->speed_error / totals->errors));
+	}
+	printf("\n");
+}
+
+// the trace through the filter, against the truth when there is one, and with the receiver's hdop
+// against the filter going by the satellites alone
+static void prv_replay(const char *name, const gps_fix *trace, const uint16_t *hdop, const gps_fix *truth, int count,
+	bool check)
+{
+	ReplayTotals raw = { 0 }, filtered = { 0 }, by_sat = { 0 }, real = { 0 };
+	kalman_filter filter, sat_filter;
+	kalman_reset(&filter);
+	kalman_reset(&sat_filter);
+
+	for (int i = 0; i < count; i++) {
+		gps_fix fix = trace[i], sat_fix = trace[i];
+		prv_replay_fix(&raw, &fix, truth ? &truth[i] : NULL);
+		kalman_add(&filter, &fix, hdop ? hdop[i] : 0);
+		prv_replay_fix(&filtered, &fix, truth ? &truth[i] : NULL);
+		if (hdop) {
+			kalman_add(&sat_filter, &sat_fix, 0);
+			prv_replay_fix(&by_sat, &sat_fix, truth ? &truth[i] : NULL);
+		}
+		if (truth) {
+			prv_replay_fix(&real, &truth[i], NULL);
+		}
+	}
+	printf("kalman replay of %s, %d fixes, %u restarts:\n", name, count, filter.restarts);
+	if (truth) {
+		prv_replay_line("true", &real);
+	}
+	prv_replay_line("raw", &raw);
+	if (hdop) {
+		prv_replay_line("sats only", &by_sat);
+	}
+	prv_replay_line("filtered", &filtered);
+	if (check && truth && count) {
+		prv_check("kalman_distance_pct", fabs(filtered.odometer.distance * 100.0 / real.odometer.distance - 100), "%");
+		prv_check("kalman_gain_pct", fabs(filtered.gain * 100.0 / real.gain - 100), "%");
+		prv_check("kalman_position_rms", sqrt(filtered.error / filtered.errors), "m");
+		prv_check("kalman_speed_rms", sqrt(filtered.speed_error / filtered.errors), "m/s");
+	}
+}
+
+// a walk at 1 Hz with stops, turns and hills, and a receiver following it with some wander: 2 m
+// times its hdop, which grows with fewer satellites and in stretches between buildings
+static void prv_walk(gps_fix *trace, uint16_t *hdop, gps_fix *truth, int count)
+{
+	geo_point p = { 473000000, 85000000 };
+	double heading = 0, speed = 1.4, alt = 40000, drift_north = 0, drift_east = 0, drift_up = 0;
+
+	for (int i = 0; i < count; i++) {
+		bool stopped = i % 600 >= 540;
+		double target = stopped ? 0 : 1.4 + 0.6 * sin(i / 300.0);
+		speed += (target - speed) * 0.3;
+		heading += i % 120 < 10 ? 0.15 : prv_uniform(-0.02, 0.02);
+		p = prv_offset(p, speed * cos(heading), speed * sin(heading));
+		alt += stopped ? 0 : 25 * sin(i / 200.0);
+
+		uint8_t sat = (uint8_t)(5 + (i / 45) % 7);
+		uint8_t quality = i % 1000 >= 950 ? 6 : 1;
+		bool street = i % 900 >= 600 && i % 900 < 720;
+		double dop = (0.9 + 0.3 * sin(i / 130.0)) * sqrt(8.0 / sat) * (street ? 2.5 : 1);
+		double wander = (quality == 6 ? 3.0 : 1.0) * 2 * dop;
+		drift_north = 0.95 * drift_north + prv_uniform(-0.3, 0.3) * wander;
+		drift_east = 0.95 * drift_east + prv_uniform(-0.3, 0.3) * wander;
+		drift_up = 0.95 * drift_up + prv_uniform(-0.45, 0.45) * wander;
+
+		truth[i] = (gps_fix){
+			.time = 1000000 + i,
+			.lat = p.lat,
+			.lon = p.lon,
+			.speed = (uint16_t)lround(speed * 100),
+			.alt = (uint16_t)lround(alt),
+			.fix = quality,
+			.sat = sat,
+		};
+		hdop[i] = (uint16_t)lround(dop * 100);
+		geo_point seen = prv_offset(p, drift_north + prv_uniform(-1, 1) * wander / 2,
+			drift_east + prv_uniform(-1, 1) * wander / 2);
+		trace[i] = truth[i];
+		trace[i].lat = seen.lat;
+		trace[i].lon = seen.lon;
+		trace[i].alt = (uint16_t)lround(alt + (drift_up + prv_uniform(-1, 1) * wander) * 100);
+		trace[i].speed = (uint16_t)lround(fmax(0, speed + prv_uniform(-0.3, 0.3)) * 100);
+	}
+}
+
+#define WALK_FIXES 3600
+
+static gps_fix *s_walk;
+static uint16_t *s_walk_hdop;
+
+static void prv_body_kalman(int ops)
+{
+	kalman_filter filter;
+	kalman_reset(&filter);
+	for (int i = 0; i < ops; i++) {
+		gps_fix fix = s_walk[i % WALK_FIXES];
+		fix.time = 1000000 + i;
+		kalman_add(&filter, &fix, s_walk_hdop[i % WALK_FIXES]);
+		s_sink += fix.lat;
+	}
+}
+
+static void prv_kalman(int fixes)
+{
+	// the same walk whatever number of fixes the benchmarks before it took
+	s_rng = BENCH_SEED;
+	s_walk = malloc(sizeof(gps_fix) * WALK_FIXES);
+	s_walk_hdop = malloc(sizeof(uint16_t) * WALK_FIXES);
+	gps_fix *truth = malloc(sizeof(gps_fix) * WALK_FIXES);
+	prv_walk(s_walk, s_walk_hdop, truth, WALK_FIXES);
+	prv_replay("an hour's walk", s_walk, s_walk_hdop, truth, WALK_FIXES, true);
+	prv_time("kalman_add", prv_body_kalman, fixes);
+	free(s_walk);
+	free(s_walk_hdop);
+	free(truth);
+}
+
+// fixes as "time,lat,lon,speed,alt,fix,sat", optionally followed by the true ",lat,lon,alt"
+static void prv_replay_file(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		perror(path);
+		exit(1);
+	}
+	int count = 0, capacity = 1024, with_truth = 0;
+	gps_fix *trace = malloc(sizeof(gps_fix) * capacity);
+	gps_fix *truth = malloc(sizeof(gps_fix) * capacity);
+	char line[256];
+	while (fgets(line, sizeof(line), file)) {
+		unsigned time, speed, alt, quality, sat, true_alt;
+		int lat, lon, true_lat, true_lon;
+		int fields = sscanf(line, "%u,%d,%d,%u,%u,%u,%u,%d,%d,%u", &time, &lat, &lon, &speed, &alt, &quality, &sat,
+			&true_lat, &true_lon, &true_alt);
+		if (fields < 7) {
+			continue;
+		}
+		if (count == capacity) {
+			capacity *= 2;
+			trace = realloc(trace, sizeof(gps_fix) * capacity);
+			truth = realloc(truth, sizeof(gps_fix) * capacity);
+		}
+		trace[count] = (gps_fix){ time, lat, lon, speed, alt, quality, sat };
+		truth[count] = (gps_fix){ time, true_lat, true_lon, speed, true_alt, quality, sat };
+		with_truth += fields == 10;
+		count++;
+	}
+	fclose(file);
+	prv_replay(path, trace, NULL, with_truth == count && count ? truth : NULL, count, false);
+	free(trace);
+	free(truth);
+}
+
+// inputs for the app benchmarks, made up front so that only the code under test is timed
+static int32_t s_numbers[BENCH_INPUTS];
+static uint8_t s_snapshots[BENCH_INPUTS][sizeof(xadow_gps_snapshot)];
+static uint8_t s_sentences[BENCH_INPUTS][XADOW_NMEA_READ_SIZE];
+static size_t s_sentence_length[BENCH_INPUTS];
+static uint8_t s_uids[BENCH_INPUTS][7];
+static uint8_t s_ndef[128];
+static size_t s_ndef_length;
+static uint8_t s_block[BULK_BUFFER_SIZE];
+static int s_app_ops;
+
+static size_t prv_sentence(uint8_t *out, const char *body)
+{
+	uint8_t checksum = 0;
+	for (const char *c = body; *c; c++) {
+		checksum ^= (uint8_t)*c;
+	}
+	return (size_t)sprintf((char *)out, "$%s*%02X\r\n", body, checksum);
+}
+
+static void prv_app_inputs(void)
+{
+	geo_point p = { 374400662, -1221583808 };
+
+	for (int i = 0; i < BENCH_INPUTS; i++) {
+		s_numbers[i] = (int32_t)prv_random() - INT32_MAX / 2;
+		p = prv_offset(p, prv_uniform(-3, 3), prv_uniform(-3, 3));
+		xadow_gps_snapshot snapshot = {
+			.lat = p.lat,
+			.lon = p.lon,
+			.speed = (uint16_t)(prv_random() % 500),
+			.alt = (uint16_t)(3000 + prv_random() % 500),
+			.fix = 1,
+			.sat = (uint8_t)(5 + prv_random() % 7),
+			.timestamp = 1000 * (i + 1),
+		};
+		memcpy(s_snapshots[i], &snapshot, sizeof(snapshot));
+
+		double lat = p.lat / 1e7, lon = -p.lon / 1e7;
+		char body[96];
+		size_t length = 0;
+		snprintf(body, sizeof(body), "GPGGA,1200%02d.00,%02d%07.4f,N,%03d%07.4f,W,1,%02d,0.9,%.1f,M,-25.0,M,,", i % 60,
+			(int)lat, fmod(lat, 1) * 60, (int)lon, fmod(lon, 1) * 60, snapshot.sat, snapshot.alt / 100.0);
+		length += prv_sentence(s_sentences[i] + length, body);
+		snprintf(body, sizeof(body), "GPRMC,1200%02d.00,A,%02d%07.4f,N,%03d%07.4f,W,%.1f,45.0,160626,,,A", i % 60,
+			(int)lat, fmod(lat, 1) * 60, (int)lon, fmod(lon, 1) * 60, snapshot.speed / 51.4);
+		length += prv_sentence(s_sentences[i] + length, body);
+		length += prv_sentence(s_sentences[i] + length, "GPGSV,1,1,04,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45");
+		s_sentence_length[i] = length;
+
+		for (size_t j = 0; j < sizeof(s_uids[i]); j++) {
+			s_uids[i][j] = (uint8_t)prv_random();
+		}
+	}
+
+	// a short text record
+	static const char text[] = "\x02" "enCheckpoint at the old mill, 4.2 km";
+	s_ndef[0] = NDEF_FLAG_MB | NDEF_FLAG_ME | NDEF_FLAG_SR | NDEF_TNF_WELL_KNOWN;
+	s_ndef[1] = 1;
+	s_ndef[2] = sizeof(text) - 1;
+	s_ndef[3] = 'T';
+	memcpy(s_ndef + 4, text, sizeof(text) - 1);
+	s_ndef_length = 4 + sizeof(text) - 1;
+
+	for (size_t i = 0; i < sizeof(s_block); i++) {
+		s_block[i] = (uint8_t)prv_random();
+	}
+}
+
+static void prv_body_format_number(int ops)
+{
+	char text[FIELD_TEXT_SIZE];
+	for (int i = 0; i < ops; i++) {
+		format_number(s_numbers[i % BENCH_INPUTS], 7, text, 4);
+		s_sink += (uint8_t)text[1];
+	}
+}
+
+static void prv_body_format_digits(int ops)
+{
+	char text[FIELD_TEXT_SIZE];
+	for (int i = 0; i < ops; i++) {
+		format_digits(text, (uint32_t)s_numbers[i % BENCH_INPUTS], 1);
+		s_sink += (uint8_t)text[1];
+	}
+}
+
+// every field reformatted, some of them to new text
+static void prv_body_update_data_text(int ops)
+{
+	for (int i = 0; i < ops; i++) {
+		vbat = (uint16_t)(400 + i % 8);
+		sat = (uint8_t)(i % 12);
+		s_dirty_fields = (1 << NUM_FIELDS) - 1;
+		update_data_text();
+	}
+}
+
+static void prv_body_did_read_snapshot(int ops)
+{
+	for (int i = 0; i < ops; i++) {
+		prv_did_read(ENDPOINT(GPS_SNAPSHOT)->attr, SmartstrapResultOk, s_snapshots[i % BENCH_INPUTS],
+			sizeof(xadow_gps_snapshot));
+	}
+}
+
+static void prv_body_did_read_nmea(int ops)
+{
+	for (int i = 0; i < ops; i++) {
+		prv_did_read(ENDPOINT(GPS_NMEA)->attr, SmartstrapResultOk, s_sentences[i % BENCH_INPUTS],
+			s_sentence_length[i % BENCH_INPUTS]);
+	}
+}
+
+static void prv_body_nmea_parse(int ops)
+{
+	nmea_parser parser;
+	nmea_parser_init(&parser, NULL, NULL);
+	for (int i = 0; i < ops; i++) {
+		nmea_parser_feed(&parser, s_sentences[i % BENCH_INPUTS], s_sentence_length[i % BENCH_INPUTS]);
+	}
+	s_sink += parser.sentences;
+}
+
+static void prv_body_ndef_parse(int ops)
+{
+	ndef_parser parser;
+	for (int i = 0; i < ops; i++) {
+		ndef_parser_init(&parser, NULL, NULL, NULL);
+		s_sink += ndef_parser_feed(&parser, s_ndef, s_ndef_length);
+	}
+}
+
+static void prv_body_crc16(int ops)
+{
+	for (int i = 0; i < ops; i++) {
+		s_sink += bulk_crc16(s_block, sizeof(s_block));
+	}
+}
+
+static void prv_body_tag_registry_find(int ops)
+{
+	for (int i = 0; i < ops; i++) {
+		s_sink += tag_registry_find(s_uids[i % BENCH_INPUTS], sizeof(s_uids[0]));
+	}
+}
+
+// runs in the app's event loop, with the app connected and polling the fake strap
+static void prv_app(void *context)
+{
+	if (!connected) {
+		fprintf(stderr, "the app didn't connect to the fake strap\n");
+		exit(1);
+	}
+	int ops = s_app_ops;
+	prv_time("format_number", prv_body_format_number, ops);
+	prv_time("format_digits", prv_body_format_digits, ops);
+	prv_time("update_data_text", prv_body_update_data_text, ops / 10);
+	prv_time("did_read_snapshot", prv_body_did_read_snapshot, ops / 10);
+	prv_time("did_read_nmea", prv_body_did_read_nmea, ops / 10);
+	prv_time("nmea_parse_3_sentences", prv_body_nmea_parse, ops / 10);
+	prv_time("ndef_parse_text", prv_body_ndef_parse, ops);
+	prv_time("bulk_crc16_264", prv_body_crc16, ops / 10);
+	prv_time("tag_registry_find", prv_body_tag_registry_find, ops);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *positional[2] = { "1000000", NULL };
+	int num_positional = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			s_json = fopen(argv[++i], "w");
+			if (!s_json) {
+				perror(argv[i]);
+				return 1;
+			}
+		}
+		else if (num_positional < 2) {
+			positional[num_positional++] = argv[i];
+		}
+	}
+	int fixes = atoi(positional[0]);
+
+	prv_accuracy(fixes / 4, 45);
+	prv_accuracy(fixes / 4, 70);
+	prv_cost(fixes);
+	prv_kalman(fixes);
+	if (positional[1]) {
+		prv_replay_file(positional[1]);
+	}
+
+	prv_app_inputs();
+	s_app_ops = fixes;
+	sim_seed(1);
+	sim_set_duration(BENCH_APP_AT + 1000);
+	sim_strap_set_all(30, 0, 0, 0);
+	sim_schedule(BENCH_APP_AT, prv_app, NULL);
+	xadow_main();
+
+	if (s_json) {
+		fclose(s_json);
+	}
+	return 0;
+}
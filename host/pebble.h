@@ -0,0 +1,540 @@
+// pebble.h : host stand-in for the subset of the Pebble SDK used by the app
+//
+// Only used by the Linux simulation harness (see wscript "sim" command), never
+// by the watch build. Declarations follow SDK 3 signatures so that the sources
+// in src/ compile unchanged; behaviour lives in sim_pebble.c and sim_strap.c.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ---------------------------------------------------------------------------
+// logging
+
+typedef enum {
+	APP_LOG_LEVEL_ERROR = 1,
+	APP_LOG_LEVEL_WARNING = 50,
+	APP_LOG_LEVEL_INFO = 100,
+	APP_LOG_LEVEL_DEBUG = 200,
+	APP_LOG_LEVEL_DEBUG_VERBOSE = 255,
+} AppLogLevel;
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt, ...)
+	__attribute__((format(printf, 4, 5)));
+
+#define APP_LOG(level, fmt, args...) \
+	app_log(level, __FILE__, __LINE__, fmt, ## args)
+
+// ---------------------------------------------------------------------------
+// time
+
+#define SECONDS_PER_MINUTE 60
+#define SECONDS_PER_HOUR 3600
+#define SECONDS_PER_DAY 86400
+
+time_t sim_time(time_t *tloc);
+#define time(tloc) sim_time(tloc)
+
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms);
+time_t time_start_of_today(void);
+bool clock_is_24h_style(void);
+
+typedef enum {
+	SECOND_UNIT = 1 << 0,
+	MINUTE_UNIT = 1 << 1,
+	HOUR_UNIT = 1 << 2,
+	DAY_UNIT = 1 << 3,
+	MONTH_UNIT = 1 << 4,
+	YEAR_UNIT = 1 << 5,
+} TimeUnits;
+
+typedef void (*TickHandler)(struct tm *tick_time, TimeUnits units_changed);
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
+void tick_timer_service_unsubscribe(void);
+
+// ---------------------------------------------------------------------------
+// app timer
+
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void *data);
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data);
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms);
+void app_timer_cancel(AppTimer *timer_handle);
+
+void app_event_loop(void);
+
+// ---------------------------------------------------------------------------
+// math
+
+#define TRIG_MAX_RATIO 0xffff
+#define TRIG_MAX_ANGLE 0x10000
+#define DEG_TO_TRIGANGLE(angle) (((angle) * TRIG_MAX_ANGLE) / 360)
+#define TRIGANGLE_TO_DEG(trig_angle) (((trig_angle) * 360) / TRIG_MAX_ANGLE)
+
+int32_t sin_lookup(int32_t angle);
+int32_t cos_lookup(int32_t angle);
+int32_t atan2_lookup(int16_t y, int16_t x);
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define ARRAY_LENGTH(array) (sizeof((array)) / sizeof((array)[0]))
+
+// ---------------------------------------------------------------------------
+// graphics types
+
+typedef union GColor8 {
+	uint8_t argb;
+	struct {
+		uint8_t b:2;
+		uint8_t g:2;
+		uint8_t r:2;
+		uint8_t a:2;
+	};
+} GColor8;
+typedef GColor8 GColor;
+
+#define GColorARGB8(a, r, g, b) ((GColor8){ .argb = (uint8_t)(((a) << 6) | ((r) << 4) | ((g) << 2) | (b)) })
+#define GColorClear       GColorARGB8(0, 0, 0, 0)
+#define GColorBlack       GColorARGB8(3, 0, 0, 0)
+#define GColorWhite       GColorARGB8(3, 3, 3, 3)
+#define GColorDarkGray    GColorARGB8(3, 1, 1, 1)
+#define GColorLightGray   GColorARGB8(3, 2, 2, 2)
+#define GColorDarkGreen   GColorARGB8(3, 0, 1, 0)
+#define GColorYellow      GColorARGB8(3, 3, 3, 0)
+#define GColorRed         GColorARGB8(3, 3, 0, 0)
+#define GColorPictonBlue  GColorARGB8(3, 1, 2, 3)
+#define GColorJaegerGreen GColorARGB8(3, 0, 3, 1)
+
+typedef struct GPoint {
+	int16_t x;
+	int16_t y;
+} GPoint;
+#define GPoint(x, y) ((GPoint){(x), (y)})
+
+typedef struct GSize {
+	int16_t w;
+	int16_t h;
+} GSize;
+#define GSize(w, h) ((GSize){(w), (h)})
+
+typedef struct GRect {
+	GPoint origin;
+	GSize size;
+} GRect;
+#define GRect(x, y, w, h) ((GRect){{(x), (y)}, {(w), (h)}})
+#define GRectZero GRect(0, 0, 0, 0)
+
+typedef struct GEdgeInsets {
+	int16_t top;
+	int16_t right;
+	int16_t bottom;
+	int16_t left;
+} GEdgeInsets;
+#define GEdgeInsets1(v) ((GEdgeInsets){(v), (v), (v), (v)})
+#define GEdgeInsets2(v, h) ((GEdgeInsets){(v), (h), (v), (h)})
+#define GEdgeInsets3(t, h, b) ((GEdgeInsets){(t), (h), (b), (h)})
+#define GEdgeInsets4(t, r, b, l) ((GEdgeInsets){(t), (r), (b), (l)})
+#define PRV_GEDGEINSETS_SELECT(_1, _2, _3, _4, name, ...) name
+#define GEdgeInsets(...) \
+	PRV_GEDGEINSETS_SELECT(__VA_ARGS__, GEdgeInsets4, GEdgeInsets3, GEdgeInsets2, GEdgeInsets1)(__VA_ARGS__)
+
+GRect grect_inset(GRect rect, GEdgeInsets insets);
+
+typedef enum {
+	GOvalScaleModeFitCircle,
+	GOvalScaleModeFillCircle,
+} GOvalScaleMode;
+
+GPoint gpoint_from_polar(GRect container, GOvalScaleMode scale_mode, int32_t angle);
+
+typedef enum {
+	GCompOpAssign,
+	GCompOpAssignInverted,
+	GCompOpOr,
+	GCompOpAnd,
+	GCompOpClear,
+	GCompOpSet,
+} GCompOp;
+
+typedef enum {
+	GTextAlignmentLeft,
+	GTextAlignmentCenter,
+	GTextAlignmentRight,
+} GTextAlignment;
+
+typedef enum {
+	GTextOverflowModeWordWrap,
+	GTextOverflowModeTrailingEllipsis,
+	GTextOverflowModeFill,
+} GTextOverflowMode;
+
+#define PBL_IF_ROUND_ELSE(if_true, if_false) (if_false)
+#define PBL_IF_COLOR_ELSE(if_true, if_false) (if_true)
+
+// ---------------------------------------------------------------------------
+// graphics context, fonts and bitmaps
+
+typedef struct GContext GContext;
+typedef const char *GFont;
+
+#define FONT_KEY_GOTHIC_14 "GOTHIC_14"
+#define FONT_KEY_GOTHIC_18 "GOTHIC_18"
+#define FONT_KEY_GOTHIC_24_BOLD "GOTHIC_24_BOLD"
+#define FONT_KEY_GOTHIC_28 "GOTHIC_28"
+#define FONT_KEY_BITHAM_30_BLACK "BITHAM_30_BLACK"
+
+GFont fonts_get_system_font(const char *font_key);
+
+void graphics_context_set_fill_color(GContext *ctx, GColor color);
+void graphics_context_set_stroke_color(GContext *ctx, GColor color);
+void graphics_context_set_compositing_mode(GContext *ctx, GCompOp mode);
+void graphics_fill_circle(GContext *ctx, GPoint p, uint16_t radius);
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius, int corner_mask);
+void graphics_fill_radial(GContext *ctx, GRect rect, GOvalScaleMode scale_mode, uint16_t inset_thickness,
+	int32_t angle_start, int32_t angle_end);
+
+typedef struct GBitmap GBitmap;
+
+typedef enum GBitmapFormat {
+	GBitmapFormat1Bit = 0,
+	GBitmapFormat8Bit,
+	GBitmapFormat1BitPalette,
+	GBitmapFormat2BitPalette,
+	GBitmapFormat4BitPalette,
+	GBitmapFormat8BitCircular,
+} GBitmapFormat;
+
+GBitmap *gbitmap_create_with_resource(uint32_t resource_id);
+GBitmap *gbitmap_create_blank(GSize size, GBitmapFormat format);
+void gbitmap_set_palette(GBitmap *bitmap, GColor *palette, bool free_on_destroy);
+uint8_t *gbitmap_get_data(const GBitmap *bitmap);
+uint16_t gbitmap_get_bytes_per_row(const GBitmap *bitmap);
+GRect gbitmap_get_bounds(const GBitmap *bitmap);
+void gbitmap_destroy(GBitmap *bitmap);
+void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bitmap, GRect rect);
+
+enum {
+	RESOURCE_ID_CHARGE = 1,
+	RESOURCE_ID_TICK,
+	RESOURCE_ID_CROSS,
+	RESOURCE_ID_CONFIRM,
+};
+
+// ---------------------------------------------------------------------------
+// layers and windows
+
+typedef struct Layer Layer;
+typedef void (*LayerUpdateProc)(Layer *layer, GContext *ctx);
+
+Layer *layer_create(GRect frame);
+void layer_destroy(Layer *layer);
+GRect layer_get_bounds(const Layer *layer);
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc);
+void layer_add_child(Layer *parent, Layer *child);
+void layer_mark_dirty(Layer *layer);
+void layer_set_hidden(Layer *layer, bool hidden);
+bool layer_get_hidden(const Layer *layer);
+
+typedef struct TextLayer TextLayer;
+
+TextLayer *text_layer_create(GRect frame);
+void text_layer_destroy(TextLayer *text_layer);
+Layer *text_layer_get_layer(TextLayer *text_layer);
+void text_layer_set_text(TextLayer *text_layer, const char *text);
+const char *text_layer_get_text(TextLayer *text_layer);
+void text_layer_set_font(TextLayer *text_layer, GFont font);
+void text_layer_set_text_color(TextLayer *text_layer, GColor color);
+void text_layer_set_background_color(TextLayer *text_layer, GColor color);
+void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment text_alignment);
+void text_layer_set_overflow_mode(TextLayer *text_layer, GTextOverflowMode line_mode);
+
+typedef struct BitmapLayer BitmapLayer;
+
+BitmapLayer *bitmap_layer_create(GRect frame);
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer);
+Layer *bitmap_layer_get_layer(const BitmapLayer *bitmap_layer);
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap);
+void bitmap_layer_set_compositing_mode(BitmapLayer *bitmap_layer, GCompOp mode);
+
+typedef enum {
+	BUTTON_ID_BACK = 0,
+	BUTTON_ID_UP,
+	BUTTON_ID_SELECT,
+	BUTTON_ID_DOWN,
+	NUM_BUTTONS
+} ButtonId;
+
+typedef void *ClickRecognizerRef;
+typedef void (*ClickHandler)(ClickRecognizerRef recognizer, void *context);
+typedef void (*ClickConfigProvider)(void *context);
+
+typedef struct Window Window;
+typedef void (*WindowHandler)(Window *window);
+
+typedef struct WindowHandlers {
+	WindowHandler load;
+	WindowHandler appear;
+	WindowHandler disappear;
+	WindowHandler unload;
+} WindowHandlers;
+
+Window *window_create(void);
+void window_destroy(Window *window);
+Layer *window_get_root_layer(const Window *window);
+void window_set_window_handlers(Window *window, WindowHandlers handlers);
+void window_set_click_config_provider(Window *window, ClickConfigProvider click_config_provider);
+void window_set_click_config_provider_with_context(Window *window, ClickConfigProvider click_config_provider, void *context);
+void window_set_background_color(Window *window, GColor background_color);
+void window_set_user_data(Window *window, void *data);
+void *window_get_user_data(const Window *window);
+void window_single_click_subscribe(ButtonId button_id, ClickHandler handler);
+void window_long_click_subscribe(ButtonId button_id, uint16_t delay_ms, ClickHandler down_handler, ClickHandler up_handler);
+void window_multi_click_subscribe(ButtonId button_id, uint8_t min_clicks, uint8_t max_clicks, uint16_t timeout,
+	bool last_click_only, ClickHandler handler);
+void window_stack_push(Window *window, bool animated);
+bool window_stack_remove(Window *window, bool animated);
+
+#define ACTION_BAR_WIDTH 30
+
+typedef struct ActionBarLayer ActionBarLayer;
+
+ActionBarLayer *action_bar_layer_create(void);
+void action_bar_layer_destroy(ActionBarLayer *action_bar);
+void action_bar_layer_set_icon(ActionBarLayer *action_bar, ButtonId button_id, const GBitmap *icon);
+void action_bar_layer_add_to_window(ActionBarLayer *action_bar, Window *window);
+void action_bar_layer_set_context(ActionBarLayer *action_bar, void *context);
+void action_bar_layer_set_click_config_provider(ActionBarLayer *action_bar, ClickConfigProvider click_config_provider);
+
+// ---------------------------------------------------------------------------
+// health
+
+typedef int32_t HealthValue;
+
+typedef enum {
+	HealthMetricStepCount,
+	HealthMetricActiveSeconds,
+	HealthMetricWalkedDistanceMeters,
+	HealthMetricSleepSeconds,
+	HealthMetricSleepRestfulSeconds,
+	HealthMetricRestingKCalories,
+	HealthMetricActiveKCalories,
+	HealthMetricHeartRateBPM,
+} HealthMetric;
+
+typedef enum {
+	HealthEventSignificantUpdate = 0,
+	HealthEventMovementUpdate,
+	HealthEventSleepUpdate,
+	HealthEventMetricAlert,
+	HealthEventHeartRateUpdate,
+} HealthEventType;
+
+typedef enum {
+	HealthServiceAccessibilityMaskAvailable = 1 << 0,
+	HealthServiceAccessibilityMaskNoPermission = 1 << 1,
+	HealthServiceAccessibilityMaskNotSupported = 1 << 2,
+	HealthServiceAccessibilityMaskNotAvailable = 1 << 3,
+} HealthServiceAccessibilityMask;
+
+typedef enum {
+	HealthServiceTimeScopeOnce,
+	HealthServiceTimeScopeWeekly,
+	HealthServiceTimeScopeDailyWeekdayOrWeekend,
+	HealthServiceTimeScopeDaily,
+} HealthServiceTimeScope;
+
+typedef enum {
+	AmbientLightLevelUnknown = 0,
+	AmbientLightLevelVeryDark,
+	AmbientLightLevelDark,
+	AmbientLightLevelLight,
+	AmbientLightLevelVeryLight,
+} AmbientLightLevel;
+
+typedef struct {
+	uint8_t steps;
+	uint8_t orientation;
+	uint16_t vmc;
+	bool is_invalid: 1;
+	AmbientLightLevel light: 3;
+	uint8_t padding: 4;
+	uint8_t heart_rate_bpm;
+	uint8_t reserved[6];
+} HealthMinuteData;
+
+typedef void (*HealthEventHandler)(HealthEventType event, void *context);
+
+bool health_service_events_subscribe(HealthEventHandler handler, void *context);
+bool health_service_events_unsubscribe(void);
+HealthServiceAccessibilityMask health_service_metric_accessible(HealthMetric metric, time_t time_start, time_t time_end);
+HealthValue health_service_sum_today(HealthMetric metric);
+HealthValue health_service_sum(HealthMetric metric, time_t time_start, time_t time_end);
+HealthValue health_service_sum_averaged(HealthMetric metric, time_t time_start, time_t time_end,
+	HealthServiceTimeScope scope);
+uint32_t health_service_get_minute_history(HealthMinuteData *minute_data, uint32_t max_records, time_t *time_start,
+	time_t *time_end);
+
+// ---------------------------------------------------------------------------
+// persistent storage
+
+typedef int32_t status_t;
+
+#define S_SUCCESS 0
+#define E_ERROR -1
+#define E_INVALID_ARGUMENT -2
+#define E_OUT_OF_STORAGE -7
+#define E_DOES_NOT_EXIST -11
+
+#define PERSIST_DATA_MAX_LENGTH 256
+#define PERSIST_STRING_MAX_LENGTH PERSIST_DATA_MAX_LENGTH
+
+bool persist_exists(const uint32_t key);
+int persist_get_size(const uint32_t key);
+bool persist_read_bool(const uint32_t key);
+int32_t persist_read_int(const uint32_t key);
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size);
+status_t persist_write_bool(const uint32_t key, const bool value);
+status_t persist_write_int(const uint32_t key, const int32_t value);
+int persist_write_data(const uint32_t key, const void *data, const size_t size);
+status_t persist_delete(const uint32_t key);
+
+// ---------------------------------------------------------------------------
+// dictionaries and app messages
+
+typedef enum {
+	TUPLE_BYTE_ARRAY = 0,
+	TUPLE_CSTRING = 1,
+	TUPLE_UINT = 2,
+	TUPLE_INT = 3,
+} TupleType;
+
+typedef struct __attribute__((__packed__)) {
+	uint32_t key;
+	TupleType type:8;
+	uint16_t length;
+	union {
+		uint8_t data[0];
+		char cstring[0];
+		uint8_t uint8;
+		uint16_t uint16;
+		uint32_t uint32;
+		int8_t int8;
+		int16_t int16;
+		int32_t int32;
+	} value[];
+} Tuple;
+
+typedef struct Dictionary Dictionary;
+
+typedef struct {
+	Dictionary *dictionary;
+	const void *end;
+	Tuple *cursor;
+} DictionaryIterator;
+
+typedef enum {
+	DICT_OK = 0,
+	DICT_NOT_ENOUGH_STORAGE = 1 << 1,
+	DICT_INVALID_ARGS = 1 << 2,
+	DICT_INTERNAL_INCONSISTENCY = 1 << 3,
+	DICT_MALLOC_FAILED = 1 << 4,
+} DictionaryResult;
+
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t * const buffer, const uint16_t size);
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t * const data,
+	const uint16_t size);
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value);
+uint32_t dict_write_end(DictionaryIterator *iter);
+Tuple *dict_read_begin_from_buffer(DictionaryIterator *iter, const uint8_t * const buffer, const uint16_t size);
+Tuple *dict_read_first(DictionaryIterator *iter);
+Tuple *dict_read_next(DictionaryIterator *iter);
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key);
+
+typedef enum {
+	APP_MSG_OK = 0,
+	APP_MSG_SEND_TIMEOUT = 1 << 1,
+	APP_MSG_SEND_REJECTED = 1 << 2,
+	APP_MSG_NOT_CONNECTED = 1 << 3,
+	APP_MSG_APP_NOT_RUNNING = 1 << 4,
+	APP_MSG_INVALID_ARGS = 1 << 5,
+	APP_MSG_BUSY = 1 << 6,
+	APP_MSG_BUFFER_OVERFLOW = 1 << 7,
+	APP_MSG_ALREADY_RELEASED = 1 << 9,
+	APP_MSG_CALLBACK_ALREADY_REGISTERED = 1 << 10,
+	APP_MSG_CALLBACK_NOT_REGISTERED = 1 << 11,
+	APP_MSG_OUT_OF_MEMORY = 1 << 12,
+	APP_MSG_CLOSED = 1 << 13,
+	APP_MSG_INTERNAL_ERROR = 1 << 14,
+} AppMessageResult;
+
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageInboxDropped)(AppMessageResult reason, void *context);
+typedef void (*AppMessageOutboxSent)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator *iterator, AppMessageResult reason, void *context);
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound);
+void *app_message_set_context(void *context);
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback);
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback);
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback);
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback);
+uint32_t app_message_inbox_size_maximum(void);
+uint32_t app_message_outbox_size_maximum(void);
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator);
+AppMessageResult app_message_outbox_send(void);
+
+// ---------------------------------------------------------------------------
+// smartstrap
+
+typedef enum {
+	SmartstrapResultOk = 0,
+	SmartstrapResultInvalidArgs,
+	SmartstrapResultNotPresent,
+	SmartstrapResultBusy,
+	SmartstrapResultServiceUnavailable,
+	SmartstrapResultAttributeUnsupported,
+	SmartstrapResultTimeOut,
+} SmartstrapResult;
+
+typedef uint16_t SmartstrapServiceId;
+typedef uint16_t SmartstrapAttributeId;
+typedef struct SmartstrapAttribute SmartstrapAttribute;
+
+#define SMARTSTRAP_RAW_DATA_SERVICE_ID 0
+#define SMARTSTRAP_RAW_DATA_ATTRIBUTE_ID 0
+#define SMARTSTRAP_TIMEOUT_DEFAULT 250
+
+typedef void (*SmartstrapServiceAvailabilityHandler)(SmartstrapServiceId service_id, bool is_available);
+typedef void (*SmartstrapReadHandler)(SmartstrapAttribute *attribute, SmartstrapResult result,
+	const uint8_t *data, size_t length);
+typedef void (*SmartstrapWriteHandler)(SmartstrapAttribute *attribute, SmartstrapResult result);
+typedef void (*SmartstrapNotifyHandler)(SmartstrapAttribute *attribute);
+
+typedef struct {
+	SmartstrapServiceAvailabilityHandler availability_did_change;
+	SmartstrapReadHandler did_read;
+	SmartstrapWriteHandler did_write;
+	SmartstrapNotifyHandler notified;
+} SmartstrapHandlers;
+
+SmartstrapResult smartstrap_subscribe(SmartstrapHandlers handlers);
+void smartstrap_unsubscribe(void);
+void smartstrap_set_timeout(uint16_t timeout_ms);
+SmartstrapAttribute *smartstrap_attribute_create(SmartstrapServiceId service_id,
+	SmartstrapAttributeId attribute_id, size_t buffer_length);
+void smartstrap_attribute_destroy(SmartstrapAttribute *attribute);
+bool smartstrap_service_is_available(SmartstrapServiceId service_id);
+SmartstrapServiceId smartstrap_attribute_get_service_id(SmartstrapAttribute *attribute);
+SmartstrapAttributeId smartstrap_attribute_get_attribute_id(SmartstrapAttribute *attribute);
+SmartstrapResult smartstrap_attribute_read(SmartstrapAttribute *attribute);
+SmartstrapResult smartstrap_attribute_begin_write(SmartstrapAttribute *attribute, uint8_t **buffer,
+	size_t *buffer_length);
+SmartstrapResult smartstrap_attribute_end_write(SmartstrapAttribute *attribute, size_t write_length,
+	bool request_read);
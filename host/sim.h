@@ -0,0 +1,144 @@
+// sim.h : virtual clock, event queue and scriptable fake strap for the host harness
+//
+// Everything runs on a deterministic virtual millisecond clock: app timers,
+// strap responses and scripted scenario events are ordered by due time, so a
+// given scenario and seed always produce the same report.
+
+#pragma once
+
+#include <pebble.h>
+
+#define SIM_EPOCH 1466000000
+
+typedef void (*SimEventHandler)(void *context);
+
+// clock and event queue
+uint64_t sim_now_ms(void);
+void sim_schedule(uint64_t at_ms, SimEventHandler handler, void *context);
+void sim_set_duration(uint64_t duration_ms);
+void sim_set_verbose(bool verbose);
+
+// deterministic random source shared by the fake strap and scenarios
+void sim_seed(uint32_t seed);
+uint32_t sim_random(void);
+uint32_t sim_random_range(uint32_t lo, uint32_t hi);
+
+// app timer accounting, keyed by callback
+typedef struct SimTimerStats {
+	AppTimerCallback callback;
+	uint32_t registered;
+	uint32_t fired;
+	uint32_t cancelled;
+} SimTimerStats;
+
+const SimTimerStats *sim_timer_stats(int *count);
+int sim_timer_max_armed(void);
+uint32_t sim_log_count(void);
+
+// rendering accounting (one frame per event that left a layer dirty)
+typedef struct SimRenderStats {
+	uint32_t frames;
+	uint32_t dirty_marks;
+	uint64_t dirty_area;        // pixels of the layers marked dirty
+	uint32_t text_updates;
+	uint32_t draw_calls;
+	uint64_t draw_area;
+} SimRenderStats;
+
+const SimRenderStats *sim_render_stats(void);
+
+// health aggregate queries and the minute records they had to sum
+typedef struct SimHealthStats {
+	uint32_t queries;
+	uint64_t minutes_summed;
+} SimHealthStats;
+
+const SimHealthStats *sim_health_stats(void);
+
+// persistent storage, optionally backed by a file so that a run can resume where another left off
+typedef struct SimPersistStats {
+	uint32_t writes;
+	uint32_t bytes_written;
+	uint32_t deletes;
+	uint32_t keys;
+	uint32_t bytes_stored;
+} SimPersistStats;
+
+bool sim_persist_load(const char *path);
+bool sim_persist_save(const char *path);
+const SimPersistStats *sim_persist_stats(void);
+
+// app message link to a fake phone that exports the recorded track like src/js/app.js
+typedef struct SimPhoneStats {
+	uint32_t messages_to_phone;
+	uint32_t bytes_to_phone;
+	uint32_t lost;
+	uint32_t out_of_order;
+	uint32_t fixes;
+	uint32_t fused;             // of the fixes, those that came with their steps and cadence
+	uint32_t steps;
+	uint8_t cadence;            // of the newest fused fix
+	uint64_t requested_ms;
+	uint64_t done_ms;
+} SimPhoneStats;
+
+void sim_phone_set_link(uint32_t latency_ms, uint32_t bytes_per_s, uint8_t loss_pct);
+void sim_phone_request_export(uint64_t at_ms);
+const SimPhoneStats *sim_phone_stats(void);
+
+// button presses on the top window
+void sim_button_click(ButtonId button_id);
+void sim_button_long_click(ButtonId button_id);
+void sim_button_double_click(ButtonId button_id);
+// the text of the visible text layers of the top window
+void sim_print_window(FILE *out);
+
+// fake strap endpoint, one per (service, attribute)
+typedef struct SimStrapEndpoint {
+	SmartstrapServiceId service_id;
+	SmartstrapAttributeId attribute_id;
+
+	// behaviour
+	uint32_t latency_ms;
+	uint32_t jitter_ms;
+	uint8_t busy_pct;
+	uint8_t timeout_pct;
+	bool unsupported;
+	uint8_t corrupt_pct;          // frames of a bulk reply garbled on the way
+
+	// statistics
+	bool created;
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t ok;
+	uint32_t busy;
+	uint32_t unavailable;
+	uint32_t timeouts;
+	uint32_t unsupported_replies;
+	uint32_t notifications;
+	uint64_t latency_total_ms;
+	uint64_t last_ok_ms;
+	uint8_t value[32];            // world value as of the last successful read
+	size_t value_length;
+	uint64_t diverged_ms;         // when the world moved away from it, 0 while current
+	uint64_t age_total_ms;        // time since the last successful read
+	uint64_t staleness_total_ms;  // time the app's copy has been out of date
+	uint64_t staleness_max_ms;
+	uint32_t staleness_samples;
+} SimStrapEndpoint;
+
+SimStrapEndpoint *sim_strap_endpoint(SmartstrapServiceId service_id, SmartstrapAttributeId attribute_id);
+void sim_strap_set_all(uint32_t latency_ms, uint32_t jitter_ms, uint8_t busy_pct, uint8_t timeout_pct);
+void sim_strap_set_max_in_flight(int max_in_flight);
+void sim_strap_pause_walker(uint64_t from_ms, uint64_t to_ms);
+void sim_strap_set_gps_noise(uint16_t metres);
+void sim_strap_notify_changes(void);
+void sim_strap_schedule_presence(uint64_t at_ms, bool present);
+void sim_strap_schedule_service(uint64_t at_ms, SmartstrapServiceId service_id, bool available);
+// the tag with the given serial comes into range, or leaves it for serial 0; a tag not seen
+// before holds the default message
+void sim_strap_schedule_tag(uint64_t at_ms, uint8_t serial);
+void sim_strap_schedule_notify(uint64_t at_ms, SmartstrapServiceId service_id, SmartstrapAttributeId attribute_id);
+uint32_t sim_strap_nmea_dropped(void);
+void sim_strap_sample_staleness(void);
+void sim_strap_report(FILE *out, uint64_t duration_ms);
@@ -0,0 +1,422 @@
+// sim_main.c : runs the watch app's polling loop against the fake strap
+//
+// usage: sim [scenario] [seconds] [seed] [-v] [-p file] [-t metres]
+//
+// With -p, persistent storage is loaded from the file before the run and saved to it after,
+// so that consecutive runs behave like the app being closed and opened again. -t sets the
+// tolerance of the track simplifier.
+//
+// The app translation unit is included directly so that its static timer
+// callbacks can be named in the report.
+
+#include "sim.h"
+
+#define main xadow_main
+#include "../src/xadow_window.c"
+#undef main
+
+#define SAMPLE_PERIOD_MS 100
+
+typedef struct {
+	const char *name;
+	const char *description;
+	void (*setup)(uint64_t duration_ms);
+} SimScenario;
+
+static const struct {
+	AppTimerCallback callback;
+	const char *name;
+} s_callback_names[] = {
+	{ link_timer_fired, "link_timer_fired" },
+};
+
+static void prv_setup_ideal(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 0, 0, 0);
+}
+
+static void prv_setup_legacy(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 0, 0, 0);
+	sim_strap_endpoint(SERVICE_GPS, ATTR_GPS_SNAPSHOT)->unsupported = true;
+}
+
+static void prv_setup_pipeline(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 20, 0, 0);
+	sim_strap_set_max_in_flight(3);
+	for (uint64_t t = 5000; t < duration_ms; t += 10000) {
+		sim_strap_schedule_notify(t, SERVICE_NFC, ATTR_NFC_GET_UID);
+	}
+}
+
+static void prv_setup_stationary(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 0, 0, 0);
+	sim_strap_pause_walker(duration_ms / 4, duration_ms * 3 / 4);
+}
+
+static void prv_setup_notify(uint64_t duration_ms)
+{
+	prv_setup_stationary(duration_ms);
+	sim_strap_notify_changes();
+}
+
+static void prv_setup_noisy(uint64_t duration_ms)
+{
+	prv_setup_stationary(duration_ms);
+	sim_strap_set_gps_noise(3);
+}
+
+static void prv_setup_slow(uint64_t duration_ms)
+{
+	sim_strap_set_all(80, 520, 0, 0);
+}
+
+static void prv_setup_busy(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 20, 20, 0);
+}
+
+static void prv_setup_timeout(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 20, 0, 10);
+}
+
+static void prv_setup_flap(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 20, 5, 2);
+	for (uint64_t t = 15000; t + 5000 < duration_ms; t += 30000) {
+		sim_strap_schedule_presence(t, false);
+		sim_strap_schedule_presence(t + 5000, true);
+	}
+	for (uint64_t t = 7000; t + 3000 < duration_ms; t += 20000) {
+		sim_strap_schedule_service(t, SERVICE_GPS, false);
+		sim_strap_schedule_service(t + 3000, SERVICE_GPS, true);
+	}
+}
+
+static void prv_setup_export(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 0, 0, 0);
+	sim_phone_set_link(60, 6000, 3);
+	sim_phone_request_export(duration_ms * 3 / 4);
+}
+
+static void prv_phone_gone(void *context)
+{
+	sim_phone_set_link(60, 6000, 100);
+}
+
+// the phone goes out of range as the export starts and never comes back
+static void prv_setup_phonegone(uint64_t duration_ms)
+{
+	prv_setup_export(duration_ms);
+	sim_schedule(duration_ms * 3 / 4 + 100, prv_phone_gone, NULL);
+}
+
+static void prv_setup_nostrap(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 0, 0, 0);
+	sim_strap_schedule_presence(0, false);
+	sim_strap_schedule_presence(duration_ms / 2, true);
+}
+
+static void prv_press(void *context)
+{
+	sim_button_click((ButtonId)(intptr_t)context);
+}
+
+static void prv_long_press(void *context)
+{
+	sim_button_long_click((ButtonId)(intptr_t)context);
+}
+
+static void prv_double_press(void *context)
+{
+	sim_button_double_click((ButtonId)(intptr_t)context);
+}
+
+// the track recorded so far is dropped, stored chunks and all, and a new one starts
+static void prv_setup_activity(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 0, 0, 0);
+	sim_schedule(duration_ms / 2, prv_double_press, (void *)BUTTON_ID_SELECT);
+}
+
+static void prv_setup_diagnostics(uint64_t duration_ms)
+{
+	prv_setup_busy(duration_ms);
+	sim_schedule(duration_ms / 4, prv_long_press, (void *)BUTTON_ID_DOWN);
+	sim_schedule(duration_ms / 2, prv_press, (void *)BUTTON_ID_DOWN);
+}
+
+static void prv_write_tag(void *context)
+{
+	//a single text record
+	static const uint8_t message[] = { 0xD1, 0x01, 0x0F, 'T', 0x02, 'e', 'n',
+		'C', 'h', 'e', 'c', 'k', 'p', 'o', 'i', 'n', 't', ' ', '2' };
+	if (!ndef_write_start(message, sizeof(message))) {
+		printf("sim: tag write refused\n");
+	}
+}
+
+static void prv_setup_ndef(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 20, 0, 0);
+	sim_strap_schedule_tag(duration_ms / 8, 2);
+	sim_schedule(duration_ms * 3 / 8, prv_write_tag, NULL);
+	sim_strap_schedule_tag(duration_ms * 5 / 8, 0);
+	sim_strap_schedule_tag(duration_ms * 6 / 8, 2);
+}
+
+// a course already set up with 150 other tags
+static void prv_register_tags(void *context)
+{
+	for (int i = 0; i < 150; i++) {
+		uint8_t uid[7] = { 0x04 };
+		for (size_t b = 1; b < sizeof(uid); b++) {
+			uid[b] = (uint8_t)sim_random();
+		}
+		tag_registry_add(uid, sizeof(uid), 10 + i);
+	}
+}
+
+static void prv_setup_course(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 20, 0, 0);
+	sim_schedule(1, prv_register_tags, NULL);
+
+	//two tags registered on the way out, then passed on the way back
+	uint64_t step = duration_ms / 10;
+	sim_strap_schedule_tag(1 * step, 2);
+	sim_schedule(1 * step + 1000, prv_long_press, (void *)BUTTON_ID_SELECT);
+	sim_strap_schedule_tag(2 * step, 0);
+	sim_strap_schedule_tag(3 * step, 3);
+	sim_schedule(3 * step + 1000, prv_long_press, (void *)BUTTON_ID_SELECT);
+	sim_strap_schedule_tag(4 * step, 0);
+	sim_strap_schedule_tag(6 * step, 3);
+	sim_strap_schedule_tag(7 * step, 0);
+	sim_strap_schedule_tag(9 * step, 2);
+}
+
+static void prv_setup_backlog(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 20, 0, 0);
+	sim_strap_endpoint(SMARTSTRAP_RAW_DATA_SERVICE_ID, SMARTSTRAP_RAW_DATA_ATTRIBUTE_ID)->corrupt_pct = 5;
+	sim_strap_schedule_presence(duration_ms / 6, false);
+	sim_strap_schedule_presence(duration_ms * 5 / 6, true);
+}
+
+static void prv_setup_nmea(uint64_t duration_ms)
+{
+	sim_strap_set_all(30, 20, 0, 0);
+	sim_strap_endpoint(SERVICE_GPS, ATTR_GPS_NMEA)->corrupt_pct = 2;
+	sim_schedule(duration_ms / 10, prv_long_press, (void *)BUTTON_ID_UP);
+}
+
+static const SimScenario s_scenarios[] = {
+	{ "ideal", "all endpoints answer in 30 ms", prv_setup_ideal },
+	{ "legacy", "strap firmware without the composite gps attribute", prv_setup_legacy },
+	{ "pipeline", "firmware takes three reads at once, a tag every 10 s", prv_setup_pipeline },
+	{ "stationary", "walker stands still for the middle half of the run", prv_setup_stationary },
+	{ "notify", "as stationary, but the strap notifies new fixes and battery changes", prv_setup_notify },
+	{ "noisy", "as stationary, with the receiver position wandering by 3 m", prv_setup_noisy },
+	{ "slow", "80-600 ms latency, the slowest replies exceed the strap timeout", prv_setup_slow },
+	{ "busy", "20% of requests rejected with Busy", prv_setup_busy },
+	{ "timeout", "10% of requests time out", prv_setup_timeout },
+	{ "flap", "strap unplugged for 5 s every 30 s, GPS service drops every 20 s", prv_setup_flap },
+	{ "export", "the phone fetches the track over a lossy link 3/4 into the run (try 1200 s)", prv_setup_export },
+	{ "phonegone", "as export, but the phone goes out of range as it starts", prv_setup_phonegone },
+	{ "nostrap", "no strap for the first half of the run", prv_setup_nostrap },
+	{ "diag", "as busy, with the diagnostics window opened 1/4 into the run", prv_setup_diagnostics },
+	{ "ndef", "a new tag is read, written, taken away and read again", prv_setup_ndef },
+	{ "backlog", "strap unplugged for 2/3 of the run, its log fetched after, 5% of frames garbled",
+		prv_setup_backlog },
+	{ "nmea", "switched to the nmea stream 1/10 into the run, 2% of reads with a byte garbled", prv_setup_nmea },
+	{ "activity", "a new activity started half way through the run (try 1200 s)", prv_setup_activity },
+	{ "course", "two tags registered as checkpoints among 150 others, then passed", prv_setup_course },
+};
+
+static const char *prv_callback_name(AppTimerCallback callback)
+{
+	for (size_t i = 0; i < ARRAY_LENGTH(s_callback_names); i++) {
+		if (s_callback_names[i].callback == callback) {
+			return s_callback_names[i].name;
+		}
+	}
+	return "(other)";
+}
+
+static void prv_sample(void *context)
+{
+	sim_strap_sample_staleness();
+	sim_schedule(sim_now_ms() + SAMPLE_PERIOD_MS, prv_sample, NULL);
+}
+
+static void prv_report(const SimScenario *scenario, uint64_t duration_ms, uint32_t seed)
+{
+	printf("scenario: %s (%s), %llu s, seed %u\n\n", scenario->name, scenario->description,
+		(unsigned long long)(duration_ms / 1000), seed);
+
+	sim_strap_report(stdout, duration_ms);
+
+	int count;
+	const SimTimerStats *stats = sim_timer_stats(&count);
+	printf("\n%-26s %10s %8s %9s\n", "timer callback", "registered", "fired", "cancelled");
+	for (int i = 0; i < count; i++) {
+		printf("%-26s %10u %8u %9u\n", prv_callback_name(stats[i].callback),
+			stats[i].registered, stats[i].fired, stats[i].cancelled);
+	}
+	printf("max armed timers: %d, max link timer chains: %d, connects: %u\n",
+		sim_timer_max_armed(), link.max_chains, link.reconnects);
+
+	printf("\nrtt estimates:");
+	for (int i = 0; i < XADOW_NUM_ATTRIBUTES; i++) {
+		struct endpoint *ep = &readable_end_points[i];
+		if (ep->srtt) {
+			printf(" %04x:%04x srtt %u rto %u;", smartstrap_attribute_get_service_id(ep->attr),
+				smartstrap_attribute_get_attribute_id(ep->attr), ep->srtt >> 3, ep->rto);
+		}
+	}
+	printf("\n");
+
+	printf("\n%-10s %7s %7s %5s %5s %5s %5s %5s %6s %6s\n", "attribute", "reads", "ok", "busy", "t/o",
+		"lost", "uns", "err", "p50", "p95");
+	for (int i = 0; i < bus_stats_count(); i++) {
+		const bus_attr_stats *bus = bus_stats_get(i);
+		printf("%04x:%04x  %7u %7u %5u %5u %5u %5u %5u %6u %6u\n", bus->service_id, bus->attr_id, bus->reads,
+			bus->ok, bus->busy, bus->timeouts, bus->lost, bus->unsupported, bus->errors,
+			bus_stats_latency_percentile(bus, 50), bus_stats_latency_percentile(bus, 95));
+	}
+
+	printf("\npipeline: %u reads, depth %d (max %d), %u refused, idle %u ms\n",
+		pipeline_stats.reads, pipeline_limit, pipeline_stats.max_depth, pipeline_stats.busy,
+		pipeline_stats.idle_ms);
+
+	fix_log_iter it;
+	gps_fix first = { 0 }, last = { 0 }, f;
+	uint32_t decoded = 0;
+	fix_log_iter_init(&it);
+	while (fix_log_iter_next(&it, &f)) {
+		if (!decoded++) {
+			first = f;
+		}
+		last = f;
+	}
+	const SimPersistStats *persist = sim_persist_stats();
+	printf("persist: %u writes, %u bytes written, %u deletes, %u keys holding %u bytes, %u track chunks\n",
+		persist->writes, persist->bytes_written, persist->deletes, persist->keys, persist->bytes_stored,
+		track_store_count());
+	printf("fix log: %u fixes in %u bytes (%.1f bytes/fix), %u decoded over %u s, last %s\n",
+		fix_log_count(), (unsigned)fix_log_size(),
+		fix_log_count() ? (double)fix_log_size() / fix_log_count() : 0.0,
+		decoded, last.time - first.time,
+		decoded && last.lat == smoothed.lat && last.lon == smoothed.lon ? "matches" : "differs");
+
+	printf("odometer: %.1f m, pace %u s/km\n", odometer.distance / 100.0, geo_odometer_pace(&odometer));
+
+	const simplify_stats *simplified = track_simplify_stats();
+	printf("simplify: %u fixes, %u kept (%.1f:1)\n", simplified->in, simplified->out,
+		simplified->out ? (double)simplified->in / simplified->out : 0.0);
+
+	const fusion_stats *fused = track_fusion_stats();
+	printf("fusion: %u blocks, %u fixes, %u steps from %u minutes in %u queries\n", fused->blocks, fused->fixes,
+		fused->steps, fused->minutes, fused->queries);
+
+	if (s_nmea.sentences || s_nmea.errors) {
+		printf("nmea: %u sentences, %u dropped (%u queued on the strap lost), hdop %u.%02u\n", s_nmea.sentences,
+			s_nmea.errors, sim_strap_nmea_dropped(), s_nmea.data.hdop / 100, s_nmea.data.hdop % 100);
+	}
+	const bulk_stats *bulk = bulk_transfer_stats();
+	if (bulk->requests) {
+		printf("backlog: %u requests, %u frames (%u asked again, %u bad), %u fixes, %u bytes in %u ms%s, %.0f fixes/s\n",
+			bulk->requests, bulk->frames, bulk->asked_again, bulk->bad, bulk->fixes, bulk->bytes, backlog.took,
+			bulk_transfer_active() ? " (unfinished)" : "", backlog.took ? bulk->fixes * 1000.0 / backlog.took : 0.0);
+	}
+	printf("checkpoints: %u tags registered, highest %u, last split at checkpoint %u\n", tag_registry_count(),
+		tag_registry_highest(), split.checkpoint);
+	if (tagid[0]) {
+		printf("tag: %02x%02x%02x%02x, text \"%s\"%s\n", (uint8_t)tagid[0], (uint8_t)tagid[1], (uint8_t)tagid[2],
+			(uint8_t)tagid[3], s_tag_text,
+			ndef_transfer_active() ? ", transfer running" : "");
+	}
+
+	const SimPhoneStats *phone = sim_phone_stats();
+	if (phone->requested_ms) {
+		uint64_t elapsed = (phone->done_ms ? phone->done_ms : duration_ms) - phone->requested_ms;
+		printf("export: %u messages (%u resent, %u lost), %u bytes, %u fixes in %llu ms%s, %.0f fixes/s\n",
+			phone->messages_to_phone, track_export_stats()->resent, phone->lost, phone->bytes_to_phone,
+			phone->fixes, (unsigned long long)elapsed,
+			phone->done_ms ? "" : track_export_stats()->gave_up ? " (watch gave up)" : " (unfinished)",
+			elapsed ? phone->fixes * 1000.0 / elapsed : 0.0);
+		printf("export steps: %u of the fixes with %u steps, newest cadence %u/min\n", phone->fused, phone->steps,
+			phone->cadence);
+	}
+
+	const SimRenderStats *render = sim_render_stats();
+	printf("\nframes: %u  text updates: %u  dirty area: %llu px  draw calls: %u  log lines: %u\n",
+		render->frames, render->text_updates, (unsigned long long)render->dirty_area, render->draw_calls,
+		sim_log_count());
+	const SimHealthStats *health = sim_health_stats();
+	printf("health: %u queries over %llu minute records\n", health->queries,
+		(unsigned long long)health->minutes_summed);
+
+	printf("\ntop window:\n");
+	sim_print_window(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *positional[3] = { "ideal", "60", "1" };
+	int num_positional = 0;
+	const char *persist_path = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-v") == 0) {
+			sim_set_verbose(true);
+		}
+		else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			persist_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			track_simplify_set_tolerance((uint16_t)atoi(argv[++i]));
+		}
+		else if (num_positional < 3) {
+			positional[num_positional++] = argv[i];
+		}
+	}
+
+	const SimScenario *scenario = NULL;
+	for (size_t i = 0; i < ARRAY_LENGTH(s_scenarios); i++) {
+		if (strcmp(s_scenarios[i].name, positional[0]) == 0) {
+			scenario = &s_scenarios[i];
+		}
+	}
+	if (!scenario) {
+		fprintf(stderr, "usage: %s [scenario] [seconds] [seed] [-v] [-p file] [-t metres]\nscenarios:\n", argv[0]);
+		for (size_t i = 0; i < ARRAY_LENGTH(s_scenarios); i++) {
+			fprintf(stderr, "  %-10s %s\n", s_scenarios[i].name, s_scenarios[i].description);
+		}
+		return 1;
+	}
+
+	uint64_t duration_ms = strtoull(positional[1], NULL, 10) * 1000;
+	uint32_t seed = (uint32_t)strtoul(positional[2], NULL, 10);
+
+	sim_seed(seed);
+	sim_set_duration(duration_ms);
+	scenario->setup(duration_ms);
+	sim_schedule(SAMPLE_PERIOD_MS, prv_sample, NULL);
+
+	if (persist_path) {
+		sim_persist_load(persist_path);
+	}
+	xadow_main();
+	if (persist_path) {
+		sim_persist_save(persist_path);
+	}
+
+	prv_report(scenario, duration_ms, seed);
+	return 0;
+}
@@ -0,0 +1,1227 @@
+// sim_pebble.c : virtual-time implementation of the Pebble SDK stand-in
+
+#include <pebble.h>
+#include <math.h>
+#include <stdarg.h>
+#include "sim.h"
+
+#undef time
+
+#define MAX_EVENTS 256
+#define MAX_TIMERS 64
+#define MAX_TIMER_CALLBACKS 32
+#define MAX_WINDOWS 8
+#define MAX_CHILDREN 16
+
+// ---------------------------------------------------------------------------
+// clock, random source and event queue
+
+struct SimEvent {
+	bool active;
+	uint64_t at_ms;
+	uint64_t seq;
+	SimEventHandler handler;
+	void *context;
+};
+
+struct AppTimer {
+	bool active;
+	uint8_t generation;
+	uint64_t at_ms;
+	uint64_t seq;
+	AppTimerCallback callback;
+	void *data;
+};
+
+static struct SimEvent s_events[MAX_EVENTS];
+static struct AppTimer s_timers[MAX_TIMERS];
+static uint64_t s_now_ms = 0;
+static uint64_t s_seq = 0;
+static uint64_t s_duration_ms = 60 * 1000;
+static bool s_verbose = false;
+static uint32_t s_random = 1;
+static uint32_t s_log_count = 0;
+
+static SimTimerStats s_timer_stats[MAX_TIMER_CALLBACKS];
+static int s_num_timer_stats = 0;
+static int s_armed = 0;
+static int s_max_armed = 0;
+
+static SimRenderStats s_render_stats;
+
+uint64_t sim_now_ms(void)
+{
+	return s_now_ms;
+}
+
+void sim_set_duration(uint64_t duration_ms)
+{
+	s_duration_ms = duration_ms;
+}
+
+void sim_set_verbose(bool verbose)
+{
+	s_verbose = verbose;
+}
+
+void sim_seed(uint32_t seed)
+{
+	s_random = seed ? seed : 1;
+}
+
+uint32_t sim_random(void)
+{
+	// xorshift32, good enough for fault injection and fully reproducible
+	s_random ^= s_random << 13;
+	s_random ^= s_random >> 17;
+	s_random ^= s_random << 5;
+	return s_random;
+}
+
+uint32_t sim_random_range(uint32_t lo, uint32_t hi)
+{
+	if (hi <= lo) {
+		return lo;
+	}
+	return lo + sim_random() % (hi - lo + 1);
+}
+
+void sim_schedule(uint64_t at_ms, SimEventHandler handler, void *context)
+{
+	for (int i = 0; i < MAX_EVENTS; i++) {
+		if (!s_events[i].active) {
+			s_events[i] = (struct SimEvent) {
+				.active = true,
+				.at_ms = at_ms < s_now_ms ? s_now_ms : at_ms,
+				.seq = s_seq++,
+				.handler = handler,
+				.context = context,
+			};
+			return;
+		}
+	}
+	fprintf(stderr, "sim: event queue overflow\n");
+	abort();
+}
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt, ...)
+{
+	s_log_count++;
+	if (!s_verbose) {
+		return;
+	}
+
+	va_list args;
+	va_start(args, fmt);
+	fprintf(stderr, "[%8llu] %s:%d ", (unsigned long long)s_now_ms, src_filename, src_line_number);
+	vfprintf(stderr, fmt, args);
+	fputc('\n', stderr);
+	va_end(args);
+}
+
+uint32_t sim_log_count(void)
+{
+	return s_log_count;
+}
+
+// ---------------------------------------------------------------------------
+// time
+
+static time_t s_epoch = SIM_EPOCH;   //wall clock at virtual time 0
+
+time_t sim_time(time_t *tloc)
+{
+	time_t t = s_epoch + (time_t)(s_now_ms / 1000);
+	if (tloc) {
+		*tloc = t;
+	}
+	return t;
+}
+
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms)
+{
+	uint16_t ms = (uint16_t)(s_now_ms % 1000);
+	sim_time(tloc);
+	if (out_ms) {
+		*out_ms = ms;
+	}
+	return ms;
+}
+
+time_t time_start_of_today(void)
+{
+	time_t t = sim_time(NULL);
+	return t - t % SECONDS_PER_DAY;
+}
+
+bool clock_is_24h_style(void)
+{
+	return true;
+}
+
+static TickHandler s_tick_handler;
+
+static void prv_tick(void *context)
+{
+	if (!s_tick_handler) {
+		return;
+	}
+
+	time_t t = sim_time(NULL);
+	struct tm tm;
+	gmtime_r(&t, &tm);
+	s_tick_handler(&tm, MINUTE_UNIT);
+	sim_schedule(s_now_ms + 60 * 1000, prv_tick, NULL);
+}
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler)
+{
+	s_tick_handler = handler;
+	sim_schedule(s_now_ms + (60 - sim_time(NULL) % 60) * 1000, prv_tick, NULL);
+}
+
+void tick_timer_service_unsubscribe(void)
+{
+	s_tick_handler = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// app timer
+
+static SimTimerStats *prv_timer_stats(AppTimerCallback callback)
+{
+	for (int i = 0; i < s_num_timer_stats; i++) {
+		if (s_timer_stats[i].callback == callback) {
+			return &s_timer_stats[i];
+		}
+	}
+	if (s_num_timer_stats == MAX_TIMER_CALLBACKS) {
+		fprintf(stderr, "sim: too many distinct timer callbacks\n");
+		abort();
+	}
+	s_timer_stats[s_num_timer_stats].callback = callback;
+	return &s_timer_stats[s_num_timer_stats++];
+}
+
+const SimTimerStats *sim_timer_stats(int *count)
+{
+	*count = s_num_timer_stats;
+	return s_timer_stats;
+}
+
+int sim_timer_max_armed(void)
+{
+	return s_max_armed;
+}
+
+// handles carry a generation so that cancelling a timer which already fired
+// is harmless, exactly like the firmware's id based handles
+static AppTimer *prv_timer_handle(int slot)
+{
+	return (AppTimer *)(uintptr_t)(((uint32_t)s_timers[slot].generation << 8) | (slot + 1));
+}
+
+static struct AppTimer *prv_timer_lookup(AppTimer *handle)
+{
+	uintptr_t id = (uintptr_t)handle;
+	int slot = (int)(id & 0xff) - 1;
+	if (slot < 0 || slot >= MAX_TIMERS) {
+		return NULL;
+	}
+	struct AppTimer *timer = &s_timers[slot];
+	if (!timer->active || timer->generation != (uint8_t)(id >> 8)) {
+		return NULL;
+	}
+	return timer;
+}
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data)
+{
+	for (int i = 0; i < MAX_TIMERS; i++) {
+		struct AppTimer *timer = &s_timers[i];
+		if (!timer->active) {
+			timer->active = true;
+			timer->generation++;
+			timer->at_ms = s_now_ms + timeout_ms;
+			timer->seq = s_seq++;
+			timer->callback = callback;
+			timer->data = callback_data;
+
+			prv_timer_stats(callback)->registered++;
+			if (++s_armed > s_max_armed) {
+				s_max_armed = s_armed;
+			}
+			return prv_timer_handle(i);
+		}
+	}
+	fprintf(stderr, "sim: app timer pool exhausted (runaway timer chains?)\n");
+	abort();
+}
+
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms)
+{
+	struct AppTimer *timer = prv_timer_lookup(timer_handle);
+	if (!timer) {
+		return false;
+	}
+	timer->at_ms = s_now_ms + new_timeout_ms;
+	timer->seq = s_seq++;
+	return true;
+}
+
+void app_timer_cancel(AppTimer *timer_handle)
+{
+	struct AppTimer *timer = prv_timer_lookup(timer_handle);
+	if (!timer) {
+		return;
+	}
+	timer->active = false;
+	s_armed--;
+	prv_timer_stats(timer->callback)->cancelled++;
+}
+
+static void prv_render(void);
+
+void app_event_loop(void)
+{
+	while (true) {
+		struct SimEvent *event = NULL;
+		struct AppTimer *timer = NULL;
+
+		for (int i = 0; i < MAX_EVENTS; i++) {
+			struct SimEvent *e = &s_events[i];
+			if (e->active && (!event || e->at_ms < event->at_ms ||
+				(e->at_ms == event->at_ms && e->seq < event->seq))) {
+				event = e;
+			}
+		}
+		for (int i = 0; i < MAX_TIMERS; i++) {
+			struct AppTimer *t = &s_timers[i];
+			if (t->active && (!timer || t->at_ms < timer->at_ms ||
+				(t->at_ms == timer->at_ms && t->seq < timer->seq))) {
+				timer = t;
+			}
+		}
+
+		if (timer && event && (event->at_ms < timer->at_ms ||
+			(event->at_ms == timer->at_ms && event->seq < timer->seq))) {
+			timer = NULL;
+		}
+		uint64_t at_ms = timer ? timer->at_ms : event ? event->at_ms : s_duration_ms;
+		if (at_ms >= s_duration_ms) {
+			s_now_ms = s_duration_ms;
+			return;
+		}
+		s_now_ms = at_ms;
+
+		if (timer) {
+			timer->active = false;
+			s_armed--;
+			prv_timer_stats(timer->callback)->fired++;
+			timer->callback(timer->data);
+		}
+		else {
+			event->active = false;
+			event->handler(event->context);
+		}
+		prv_render();
+	}
+}
+
+// ---------------------------------------------------------------------------
+// math
+
+int32_t sin_lookup(int32_t angle)
+{
+	return (int32_t)lround(sin(angle * 2.0 * M_PI / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO);
+}
+
+int32_t cos_lookup(int32_t angle)
+{
+	return (int32_t)lround(cos(angle * 2.0 * M_PI / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO);
+}
+
+int32_t atan2_lookup(int16_t y, int16_t x)
+{
+	double a = atan2(y, x);
+	if (a < 0) {
+		a += 2.0 * M_PI;
+	}
+	return (int32_t)lround(a * TRIG_MAX_ANGLE / (2.0 * M_PI)) % TRIG_MAX_ANGLE;
+}
+
+// ---------------------------------------------------------------------------
+// graphics
+
+struct GContext {
+	GColor fill_color;
+	GColor stroke_color;
+	GCompOp compositing_mode;
+};
+
+struct GBitmap {
+	GRect bounds;
+	GBitmapFormat format;
+	uint16_t row_size;
+	uint8_t *data;
+	GColor *palette;
+	bool free_palette;
+};
+
+GRect grect_inset(GRect rect, GEdgeInsets insets)
+{
+	return GRect(rect.origin.x + insets.left, rect.origin.y + insets.top,
+		rect.size.w - insets.left - insets.right, rect.size.h - insets.top - insets.bottom);
+}
+
+GPoint gpoint_from_polar(GRect container, GOvalScaleMode scale_mode, int32_t angle)
+{
+	int32_t radius = MIN(container.size.w, container.size.h) / 2;
+	int32_t cx = container.origin.x + container.size.w / 2;
+	int32_t cy = container.origin.y + container.size.h / 2;
+	return GPoint(cx + sin_lookup(angle) * radius / TRIG_MAX_RATIO,
+		cy - cos_lookup(angle) * radius / TRIG_MAX_RATIO);
+}
+
+GFont fonts_get_system_font(const char *font_key)
+{
+	return font_key;
+}
+
+void graphics_context_set_fill_color(GContext *ctx, GColor color)
+{
+	ctx->fill_color = color;
+}
+
+void graphics_context_set_stroke_color(GContext *ctx, GColor color)
+{
+	ctx->stroke_color = color;
+}
+
+void graphics_context_set_compositing_mode(GContext *ctx, GCompOp mode)
+{
+	ctx->compositing_mode = mode;
+}
+
+void graphics_fill_circle(GContext *ctx, GPoint p, uint16_t radius)
+{
+	s_render_stats.draw_calls++;
+	s_render_stats.draw_area += (uint64_t)(M_PI * radius * radius);
+}
+
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius, int corner_mask)
+{
+	s_render_stats.draw_calls++;
+	s_render_stats.draw_area += (uint64_t)rect.size.w * rect.size.h;
+}
+
+void graphics_fill_radial(GContext *ctx, GRect rect, GOvalScaleMode scale_mode, uint16_t inset_thickness,
+	int32_t angle_start, int32_t angle_end)
+{
+	int32_t radius = MIN(rect.size.w, rect.size.h) / 2;
+	int32_t sweep = angle_end > angle_start ? angle_end - angle_start : 0;
+	double ring = M_PI * (radius * radius - (double)(radius - inset_thickness) * (radius - inset_thickness));
+	s_render_stats.draw_calls++;
+	s_render_stats.draw_area += (uint64_t)(ring * MIN(sweep, TRIG_MAX_ANGLE) / TRIG_MAX_ANGLE);
+}
+
+GBitmap *gbitmap_create_with_resource(uint32_t resource_id)
+{
+	GBitmap *bitmap = calloc(1, sizeof(GBitmap));
+	bitmap->bounds = GRect(0, 0, 40, 40);
+	return bitmap;
+}
+
+GBitmap *gbitmap_create_blank(GSize size, GBitmapFormat format)
+{
+	static const uint8_t bits_per_pixel[] = { 1, 8, 1, 2, 4, 8 };
+	GBitmap *bitmap = calloc(1, sizeof(GBitmap));
+	bitmap->bounds = GRect(0, 0, size.w, size.h);
+	bitmap->format = format;
+	bitmap->row_size = (uint16_t)((size.w * bits_per_pixel[format] + 7) / 8);
+	if (format == GBitmapFormat1Bit) {
+		// legacy 1 bit rows are padded to whole words
+		bitmap->row_size = (uint16_t)((bitmap->row_size + 3) & ~3);
+	}
+	bitmap->data = calloc(size.h, bitmap->row_size);
+	return bitmap;
+}
+
+void gbitmap_set_palette(GBitmap *bitmap, GColor *palette, bool free_on_destroy)
+{
+	if (bitmap->free_palette) {
+		free(bitmap->palette);
+	}
+	bitmap->palette = palette;
+	bitmap->free_palette = free_on_destroy;
+}
+
+uint8_t *gbitmap_get_data(const GBitmap *bitmap)
+{
+	return bitmap->data;
+}
+
+uint16_t gbitmap_get_bytes_per_row(const GBitmap *bitmap)
+{
+	return bitmap->row_size;
+}
+
+GRect gbitmap_get_bounds(const GBitmap *bitmap)
+{
+	return bitmap->bounds;
+}
+
+void gbitmap_destroy(GBitmap *bitmap)
+{
+	if (bitmap->free_palette) {
+		free(bitmap->palette);
+	}
+	free(bitmap->data);
+	free(bitmap);
+}
+
+void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bitmap, GRect rect)
+{
+	s_render_stats.draw_calls++;
+	s_render_stats.draw_area += (uint64_t)rect.size.w * rect.size.h;
+}
+
+const SimRenderStats *sim_render_stats(void)
+{
+	return &s_render_stats;
+}
+
+// ---------------------------------------------------------------------------
+// layers
+
+struct Layer {
+	GRect frame;
+	bool hidden;
+	bool dirty;
+	LayerUpdateProc update_proc;
+	Layer *parent;
+	Layer *children[MAX_CHILDREN];
+	int num_children;
+};
+
+struct TextLayer {
+	Layer layer;
+	const char *text;
+};
+
+struct BitmapLayer {
+	Layer layer;
+	const GBitmap *bitmap;
+};
+
+static bool s_any_dirty = false;
+
+static void prv_layer_init(Layer *layer, GRect frame)
+{
+	memset(layer, 0, sizeof(*layer));
+	layer->frame = frame;
+	layer->dirty = true;
+	s_any_dirty = true;
+}
+
+static void prv_layer_detach(Layer *layer)
+{
+	Layer *parent = layer->parent;
+	if (!parent) {
+		return;
+	}
+	for (int i = 0; i < parent->num_children; i++) {
+		if (parent->children[i] == layer) {
+			memmove(&parent->children[i], &parent->children[i + 1],
+				(parent->num_children - i - 1) * sizeof(Layer *));
+			parent->num_children--;
+			break;
+		}
+	}
+	layer->parent = NULL;
+}
+
+Layer *layer_create(GRect frame)
+{
+	Layer *layer = malloc(sizeof(Layer));
+	prv_layer_init(layer, frame);
+	return layer;
+}
+
+void layer_destroy(Layer *layer)
+{
+	if (!layer) {
+		return;
+	}
+	prv_layer_detach(layer);
+	for (int i = 0; i < layer->num_children; i++) {
+		layer->children[i]->parent = NULL;
+	}
+	free(layer);
+}
+
+GRect layer_get_bounds(const Layer *layer)
+{
+	return GRect(0, 0, layer->frame.size.w, layer->frame.size.h);
+}
+
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc)
+{
+	layer->update_proc = update_proc;
+}
+
+void layer_add_child(Layer *parent, Layer *child)
+{
+	prv_layer_detach(child);
+	if (parent->num_children == MAX_CHILDREN) {
+		fprintf(stderr, "sim: too many child layers\n");
+		abort();
+	}
+	parent->children[parent->num_children++] = child;
+	child->parent = parent;
+	layer_mark_dirty(child);
+}
+
+void layer_mark_dirty(Layer *layer)
+{
+	s_render_stats.dirty_marks++;
+	s_render_stats.dirty_area += (uint64_t)layer->frame.size.w * layer->frame.size.h;
+	layer->dirty = true;
+	s_any_dirty = true;
+}
+
+void layer_set_hidden(Layer *layer, bool hidden)
+{
+	if (layer->hidden != hidden) {
+		layer->hidden = hidden;
+		layer_mark_dirty(layer);
+	}
+}
+
+bool layer_get_hidden(const Layer *layer)
+{
+	return layer->hidden;
+}
+
+static void prv_text_layer_update_proc(Layer *layer, GContext *ctx)
+{
+	TextLayer *text_layer = (TextLayer *)layer;
+	if (text_layer->text) {
+		s_render_stats.draw_calls++;
+		s_render_stats.draw_area += (uint64_t)layer->frame.size.w * layer->frame.size.h;
+	}
+}
+
+TextLayer *text_layer_create(GRect frame)
+{
+	TextLayer *text_layer = calloc(1, sizeof(TextLayer));
+	prv_layer_init(&text_layer->layer, frame);
+	text_layer->layer.update_proc = prv_text_layer_update_proc;
+	return text_layer;
+}
+
+void text_layer_destroy(TextLayer *text_layer)
+{
+	layer_destroy(&text_layer->layer);
+}
+
+Layer *text_layer_get_layer(TextLayer *text_layer)
+{
+	return &text_layer->layer;
+}
+
+void text_layer_set_text(TextLayer *text_layer, const char *text)
+{
+	s_render_stats.text_updates++;
+	text_layer->text = text;
+	layer_mark_dirty(&text_layer->layer);
+}
+
+const char *text_layer_get_text(TextLayer *text_layer)
+{
+	return text_layer->text;
+}
+
+void text_layer_set_font(TextLayer *text_layer, GFont font) {}
+void text_layer_set_text_color(TextLayer *text_layer, GColor color) {}
+void text_layer_set_background_color(TextLayer *text_layer, GColor color) {}
+void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment text_alignment) {}
+void text_layer_set_overflow_mode(TextLayer *text_layer, GTextOverflowMode line_mode) {}
+
+static void prv_bitmap_layer_update_proc(Layer *layer, GContext *ctx)
+{
+	BitmapLayer *bitmap_layer = (BitmapLayer *)layer;
+	if (bitmap_layer->bitmap) {
+		s_render_stats.draw_calls++;
+		s_render_stats.draw_area += (uint64_t)bitmap_layer->bitmap->bounds.size.w *
+			bitmap_layer->bitmap->bounds.size.h;
+	}
+}
+
+BitmapLayer *bitmap_layer_create(GRect frame)
+{
+	BitmapLayer *bitmap_layer = calloc(1, sizeof(BitmapLayer));
+	prv_layer_init(&bitmap_layer->layer, frame);
+	bitmap_layer->layer.update_proc = prv_bitmap_layer_update_proc;
+	return bitmap_layer;
+}
+
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer)
+{
+	layer_destroy(&bitmap_layer->layer);
+}
+
+Layer *bitmap_layer_get_layer(const BitmapLayer *bitmap_layer)
+{
+	return (Layer *)&bitmap_layer->layer;
+}
+
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap)
+{
+	bitmap_layer->bitmap = bitmap;
+	layer_mark_dirty(&bitmap_layer->layer);
+}
+
+void bitmap_layer_set_compositing_mode(BitmapLayer *bitmap_layer, GCompOp mode) {}
+
+// ---------------------------------------------------------------------------
+// windows and clicks
+
+struct Window {
+	Layer root;
+	WindowHandlers handlers;
+	void *user_data;
+	bool loaded;
+	ClickConfigProvider click_config_provider;
+	void *click_context;
+	ClickHandler single_click[NUM_BUTTONS];
+	ClickHandler long_click[NUM_BUTTONS];
+	ClickHandler double_click[NUM_BUTTONS];
+};
+
+struct ActionBarLayer {
+	Layer layer;
+	ClickConfigProvider click_config_provider;
+	void *context;
+};
+
+static Window *s_window_stack[MAX_WINDOWS];
+static int s_window_count = 0;
+static Window *s_configuring_window;
+
+static Window *prv_top_window(void)
+{
+	return s_window_count ? s_window_stack[s_window_count - 1] : NULL;
+}
+
+static void prv_render_layer(Layer *layer, GContext *ctx)
+{
+	if (layer->hidden) {
+		return;
+	}
+	if (layer->update_proc) {
+		layer->update_proc(layer, ctx);
+	}
+	layer->dirty = false;
+	for (int i = 0; i < layer->num_children; i++) {
+		prv_render_layer(layer->children[i], ctx);
+	}
+}
+
+static void prv_print_layer(FILE *out, Layer *layer)
+{
+	if (layer->hidden) {
+		return;
+	}
+	if (layer->update_proc == prv_text_layer_update_proc && ((TextLayer *)layer)->text) {
+		fprintf(out, "%s\n", ((TextLayer *)layer)->text);
+	}
+	for (int i = 0; i < layer->num_children; i++) {
+		prv_print_layer(out, layer->children[i]);
+	}
+}
+
+void sim_print_window(FILE *out)
+{
+	Window *window = prv_top_window();
+	if (window) {
+		prv_print_layer(out, &window->root);
+	}
+}
+
+// the firmware redraws the whole window whenever any layer is dirty
+static void prv_render(void)
+{
+	Window *window = prv_top_window();
+	if (!s_any_dirty || !window) {
+		return;
+	}
+	s_any_dirty = false;
+
+	GContext ctx = { .fill_color = GColorBlack, .stroke_color = GColorBlack };
+	s_render_stats.frames++;
+	prv_render_layer(&window->root, &ctx);
+}
+
+static void prv_configure_clicks(Window *window)
+{
+	memset(window->single_click, 0, sizeof(window->single_click));
+	memset(window->long_click, 0, sizeof(window->long_click));
+	memset(window->double_click, 0, sizeof(window->double_click));
+	if (window->click_config_provider) {
+		s_configuring_window = window;
+		window->click_config_provider(window->click_context);
+		s_configuring_window = NULL;
+	}
+}
+
+Window *window_create(void)
+{
+	Window *window = calloc(1, sizeof(Window));
+	prv_layer_init(&window->root, GRect(0, 0, 144, 168));
+	return window;
+}
+
+void window_destroy(Window *window)
+{
+	if (!window) {
+		return;
+	}
+	window_stack_remove(window, false);
+	free(window);
+}
+
+Layer *window_get_root_layer(const Window *window)
+{
+	return (Layer *)&window->root;
+}
+
+void window_set_window_handlers(Window *window, WindowHandlers handlers)
+{
+	window->handlers = handlers;
+}
+
+void window_set_click_config_provider(Window *window, ClickConfigProvider click_config_provider)
+{
+	window_set_click_config_provider_with_context(window, click_config_provider, window);
+}
+
+void window_set_click_config_provider_with_context(Window *window, ClickConfigProvider click_config_provider,
+	void *context)
+{
+	window->click_config_provider = click_config_provider;
+	window->click_context = context;
+}
+
+void window_set_background_color(Window *window, GColor background_color) {}
+
+void window_set_user_data(Window *window, void *data)
+{
+	window->user_data = data;
+}
+
+void *window_get_user_data(const Window *window)
+{
+	return window->user_data;
+}
+
+void window_single_click_subscribe(ButtonId button_id, ClickHandler handler)
+{
+	if (s_configuring_window) {
+		s_configuring_window->single_click[button_id] = handler;
+	}
+}
+
+void window_long_click_subscribe(ButtonId button_id, uint16_t delay_ms, ClickHandler down_handler,
+	ClickHandler up_handler)
+{
+	if (s_configuring_window) {
+		s_configuring_window->long_click[button_id] = down_handler;
+	}
+}
+
+// only double clicks are simulated
+void window_multi_click_subscribe(ButtonId button_id, uint8_t min_clicks, uint8_t max_clicks, uint16_t timeout,
+	bool last_click_only, ClickHandler handler)
+{
+	if (s_configuring_window && min_clicks <= 2 && (!max_clicks || max_clicks >= 2)) {
+		s_configuring_window->double_click[button_id] = handler;
+	}
+}
+
+void window_stack_push(Window *window, bool animated)
+{
+	if (s_window_count == MAX_WINDOWS) {
+		fprintf(stderr, "sim: window stack overflow\n");
+		abort();
+	}
+	s_window_stack[s_window_count++] = window;
+	if (!window->loaded) {
+		window->loaded = true;
+		if (window->handlers.load) {
+			window->handlers.load(window);
+		}
+	}
+	prv_configure_clicks(window);
+	if (window->handlers.appear) {
+		window->handlers.appear(window);
+	}
+	s_any_dirty = true;
+}
+
+bool window_stack_remove(Window *window, bool animated)
+{
+	for (int i = 0; i < s_window_count; i++) {
+		if (s_window_stack[i] == window) {
+			memmove(&s_window_stack[i], &s_window_stack[i + 1], (s_window_count - i - 1) * sizeof(Window *));
+			s_window_count--;
+			if (window->handlers.disappear) {
+				window->handlers.disappear(window);
+			}
+			if (window->loaded) {
+				window->loaded = false;
+				if (window->handlers.unload) {
+					window->handlers.unload(window);
+				}
+			}
+			s_any_dirty = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+void sim_button_click(ButtonId button_id)
+{
+	Window *window = prv_top_window();
+	if (window && window->single_click[button_id]) {
+		window->single_click[button_id](NULL, window->click_context);
+	}
+	else if (window && button_id == BUTTON_ID_BACK) {
+		window_stack_remove(window, true);
+	}
+	prv_render();
+}
+
+void sim_button_long_click(ButtonId button_id)
+{
+	Window *window = prv_top_window();
+	if (window && window->long_click[button_id]) {
+		window->long_click[button_id](NULL, window->click_context);
+	}
+	prv_render();
+}
+
+void sim_button_double_click(ButtonId button_id)
+{
+	Window *window = prv_top_window();
+	if (window && window->double_click[button_id]) {
+		window->double_click[button_id](NULL, window->click_context);
+	}
+	prv_render();
+}
+
+ActionBarLayer *action_bar_layer_create(void)
+{
+	ActionBarLayer *action_bar = calloc(1, sizeof(ActionBarLayer));
+	prv_layer_init(&action_bar->layer, GRect(144 - ACTION_BAR_WIDTH, 0, ACTION_BAR_WIDTH, 168));
+	return action_bar;
+}
+
+void action_bar_layer_destroy(ActionBarLayer *action_bar)
+{
+	layer_destroy(&action_bar->layer);
+}
+
+void action_bar_layer_set_icon(ActionBarLayer *action_bar, ButtonId button_id, const GBitmap *icon) {}
+
+void action_bar_layer_add_to_window(ActionBarLayer *action_bar, Window *window)
+{
+	layer_add_child(&window->root, &action_bar->layer);
+	window_set_click_config_provider_with_context(window, action_bar->click_config_provider,
+		action_bar->context);
+	prv_configure_clicks(window);
+}
+
+void action_bar_layer_set_context(ActionBarLayer *action_bar, void *context)
+{
+	action_bar->context = context;
+}
+
+void action_bar_layer_set_click_config_provider(ActionBarLayer *action_bar, ClickConfigProvider click_config_provider)
+{
+	action_bar->click_config_provider = click_config_provider;
+	Window *window = prv_top_window();
+	if (window && action_bar->layer.parent == &window->root) {
+		window_set_click_config_provider_with_context(window, click_config_provider, action_bar->context);
+		prv_configure_clicks(window);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// health: a steady walker doing one step per second, averaging 8000 a day
+
+#define SIM_STEPS_TODAY_AT_START 4000
+#define SIM_STEPS_AVERAGE_PER_DAY 8000
+
+static HealthEventHandler s_health_handler;
+static void *s_health_context;
+static SimHealthStats s_health_stats;
+
+const SimHealthStats *sim_health_stats(void)
+{
+	return &s_health_stats;
+}
+
+// the firmware walks its minute records for every aggregate query, an averaged one does so for
+// each of the days it averages
+#define SIM_HEALTH_AVERAGED_DAYS 7
+
+static void prv_health_query(time_t time_start, time_t time_end, int days)
+{
+	s_health_stats.queries++;
+	s_health_stats.minutes_summed += (uint64_t)(time_end - time_start + 59) / 60 * days;
+}
+
+static void prv_health_movement(void *context)
+{
+	if (!s_health_handler) {
+		return;
+	}
+	s_health_handler(HealthEventMovementUpdate, s_health_context);
+	sim_schedule(s_now_ms + 60 * 1000, prv_health_movement, NULL);
+}
+
+bool health_service_events_subscribe(HealthEventHandler handler, void *context)
+{
+	s_health_handler = handler;
+	s_health_context = context;
+	handler(HealthEventSignificantUpdate, context);
+	sim_schedule(s_now_ms + 60 * 1000, prv_health_movement, NULL);
+	return true;
+}
+
+bool health_service_events_unsubscribe(void)
+{
+	s_health_handler = NULL;
+	return true;
+}
+
+HealthServiceAccessibilityMask health_service_metric_accessible(HealthMetric metric, time_t time_start,
+	time_t time_end)
+{
+	return metric == HealthMetricStepCount ? HealthServiceAccessibilityMaskAvailable
+		: HealthServiceAccessibilityMaskNotSupported;
+}
+
+static HealthValue prv_steps_at(time_t t)
+{
+	const time_t start = SIM_EPOCH;
+	time_t today = start - start % SECONDS_PER_DAY;
+	if (t <= today) {
+		return 0;
+	}
+	if (t <= start) {
+		return (HealthValue)((int64_t)SIM_STEPS_TODAY_AT_START * (t - today) / (start - today));
+	}
+	return SIM_STEPS_TODAY_AT_START + (HealthValue)(t - start);
+}
+
+HealthValue health_service_sum_today(HealthMetric metric)
+{
+	time_t now = sim_time(NULL);
+	prv_health_query(now - now % SECONDS_PER_DAY, now, 1);
+	return prv_steps_at(sim_time(NULL));
+}
+
+HealthValue health_service_sum(HealthMetric metric, time_t time_start, time_t time_end)
+{
+	prv_health_query(time_start, time_end, 1);
+	return prv_steps_at(time_end) - prv_steps_at(time_start);
+}
+
+HealthValue health_service_sum_averaged(HealthMetric metric, time_t time_start, time_t time_end,
+	HealthServiceTimeScope scope)
+{
+	prv_health_query(time_start, time_end, SIM_HEALTH_AVERAGED_DAYS);
+	return (HealthValue)((int64_t)SIM_STEPS_AVERAGE_PER_DAY * (time_end - time_start) / SECONDS_PER_DAY);
+}
+
+// minute records are there up to the last whole minute
+uint32_t health_service_get_minute_history(HealthMinuteData *minute_data, uint32_t max_records, time_t *time_start,
+	time_t *time_end)
+{
+	time_t now = sim_time(NULL);
+	time_t start = *time_start - *time_start % 60;
+	time_t end = *time_end < now - now % 60 ? *time_end : now - now % 60;
+	uint32_t count = 0;
+
+	s_health_stats.queries++;
+	for (time_t t = start; t + 60 <= end && count < max_records; t += 60, count++) {
+		memset(&minute_data[count], 0, sizeof(HealthMinuteData));
+		minute_data[count].steps = (uint8_t)(prv_steps_at(t + 60) - prv_steps_at(t));
+	}
+	s_health_stats.minutes_summed += count;
+	*time_start = start;
+	*time_end = start + count * 60;
+	return count;
+}
+
+// ---------------------------------------------------------------------------
+// persistent storage: up to 4 KB in total and 256 bytes per key, like on the watch
+
+#define SIM_PERSIST_MAX_KEYS 64
+#define SIM_PERSIST_TOTAL 4096
+
+static struct {
+	uint32_t key;
+	uint16_t size;
+	uint8_t data[PERSIST_DATA_MAX_LENGTH];
+} s_persist[SIM_PERSIST_MAX_KEYS];
+static int s_num_persist = 0;
+static SimPersistStats s_persist_stats;
+
+static int prv_persist_find(uint32_t key)
+{
+	for (int i = 0; i < s_num_persist; i++) {
+		if (s_persist[i].key == key) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+bool persist_exists(const uint32_t key)
+{
+	return prv_persist_find(key) >= 0;
+}
+
+int persist_get_size(const uint32_t key)
+{
+	int i = prv_persist_find(key);
+	return i < 0 ? E_DOES_NOT_EXIST : s_persist[i].size;
+}
+
+bool persist_read_bool(const uint32_t key)
+{
+	bool value = false;
+	persist_read_data(key, &value, sizeof(value));
+	return value;
+}
+
+int32_t persist_read_int(const uint32_t key)
+{
+	int32_t value = 0;
+	persist_read_data(key, &value, sizeof(value));
+	return value;
+}
+
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size)
+{
+	int i = prv_persist_find(key);
+	if (i < 0) {
+		return E_DOES_NOT_EXIST;
+	}
+	size_t size = MIN(buffer_size, s_persist[i].size);
+	memcpy(buffer, s_persist[i].data, size);
+	return (int)size;
+}
+
+status_t persist_write_bool(const uint32_t key, const bool value)
+{
+	int result = persist_write_data(key, &value, sizeof(value));
+	return result < 0 ? result : S_SUCCESS;
+}
+
+status_t persist_write_int(const uint32_t key, const int32_t value)
+{
+	int result = persist_write_data(key, &value, sizeof(value));
+	return result < 0 ? result : S_SUCCESS;
+}
+
+int persist_write_data(const uint32_t key, const void *data, const size_t size)
+{
+	if (!data || size > PERSIST_DATA_MAX_LENGTH) {
+		return E_INVALID_ARGUMENT;
+	}
+	int i = prv_persist_find(key);
+	uint32_t stored = s_persist_stats.bytes_stored - (i < 0 ? 0 : s_persist[i].size) + size;
+	if (stored > SIM_PERSIST_TOTAL || (i < 0 && s_num_persist == SIM_PERSIST_MAX_KEYS)) {
+		fprintf(stderr, "sim: persist full writing key %u (%u bytes)\n", key, (unsigned)size);
+		return E_OUT_OF_STORAGE;
+	}
+	if (i < 0) {
+		i = s_num_persist++;
+		s_persist[i].key = key;
+	}
+	s_persist[i].size = (uint16_t)size;
+	memcpy(s_persist[i].data, data, size);
+	s_persist_stats.bytes_stored = stored;
+	s_persist_stats.keys = s_num_persist;
+	s_persist_stats.writes++;
+	s_persist_stats.bytes_written += size;
+	return (int)size;
+}
+
+status_t persist_delete(const uint32_t key)
+{
+	int i = prv_persist_find(key);
+	if (i < 0) {
+		return E_DOES_NOT_EXIST;
+	}
+	s_persist_stats.bytes_stored -= s_persist[i].size;
+	s_persist[i] = s_persist[--s_num_persist];
+	s_persist_stats.keys = s_num_persist;
+	s_persist_stats.deletes++;
+	return S_SUCCESS;
+}
+
+bool sim_persist_load(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		return false;
+	}
+	uint32_t key;
+	uint16_t size;
+	uint8_t data[PERSIST_DATA_MAX_LENGTH];
+
+	//the wall clock carries on a minute after the previous run ended
+	uint32_t saved_time;
+	if (fread(&saved_time, sizeof(saved_time), 1, file) == 1) {
+		s_epoch = saved_time + 60;
+	}
+	while (fread(&key, sizeof(key), 1, file) == 1 && fread(&size, sizeof(size), 1, file) == 1 &&
+		size <= sizeof(data) && fread(data, 1, size, file) == size) {
+		persist_write_data(key, data, size);
+	}
+	fclose(file);
+	memset(&s_persist_stats, 0, sizeof(s_persist_stats));
+	for (int i = 0; i < s_num_persist; i++) {
+		s_persist_stats.bytes_stored += s_persist[i].size;
+	}
+	s_persist_stats.keys = s_num_persist;
+	return true;
+}
+
+bool sim_persist_save(const char *path)
+{
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+	uint32_t saved_time = (uint32_t)sim_time(NULL);
+	fwrite(&saved_time, sizeof(saved_time), 1, file);
+	for (int i = 0; i < s_num_persist; i++) {
+		fwrite(&s_persist[i].key, sizeof(s_persist[i].key), 1, file);
+		fwrite(&s_persist[i].size, sizeof(s_persist[i].size), 1, file);
+		fwrite(s_persist[i].data, 1, s_persist[i].size, file);
+	}
+	fclose(file);
+	return true;
+}
+
+const SimPersistStats *sim_persist_stats(void)
+{
+	return &s_persist_stats;
+}
@@ -0,0 +1,395 @@
+// sim_phone.c : dictionaries, app messages and a fake phone behind them
+//
+// The phone side mirrors src/js/app.js: it asks for the track, decodes the fix log blocks of
+// every message that arrives in order and acknowledges how many it has. The bluetooth link
+// takes a fixed latency plus the transfer time of the message, and can lose messages, which
+// the watch then sees as an outbox failure after the send timeout.
+
+#include <pebble.h>
+#include "sim.h"
+#include "fix_log.h"
+#include "track_export.h"
+#include "track_fusion.h"
+
+#define SIM_SEND_TIMEOUT_MS 1000
+#define SIM_PHONE_REQUEST_RETRY_MS 5000
+
+// ---------------------------------------------------------------------------
+// dictionaries, same wire format as on the watch: a tuple count, then key, type, length, value
+
+struct __attribute__((__packed__)) Dictionary {
+	uint8_t count;
+	uint8_t head[];
+};
+
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t * const buffer, const uint16_t size)
+{
+	if (!iter || !buffer || size < 1) {
+		return DICT_INVALID_ARGS;
+	}
+	iter->dictionary = (Dictionary *)buffer;
+	iter->dictionary->count = 0;
+	iter->cursor = (Tuple *)iter->dictionary->head;
+	iter->end = buffer + size;
+	return DICT_OK;
+}
+
+static DictionaryResult prv_dict_write(DictionaryIterator *iter, uint32_t key, TupleType type,
+	const void *data, uint16_t length)
+{
+	if (!iter || !iter->cursor) {
+		return DICT_INVALID_ARGS;
+	}
+	if ((uint8_t *)iter->cursor + sizeof(Tuple) + length > (const uint8_t *)iter->end) {
+		return DICT_NOT_ENOUGH_STORAGE;
+	}
+	Tuple *tuple = iter->cursor;
+	tuple->key = key;
+	tuple->type = type;
+	tuple->length = length;
+	memcpy(tuple->value, data, length);
+	iter->cursor = (Tuple *)((uint8_t *)tuple + sizeof(Tuple) + length);
+	iter->dictionary->count++;
+	return DICT_OK;
+}
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t * const data,
+	const uint16_t size)
+{
+	return prv_dict_write(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value)
+{
+	return prv_dict_write(iter, key, TUPLE_UINT, &value, sizeof(value));
+}
+
+uint32_t dict_write_end(DictionaryIterator *iter)
+{
+	uint32_t size = (uint32_t)((uint8_t *)iter->cursor - (uint8_t *)iter->dictionary);
+	iter->end = iter->cursor;
+	iter->cursor = (Tuple *)iter->dictionary->head;
+	return size;
+}
+
+Tuple *dict_read_begin_from_buffer(DictionaryIterator *iter, const uint8_t * const buffer, const uint16_t size)
+{
+	iter->dictionary = (Dictionary *)buffer;
+	iter->end = buffer + size;
+	return dict_read_first(iter);
+}
+
+static bool prv_dict_valid(const DictionaryIterator *iter, const Tuple *tuple)
+{
+	return (const uint8_t *)tuple + sizeof(Tuple) <= (const uint8_t *)iter->end &&
+		(const uint8_t *)tuple + sizeof(Tuple) + tuple->length <= (const uint8_t *)iter->end;
+}
+
+Tuple *dict_read_first(DictionaryIterator *iter)
+{
+	iter->cursor = (Tuple *)iter->dictionary->head;
+	return iter->dictionary->count && prv_dict_valid(iter, iter->cursor) ? iter->cursor : NULL;
+}
+
+Tuple *dict_read_next(DictionaryIterator *iter)
+{
+	Tuple *next = (Tuple *)((uint8_t *)iter->cursor + sizeof(Tuple) + iter->cursor->length);
+	if (!prv_dict_valid(iter, next)) {
+		return NULL;
+	}
+	iter->cursor = next;
+	return next;
+}
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key)
+{
+	DictionaryIterator it = *iter;
+	for (Tuple *tuple = dict_read_first(&it); tuple; tuple = dict_read_next(&it)) {
+		if (tuple->key == key) {
+			return tuple;
+		}
+	}
+	return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// app messages
+
+typedef struct {
+	uint16_t size;
+	uint8_t data[];
+} SimMessage;
+
+static AppMessageInboxReceived s_inbox_received;
+static AppMessageInboxDropped s_inbox_dropped;
+static AppMessageOutboxSent s_outbox_sent;
+static AppMessageOutboxFailed s_outbox_failed;
+static void *s_app_message_context;
+static uint32_t s_inbox_size, s_outbox_size;
+static uint8_t *s_outbox;
+static DictionaryIterator s_outbox_iter;
+static bool s_outbox_pending = false;
+
+static uint32_t s_link_latency_ms = 60;
+static uint32_t s_link_bytes_per_s = 6000;
+static uint8_t s_link_loss_pct = 0;
+
+static SimPhoneStats s_phone_stats;
+
+static void prv_phone_received(const uint8_t *data, uint16_t size);
+
+static SimMessage *prv_message(const uint8_t *data, uint16_t size)
+{
+	SimMessage *message = malloc(sizeof(SimMessage) + size);
+	message->size = size;
+	memcpy(message->data, data, size);
+	return message;
+}
+
+static uint32_t prv_transfer_ms(uint16_t size)
+{
+	return s_link_latency_ms + size * 1000 / s_link_bytes_per_s;
+}
+
+static bool prv_lost(void)
+{
+	return s_link_loss_pct && sim_random() % 100 < s_link_loss_pct;
+}
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound)
+{
+	s_inbox_size = size_inbound;
+	s_outbox_size = size_outbound;
+	free(s_outbox);
+	s_outbox = malloc(size_outbound);
+	return APP_MSG_OK;
+}
+
+void *app_message_set_context(void *context)
+{
+	void *previous = s_app_message_context;
+	s_app_message_context = context;
+	return previous;
+}
+
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback)
+{
+	AppMessageInboxReceived previous = s_inbox_received;
+	s_inbox_received = received_callback;
+	return previous;
+}
+
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback)
+{
+	AppMessageInboxDropped previous = s_inbox_dropped;
+	s_inbox_dropped = dropped_callback;
+	return previous;
+}
+
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback)
+{
+	AppMessageOutboxSent previous = s_outbox_sent;
+	s_outbox_sent = sent_callback;
+	return previous;
+}
+
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback)
+{
+	AppMessageOutboxFailed previous = s_outbox_failed;
+	s_outbox_failed = failed_callback;
+	return previous;
+}
+
+uint32_t app_message_inbox_size_maximum(void)
+{
+	return 8200;
+}
+
+uint32_t app_message_outbox_size_maximum(void)
+{
+	return 8200;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator)
+{
+	if (!s_outbox) {
+		return APP_MSG_INVALID_ARGS;
+	}
+	if (s_outbox_pending) {
+		return APP_MSG_BUSY;
+	}
+	dict_write_begin(&s_outbox_iter, s_outbox, (uint16_t)s_outbox_size);
+	*iterator = &s_outbox_iter;
+	return APP_MSG_OK;
+}
+
+static void prv_outbox_done(void *context)
+{
+	bool failed = context != NULL;
+	s_outbox_pending = false;
+	if (failed && s_outbox_failed) {
+		s_outbox_failed(&s_outbox_iter, APP_MSG_SEND_TIMEOUT, s_app_message_context);
+	}
+	else if (!failed && s_outbox_sent) {
+		s_outbox_sent(&s_outbox_iter, s_app_message_context);
+	}
+}
+
+static void prv_deliver_to_phone(void *context)
+{
+	SimMessage *message = context;
+	prv_phone_received(message->data, message->size);
+	free(message);
+}
+
+AppMessageResult app_message_outbox_send(void)
+{
+	if (s_outbox_pending) {
+		return APP_MSG_BUSY;
+	}
+	uint16_t size = (uint16_t)dict_write_end(&s_outbox_iter);
+	s_outbox_pending = true;
+	s_phone_stats.messages_to_phone++;
+	s_phone_stats.bytes_to_phone += size;
+
+	uint64_t arrival = sim_now_ms() + prv_transfer_ms(size);
+	if (prv_lost()) {
+		s_phone_stats.lost++;
+		sim_schedule(sim_now_ms() + SIM_SEND_TIMEOUT_MS, prv_outbox_done, (void *)1);
+	}
+	else {
+		sim_schedule(arrival, prv_deliver_to_phone, prv_message(s_outbox, size));
+		sim_schedule(arrival + s_link_latency_ms, prv_outbox_done, NULL);
+	}
+	return APP_MSG_OK;
+}
+
+static void prv_deliver_to_watch(void *context)
+{
+	SimMessage *message = context;
+	DictionaryIterator iter;
+	if (message->size > s_inbox_size) {
+		if (s_inbox_dropped) {
+			s_inbox_dropped(APP_MSG_BUFFER_OVERFLOW, s_app_message_context);
+		}
+	}
+	else if (s_inbox_received && dict_read_begin_from_buffer(&iter, message->data, message->size)) {
+		s_inbox_received(&iter, s_app_message_context);
+	}
+	free(message);
+}
+
+static void prv_phone_send_uint32(uint32_t key, uint32_t value)
+{
+	uint8_t buffer[32];
+	DictionaryIterator iter;
+	dict_write_begin(&iter, buffer, sizeof(buffer));
+	dict_write_uint32(&iter, key, value);
+	uint16_t size = (uint16_t)dict_write_end(&iter);
+	if (prv_lost()) {
+		s_phone_stats.lost++;
+		return;
+	}
+	sim_schedule(sim_now_ms() + prv_transfer_ms(size), prv_deliver_to_watch, prv_message(buffer, size));
+}
+
+// ---------------------------------------------------------------------------
+// the phone, see src/js/app.js
+
+static struct {
+	uint32_t expected;          // next sequence number wanted
+	int32_t messages;           // data messages announced, -1 until known
+	uint32_t since;             // time of the newest fix received
+} s_phone = { 0, -1, 0 };
+
+void sim_phone_set_link(uint32_t latency_ms, uint32_t bytes_per_s, uint8_t loss_pct)
+{
+	s_link_latency_ms = latency_ms;
+	s_link_bytes_per_s = bytes_per_s;
+	s_link_loss_pct = loss_pct;
+}
+
+static void prv_phone_request(void *context);
+
+// asks again if the request got lost on the way
+static void prv_phone_request_check(void *context)
+{
+	if (s_phone.expected == 0) {
+		prv_phone_request((void *)1);
+	}
+}
+
+static void prv_phone_request(void *context)
+{
+	bool retry = context != NULL;
+	s_phone.expected = 0;
+	s_phone.messages = -1;
+	if (!retry) {
+		s_phone_stats.requested_ms = sim_now_ms();
+		s_phone_stats.done_ms = 0;
+	}
+	prv_phone_send_uint32(APP_KEY_EXPORT_REQUEST, s_phone.since);
+	sim_schedule(sim_now_ms() + SIM_PHONE_REQUEST_RETRY_MS, prv_phone_request_check, NULL);
+}
+
+void sim_phone_request_export(uint64_t at_ms)
+{
+	sim_schedule(at_ms, prv_phone_request, NULL);
+}
+
+static void prv_phone_received(const uint8_t *data, uint16_t size)
+{
+	DictionaryIterator iter;
+	if (!dict_read_begin_from_buffer(&iter, data, size)) {
+		return;
+	}
+	Tuple *seq = dict_find(&iter, APP_KEY_EXPORT_SEQ);
+	if (!seq) {
+		return;
+	}
+	if (seq->value->uint32 != s_phone.expected) {
+		// out of order or a repeat, the acknowledgement tells the watch where to carry on
+		s_phone_stats.out_of_order++;
+	}
+	else {
+		Tuple *count = dict_find(&iter, APP_KEY_EXPORT_COUNT);
+		Tuple *blocks = dict_find(&iter, APP_KEY_EXPORT_DATA);
+		Tuple *steps = dict_find(&iter, APP_KEY_EXPORT_STEPS);
+		uint16_t fused_count = steps ? steps->length / sizeof(fused_fix) : 0;
+		uint16_t index = 0;
+		if (seq->value->uint32 == 0 && count) {
+			s_phone.messages = (int32_t)count->value->uint32;
+		}
+		for (uint16_t offset = 0; blocks && offset + FIX_BLOCK_SIZE <= blocks->length; offset += FIX_BLOCK_SIZE) {
+			fix_block_reader reader;
+			gps_fix fix;
+			fix_block_reader_init(&reader, blocks->value->data + offset);
+			while (fix_block_reader_next(&reader, &fix)) {
+				fused_fix fused = { 0, FUSION_UNKNOWN };
+				if (index < fused_count) {
+					memcpy(&fused, steps->value->data + index * sizeof(fused), sizeof(fused));
+				}
+				index++;
+				if (fix.time > s_phone.since) {
+					s_phone.since = fix.time;
+					s_phone_stats.fixes++;
+					if (fused.cadence != FUSION_UNKNOWN) {
+						s_phone_stats.fused++;
+						s_phone_stats.steps += fused.steps;
+						s_phone_stats.cadence = fused.cadence;
+					}
+				}
+			}
+		}
+		s_phone.expected++;
+		if (s_phone.messages >= 0 && s_phone.expected == (uint32_t)s_phone.messages + 1) {
+			s_phone_stats.done_ms = sim_now_ms();
+		}
+	}
+	prv_phone_send_uint32(APP_KEY_EXPORT_ACK, s_phone.expected);
+}
+
+const SimPhoneStats *sim_phone_stats(void)
+{
+	return &s_phone_stats;
+}
@@ -0,0 +1,973 @@
+// sim_strap.c : scriptable fake Xadow strap behind the smartstrap API
+//
+// The strap answers reads from a small world model (a walker moving along a
+// gentle curve, a slowly draining battery) after a per-endpoint latency, and
+// can inject Busy, TimeOut, AttributeUnsupported and availability flaps.
+
+#include <pebble.h>
+#include <math.h>
+#include "sim.h"
+#include "xadow.h"
+
+#define MAX_ENDPOINTS 32
+#define MAX_ATTRIBUTES 32
+#define MAX_SERVICES 8
+
+struct SmartstrapAttribute {
+	SimStrapEndpoint *endpoint;
+	uint8_t *buffer;
+	size_t buffer_length;
+	bool pending;
+	bool writing;
+	size_t write_length;
+};
+
+struct SimStrapService {
+	SmartstrapServiceId service_id;
+	bool available;
+};
+
+struct SimStrapChange {
+	bool present;
+	SmartstrapServiceId service_id;
+	bool available;
+	SmartstrapAttributeId attribute_id;
+};
+
+static SimStrapEndpoint s_endpoints[MAX_ENDPOINTS];
+static int s_num_endpoints = 0;
+static SmartstrapAttribute *s_attributes[MAX_ATTRIBUTES];
+static int s_num_attributes = 0;
+static struct SimStrapService s_services[MAX_SERVICES] = {
+	{ SERVICE_BAT, true },
+	{ SERVICE_GPS, true },
+	{ SERVICE_NFC, true },
+};
+static int s_num_services = 3;
+
+static SmartstrapHandlers s_handlers;
+static bool s_subscribed = false;
+static bool s_present = true;
+static uint16_t s_timeout_ms = SMARTSTRAP_TIMEOUT_DEFAULT;
+static int s_max_in_flight = 1;
+static int s_in_flight = 0;
+
+// ---------------------------------------------------------------------------
+// world model
+
+#define SIM_FIX_PERIOD_MS 1000
+
+static uint64_t s_pause_from_ms = 0;
+static uint64_t s_pause_to_ms = 0;
+static bool s_notify_changes = false;
+static uint16_t s_gps_noise_m = 0;
+
+typedef struct {
+	int32_t lat;
+	int32_t lon;
+	uint16_t speed;
+	uint16_t alt;
+	uint8_t fix;
+	uint8_t sat;
+	uint32_t timestamp;
+	uint16_t vbat;
+	uint16_t course;     // 1/100 degrees, only in the nmea sentences
+} SimWorld;
+
+// receiver wander: a slow drift plus jitter from fix to fix, the same for every read of a fix
+static double prv_gps_noise(uint64_t fix_ms, uint32_t salt)
+{
+	uint32_t h = ((uint32_t)(fix_ms / SIM_FIX_PERIOD_MS) ^ salt) * 2654435761u;
+	h ^= h >> 15;
+	h *= 2246822519u;
+	h ^= h >> 13;
+	double jitter = (double)(h % 2001) / 1000.0 - 1.0;
+	double drift = sin((double)fix_ms / 23000.0 + salt);
+	return s_gps_noise_m * (0.6 * drift + 0.4 * jitter);
+}
+
+// ---------------------------------------------------------------------------
+// nfc tag: its uid (none when serial is 0) and ndef message, read, written and erased a chunk at a time
+
+#define SIM_NDEF_SIZE 512
+
+static uint8_t s_tag_serial = 1;
+static uint8_t s_tag_last = 1;     // the tag the message belongs to
+static uint8_t s_ndef[SIM_NDEF_SIZE];
+static uint16_t s_ndef_length = 0;
+static uint8_t s_ndef_staged[SIM_NDEF_SIZE];
+
+// a text record, a uri and a mime record long enough to take several chunks
+static void prv_ndef_default(void)
+{
+	static const uint8_t text[] = { 0x91, 0x01, 0x12, 'T', 0x02, 'e', 'n',
+		'T', 'r', 'a', 'i', 'l', 'h', 'e', 'a', 'd', ' ', 'n', 'o', 'r', 't', 'h' };
+	static const uint8_t uri[] = { 0x11, 0x01, 0x10, 'U', 0x04,
+		'z', 'e', 'n', 'p', 'e', 'b', 'b', 'l', 'e', '.', 'o', 'r', 'g', '/', 't' };
+	static const char mime[] = "application/x-track";
+	const uint32_t body = 300;
+	uint8_t *out = s_ndef;
+
+	memcpy(out, text, sizeof(text));
+	out += sizeof(text);
+	memcpy(out, uri, sizeof(uri));
+	out += sizeof(uri);
+	*out++ = 0x42;
+	*out++ = sizeof(mime) - 1;
+	*out++ = body >> 24;
+	*out++ = body >> 16;
+	*out++ = body >> 8;
+	*out++ = (uint8_t)body;
+	memcpy(out, mime, sizeof(mime) - 1);
+	out += sizeof(mime) - 1;
+	for (uint32_t i = 0; i < body; i++) {
+		*out++ = (uint8_t)i;
+	}
+	s_ndef_length = out - s_ndef;
+}
+
+// the reply to a read: the chunk header asked for, with as much of the message as fits
+static size_t prv_ndef_read(SmartstrapAttribute *attr)
+{
+	xadow_ndef_chunk chunk = { 0 };
+	if (attr->write_length >= sizeof(chunk)) {
+		memcpy(&chunk, attr->buffer, sizeof(chunk));
+	}
+	uint16_t left = chunk.offset < s_ndef_length ? s_ndef_length - chunk.offset : 0;
+	chunk.length = MIN(MIN(chunk.length, left), attr->buffer_length - sizeof(chunk));
+	chunk.total = s_ndef_length;
+	memcpy(attr->buffer, &chunk, sizeof(chunk));
+	memcpy(attr->buffer + sizeof(chunk), s_ndef + chunk.offset, chunk.length);
+	return sizeof(chunk) + chunk.length;
+}
+
+// writes are staged and take effect with their last chunk
+static void prv_ndef_write(SmartstrapAttribute *attr)
+{
+	xadow_ndef_chunk chunk;
+	if (attr->write_length < sizeof(chunk)) {
+		return;
+	}
+	memcpy(&chunk, attr->buffer, sizeof(chunk));
+	if (attr->endpoint->attribute_id == ATTR_NFC_ERASE_NDEF) {
+		static const uint8_t empty[] = { 0xD0, 0x00, 0x00 };
+		memcpy(s_ndef, empty, sizeof(empty));
+		s_ndef_length = sizeof(empty);
+	}
+	else if (chunk.total <= SIM_NDEF_SIZE && chunk.offset + chunk.length <= chunk.total &&
+		sizeof(chunk) + chunk.length <= attr->write_length) {
+		memcpy(s_ndef_staged + chunk.offset, attr->buffer + sizeof(chunk), chunk.length);
+		if (chunk.offset + chunk.length == chunk.total) {
+			memcpy(s_ndef, s_ndef_staged, chunk.total);
+			s_ndef_length = chunk.total;
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+// log of fixes, fetched in frames over the raw data service
+
+#define SIM_BACKLOG_MS (3600 * 1000)   // how far back the strap's log goes
+
+static void prv_world(uint64_t now_ms, SimWorld *world);
+
+// crc-16/ccitt-false
+static uint16_t prv_crc16(const uint8_t *data, size_t length)
+{
+	uint16_t crc = 0xffff;
+	while (length--) {
+		crc ^= *data++ << 8;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+// frame seq of the fixes logged after since, up to now; returns its size
+static size_t prv_bulk_frame(uint8_t *out, uint32_t since, uint16_t seq)
+{
+	uint64_t now = sim_now_ms();
+	uint64_t first = (uint64_t)since - since % SIM_FIX_PERIOD_MS + SIM_FIX_PERIOD_MS;
+	if (now > SIM_BACKLOG_MS && first < now - SIM_BACKLOG_MS) {
+		first = now - SIM_BACKLOG_MS;
+		first -= first % SIM_FIX_PERIOD_MS;
+	}
+	xadow_bulk_frame frame = { .seq = seq };
+	uint8_t *data = out + sizeof(frame);
+	for (int i = 0; i < XADOW_BULK_FIXES; i++) {
+		uint64_t at = first + ((uint64_t)seq * XADOW_BULK_FIXES + i) * SIM_FIX_PERIOD_MS;
+		if (at > now) {
+			break;
+		}
+		SimWorld world;
+		prv_world(at, &world);
+		xadow_gps_snapshot snapshot = {
+			.lat = world.lat,
+			.lon = world.lon,
+			.speed = world.speed,
+			.alt = world.alt,
+			.fix = world.fix,
+			.sat = world.sat,
+			.timestamp = world.timestamp,
+		};
+		memcpy(data + frame.count++ * sizeof(snapshot), &snapshot, sizeof(snapshot));
+	}
+	if (first + ((uint64_t)seq + 1) * XADOW_BULK_FIXES * SIM_FIX_PERIOD_MS > now) {
+		frame.flags |= XADOW_BULK_LAST;
+	}
+	memcpy(out, &frame, sizeof(frame));
+	size_t size = XADOW_BULK_FRAME_SIZE(frame.count);
+	uint16_t crc = prv_crc16(out, size - 2);
+	out[size - 2] = crc & 0xff;
+	out[size - 1] = crc >> 8;
+	return size;
+}
+
+// the frames asked for again, then new ones, as many as fit
+static size_t prv_bulk_reply(SmartstrapAttribute *attr)
+{
+	xadow_bulk_request request;
+	if (attr->write_length < sizeof(request)) {
+		return 0;
+	}
+	memcpy(&request, attr->buffer, sizeof(request));
+
+	uint16_t seqs[XADOW_BULK_MISSING + UINT8_MAX];
+	int count = 0;
+	for (int i = 0; i < MIN(request.missing_count, XADOW_BULK_MISSING); i++) {
+		seqs[count++] = request.missing[i];
+	}
+	for (int i = 0; i < request.limit; i++) {
+		seqs[count++] = request.next + i;
+	}
+
+	size_t length = 0;
+	uint8_t frame[XADOW_BULK_FRAME_SIZE(XADOW_BULK_FIXES)];
+	for (int i = 0; i < count; i++) {
+		size_t size = prv_bulk_frame(frame, request.since, seqs[i]);
+		if (length + size > attr->buffer_length) {
+			break;
+		}
+		if (attr->endpoint->corrupt_pct && sim_random() % 100 < attr->endpoint->corrupt_pct) {
+			frame[sim_random() % size] ^= 1 << (sim_random() % 8);
+		}
+		memcpy(attr->buffer + length, frame, size);
+		length += size;
+		if (frame[offsetof(xadow_bulk_frame, flags)] & XADOW_BULK_LAST && i >= request.missing_count) {
+			break;
+		}
+	}
+	return length;
+}
+
+// ---------------------------------------------------------------------------
+// nmea sentences, GGA, RMC and GSV once a fix, queued until read like a receiver's serial
+// buffer: sentences that don't fit any more are dropped
+
+#define SIM_NMEA_QUEUE 1024
+
+static char s_nmea[SIM_NMEA_QUEUE];
+static size_t s_nmea_length = 0;
+static uint64_t s_nmea_next_ms = 0;   // fix the receiver sends next, 0 until the stream is first read
+static uint32_t s_nmea_dropped = 0;
+
+static void prv_nmea_sentence(const char *body)
+{
+	uint8_t checksum = 0;
+	for (const char *c = body; *c; c++) {
+		checksum ^= (uint8_t)*c;
+	}
+	char sentence[96];
+	int length = snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, checksum);
+	if (s_nmea_length + length > SIM_NMEA_QUEUE) {
+		s_nmea_dropped++;
+		return;
+	}
+	memcpy(s_nmea + s_nmea_length, sentence, length);
+	s_nmea_length += length;
+}
+
+// ddmm.mmmmm or dddmm.mmmmm and the hemisphere
+static void prv_nmea_coordinate(char *out, size_t size, int32_t value, int degree_digits, char positive,
+	char negative)
+{
+	uint32_t magnitude = (uint32_t)(value < 0 ? -(int64_t)value : value);
+	uint32_t degrees = magnitude / 10000000;
+	uint64_t minutes = (uint64_t)(magnitude % 10000000) * 60;   // 1/10^7 minutes
+	snprintf(out, size, "%0*u%02u.%05u,%c", degree_digits, degrees, (unsigned)(minutes / 10000000),
+		(unsigned)(minutes % 10000000 / 100), value < 0 ? negative : positive);
+}
+
+static void prv_nmea_fix(uint64_t fix_ms)
+{
+	SimWorld world;
+	prv_world(fix_ms, &world);
+
+	time_t utc = sim_time(NULL) - (time_t)((sim_now_ms() - fix_ms) / 1000);
+	struct tm tm;
+	gmtime_r(&utc, &tm);
+	char time_text[16], lat_text[24], lon_text[24], body[96];
+	snprintf(time_text, sizeof(time_text), "%02d%02d%02d.00", tm.tm_hour, tm.tm_min, tm.tm_sec);
+	prv_nmea_coordinate(lat_text, sizeof(lat_text), world.lat, 2, 'N', 'S');
+	prv_nmea_coordinate(lon_text, sizeof(lon_text), world.lon, 3, 'E', 'W');
+
+	unsigned hdop = 80 + world.sat % 3 * 15;
+	snprintf(body, sizeof(body), "GPGGA,%s,%s,%s,%u,%02u,%u.%02u,%u.%02u,M,-25.0,M,,", time_text, lat_text, lon_text,
+		world.fix, world.sat, hdop / 100, hdop % 100, world.alt / 100, world.alt % 100);
+	prv_nmea_sentence(body);
+
+	unsigned knots = world.speed * 900 / 463;
+	snprintf(body, sizeof(body), "GPRMC,%s,A,%s,%s,%u.%02u,%u.%02u,%02d%02d%02d,,,A", time_text, lat_text, lon_text,
+		knots / 100, knots % 100, world.course / 100, world.course % 100, tm.tm_mday, tm.tm_mon + 1, tm.tm_year % 100);
+	prv_nmea_sentence(body);
+
+	// the satellites used and three more low on the horizon
+	int in_view = world.sat + 3;
+	int messages = (in_view + 3) / 4;
+	for (int m = 0; m < messages; m++) {
+		int length = snprintf(body, sizeof(body), "GPGSV,%d,%d,%02d", messages, m + 1, in_view);
+		for (int i = m * 4; i < in_view && i < m * 4 + 4; i++) {
+			int prn = 2 + i * 3;
+			int snr = i < world.sat ? 30 + prn % 17 : 0;
+			length += snprintf(body + length, sizeof(body) - length, ",%02d,%02d,%03d,", prn, 10 + prn * 7 % 70,
+				prn * 37 % 360);
+			if (snr) {
+				length += snprintf(body + length, sizeof(body) - length, "%02d", snr);
+			}
+		}
+		prv_nmea_sentence(body);
+	}
+}
+
+// the sentences queued since the last read, as much as fits
+static size_t prv_nmea_read(SmartstrapAttribute *attr)
+{
+	uint64_t now = sim_now_ms();
+	if (!s_nmea_next_ms) {
+		s_nmea_next_ms = now - now % SIM_FIX_PERIOD_MS;
+	}
+	for (; s_nmea_next_ms <= now; s_nmea_next_ms += SIM_FIX_PERIOD_MS) {
+		prv_nmea_fix(s_nmea_next_ms);
+	}
+
+	size_t length = MIN(s_nmea_length, attr->buffer_length);
+	memcpy(attr->buffer, s_nmea, length);
+	memmove(s_nmea, s_nmea + length, s_nmea_length - length);
+	s_nmea_length -= length;
+	if (length && attr->endpoint->corrupt_pct && sim_random() % 100 < attr->endpoint->corrupt_pct) {
+		attr->buffer[sim_random() % length] ^= 1 << (sim_random() % 7);
+	}
+	return length;
+}
+
+uint32_t sim_strap_nmea_dropped(void)
+{
+	return s_nmea_dropped;
+}
+
+static void prv_world(uint64_t now_ms, SimWorld *world)
+{
+	// new fixes only appear once per fix period, like a 1 Hz receiver
+	uint64_t fix_ms = now_ms - now_ms % SIM_FIX_PERIOD_MS;
+	uint64_t moving_ms = fix_ms;
+	bool paused = false;
+	if (fix_ms > s_pause_from_ms) {
+		paused = fix_ms < s_pause_to_ms;
+		moving_ms -= MIN(fix_ms, s_pause_to_ms) - s_pause_from_ms;
+	}
+
+	double t = (double)moving_ms / 1000.0;
+	double heading = 0.8 + 0.3 * sin(t / 120.0);
+	double metres = 3.0 * t;
+
+	world->lat = 374400662 + (int32_t)(metres * cos(heading) * 90.0);
+	world->lon = -1221583808 + (int32_t)(metres * sin(heading) * 113.0);
+	if (s_gps_noise_m) {
+		world->lat += (int32_t)(prv_gps_noise(fix_ms, 1) * 90.0);
+		world->lon += (int32_t)(prv_gps_noise(fix_ms, 2) * 113.0);
+	}
+	world->speed = paused ? 0 : (uint16_t)(300 + 20 * sin(t / 7.0));
+	world->alt = (uint16_t)(3000 + 500 * sin(t / 60.0));
+	world->course = (uint16_t)(fmod(heading * 180.0 / M_PI + 360.0, 360.0) * 100.0);
+	world->fix = 1;
+	world->sat = (uint8_t)(7 + ((uint64_t)t / 10) % 3);
+	world->timestamp = (uint32_t)fix_ms;
+	world->vbat = (uint16_t)(410 - now_ms / (60 * 1000));
+}
+
+static size_t prv_encode_response(SimStrapEndpoint *endpoint, uint8_t *out, size_t capacity)
+{
+	SimWorld world;
+	uint8_t data[32];
+	size_t length = 0;
+
+	prv_world(sim_now_ms(), &world);
+
+	if (endpoint->service_id == SERVICE_BAT && endpoint->attribute_id == ATTR_BAT_V) {
+		memcpy(data, &world.vbat, 2);
+		length = 2;
+	}
+	else if (endpoint->service_id == SERVICE_GPS && endpoint->attribute_id == ATTR_GPS_LOCATION) {
+		memcpy(data, &world.lat, 4);
+		memcpy(data + 4, &world.lon, 4);
+		length = 8;
+	}
+	else if (endpoint->service_id == SERVICE_GPS && endpoint->attribute_id == ATTR_GPS_SPEED) {
+		memcpy(data, &world.speed, 2);
+		length = 2;
+	}
+	else if (endpoint->service_id == SERVICE_GPS && endpoint->attribute_id == ATTR_GPS_ALTITUDE) {
+		memcpy(data, &world.alt, 2);
+		length = 2;
+	}
+	else if (endpoint->service_id == SERVICE_GPS && endpoint->attribute_id == ATTR_GPS_FIX_QUALITY) {
+		data[0] = world.fix;
+		length = 1;
+	}
+	else if (endpoint->service_id == SERVICE_GPS && endpoint->attribute_id == ATTR_GPS_SATELLITES) {
+		data[0] = world.sat;
+		length = 1;
+	}
+	else if (endpoint->service_id == SERVICE_GPS && endpoint->attribute_id == ATTR_GPS_SNAPSHOT) {
+		xadow_gps_snapshot snapshot = {
+			.lat = world.lat,
+			.lon = world.lon,
+			.speed = world.speed,
+			.alt = world.alt,
+			.fix = world.fix,
+			.sat = world.sat,
+			.timestamp = world.timestamp,
+		};
+		memcpy(data, &snapshot, sizeof(snapshot));
+		length = sizeof(snapshot);
+	}
+	else if (endpoint->service_id == SERVICE_NFC && endpoint->attribute_id == ATTR_NFC_GET_UID) {
+		const uint8_t uid[] = { 0x04, 0xA2, 0x3B, s_tag_serial };
+		length = s_tag_serial ? sizeof(uid) : 0;
+		memcpy(data, uid, length);
+	}
+
+	length = MIN(length, capacity);
+	memcpy(out, data, length);
+	return length;
+}
+
+// the part of a response that is the value, the snapshot timestamp ticks even when standing still
+static size_t prv_value_length(SimStrapEndpoint *endpoint, size_t length)
+{
+	if (endpoint->service_id == SERVICE_GPS && endpoint->attribute_id == ATTR_GPS_SNAPSHOT) {
+		return MIN(length, offsetof(xadow_gps_snapshot, timestamp));
+	}
+	// tag messages, the log and the sentences are not part of the world model
+	if ((endpoint->service_id == SERVICE_NFC && endpoint->attribute_id != ATTR_NFC_GET_UID) ||
+		endpoint->service_id == SMARTSTRAP_RAW_DATA_SERVICE_ID ||
+		(endpoint->service_id == SERVICE_GPS && endpoint->attribute_id == ATTR_GPS_NMEA)) {
+		return 0;
+	}
+	return length;
+}
+
+static void prv_notify_attribute(SmartstrapServiceId service_id, SmartstrapAttributeId attribute_id);
+
+// firmware that notifies new fixes and battery changes instead of waiting to be polled
+static void prv_notify_changes(void *context)
+{
+	static SimWorld s_last;
+	SimWorld world;
+
+	prv_world(sim_now_ms(), &world);
+	if (world.lat != s_last.lat || world.lon != s_last.lon || world.speed != s_last.speed ||
+		world.alt != s_last.alt || world.fix != s_last.fix || world.sat != s_last.sat) {
+		prv_notify_attribute(SERVICE_GPS, ATTR_GPS_SNAPSHOT);
+		prv_notify_attribute(SERVICE_GPS, ATTR_GPS_NMEA);
+		prv_notify_attribute(SERVICE_GPS, ATTR_GPS_LOCATION);
+	}
+	if (world.vbat != s_last.vbat) {
+		prv_notify_attribute(SERVICE_BAT, ATTR_BAT_V);
+	}
+	s_last = world;
+	sim_schedule(sim_now_ms() + SIM_FIX_PERIOD_MS, prv_notify_changes, NULL);
+}
+
+void sim_strap_notify_changes(void)
+{
+	if (!s_notify_changes) {
+		s_notify_changes = true;
+		sim_schedule(SIM_FIX_PERIOD_MS / 2, prv_notify_changes, NULL);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// endpoints and services
+
+SimStrapEndpoint *sim_strap_endpoint(SmartstrapServiceId service_id, SmartstrapAttributeId attribute_id)
+{
+	for (int i = 0; i < s_num_endpoints; i++) {
+		if (s_endpoints[i].service_id == service_id && s_endpoints[i].attribute_id == attribute_id) {
+			return &s_endpoints[i];
+		}
+	}
+	if (s_num_endpoints == MAX_ENDPOINTS) {
+		fprintf(stderr, "sim: too many strap endpoints\n");
+		abort();
+	}
+	SimStrapEndpoint *endpoint = &s_endpoints[s_num_endpoints++];
+	memset(endpoint, 0, sizeof(*endpoint));
+	endpoint->service_id = service_id;
+	endpoint->attribute_id = attribute_id;
+	endpoint->latency_ms = 30;
+	return endpoint;
+}
+
+void sim_strap_set_all(uint32_t latency_ms, uint32_t jitter_ms, uint8_t busy_pct, uint8_t timeout_pct)
+{
+	static const uint16_t known[][2] = {
+		{ SERVICE_BAT, ATTR_BAT_V },
+		{ SERVICE_GPS, ATTR_GPS_LOCATION },
+		{ SERVICE_GPS, ATTR_GPS_SPEED },
+		{ SERVICE_GPS, ATTR_GPS_ALTITUDE },
+		{ SERVICE_GPS, ATTR_GPS_FIX_QUALITY },
+		{ SERVICE_GPS, ATTR_GPS_SATELLITES },
+		{ SERVICE_GPS, ATTR_GPS_SNAPSHOT },
+		{ SERVICE_GPS, ATTR_GPS_NMEA },
+		{ SERVICE_NFC, ATTR_NFC_GET_UID },
+		{ SERVICE_NFC, ATTR_NFC_READ_NDEF },
+		{ SERVICE_NFC, ATTR_NFC_WRITE_NDEF },
+		{ SERVICE_NFC, ATTR_NFC_ERASE_NDEF },
+		{ SMARTSTRAP_RAW_DATA_SERVICE_ID, SMARTSTRAP_RAW_DATA_ATTRIBUTE_ID },
+	};
+	for (size_t i = 0; i < ARRAY_LENGTH(known); i++) {
+		sim_strap_endpoint(known[i][0], known[i][1]);
+	}
+	for (int i = 0; i < s_num_endpoints; i++) {
+		s_endpoints[i].latency_ms = latency_ms;
+		s_endpoints[i].jitter_ms = jitter_ms;
+		s_endpoints[i].busy_pct = busy_pct;
+		s_endpoints[i].timeout_pct = timeout_pct;
+	}
+}
+
+void sim_strap_pause_walker(uint64_t from_ms, uint64_t to_ms)
+{
+	s_pause_from_ms = from_ms;
+	s_pause_to_ms = to_ms;
+}
+
+void sim_strap_set_gps_noise(uint16_t metres)
+{
+	s_gps_noise_m = metres;
+}
+
+void sim_strap_set_max_in_flight(int max_in_flight)
+{
+	s_max_in_flight = max_in_flight;
+}
+
+static struct SimStrapService *prv_service(SmartstrapServiceId service_id)
+{
+	for (int i = 0; i < s_num_services; i++) {
+		if (s_services[i].service_id == service_id) {
+			return &s_services[i];
+		}
+	}
+	return NULL;
+}
+
+static void prv_notify_availability(SmartstrapServiceId service_id, bool available)
+{
+	if (s_subscribed && s_handlers.availability_did_change) {
+		s_handlers.availability_did_change(service_id, available);
+	}
+}
+
+static void prv_apply_presence(void *context)
+{
+	struct SimStrapChange *change = context;
+	if (s_present != change->present) {
+		s_present = change->present;
+		prv_notify_availability(SMARTSTRAP_RAW_DATA_SERVICE_ID, s_present);
+		for (int i = 0; i < s_num_services; i++) {
+			if (s_services[i].available) {
+				prv_notify_availability(s_services[i].service_id, s_present);
+			}
+		}
+	}
+	free(change);
+}
+
+static void prv_apply_service(void *context)
+{
+	struct SimStrapChange *change = context;
+	struct SimStrapService *service = prv_service(change->service_id);
+	if (service && service->available != change->available) {
+		service->available = change->available;
+		if (s_present) {
+			prv_notify_availability(service->service_id, service->available);
+		}
+	}
+	free(change);
+}
+
+static void prv_notify_attribute(SmartstrapServiceId service_id, SmartstrapAttributeId attribute_id)
+{
+	if (!s_present || !s_subscribed || !s_handlers.notified || !smartstrap_service_is_available(service_id)) {
+		return;
+	}
+	for (int i = 0; i < s_num_attributes; i++) {
+		SimStrapEndpoint *endpoint = s_attributes[i]->endpoint;
+		if (endpoint->service_id == service_id && endpoint->attribute_id == attribute_id) {
+			endpoint->notifications++;
+			s_handlers.notified(s_attributes[i]);
+			break;
+		}
+	}
+}
+
+static void prv_apply_notify(void *context)
+{
+	struct SimStrapChange *change = context;
+	prv_notify_attribute(change->service_id, change->attribute_id);
+	free(change);
+}
+
+static struct SimStrapChange *prv_change(void)
+{
+	return calloc(1, sizeof(struct SimStrapChange));
+}
+
+void sim_strap_schedule_presence(uint64_t at_ms, bool present)
+{
+	struct SimStrapChange *change = prv_change();
+	change->present = present;
+	sim_schedule(at_ms, prv_apply_presence, change);
+}
+
+void sim_strap_schedule_service(uint64_t at_ms, SmartstrapServiceId service_id, bool available)
+{
+	struct SimStrapChange *change = prv_change();
+	change->service_id = service_id;
+	change->available = available;
+	sim_schedule(at_ms, prv_apply_service, change);
+}
+
+static void prv_apply_tag(void *context)
+{
+	struct SimStrapChange *change = context;
+	s_tag_serial = change->attribute_id;
+	if (s_tag_serial && s_tag_serial != s_tag_last) {
+		s_tag_last = s_tag_serial;
+		prv_ndef_default();
+	}
+	prv_notify_attribute(SERVICE_NFC, ATTR_NFC_GET_UID);
+	free(change);
+}
+
+void sim_strap_schedule_tag(uint64_t at_ms, uint8_t serial)
+{
+	struct SimStrapChange *change = prv_change();
+	change->attribute_id = serial;
+	sim_schedule(at_ms, prv_apply_tag, change);
+}
+
+void sim_strap_schedule_notify(uint64_t at_ms, SmartstrapServiceId service_id, SmartstrapAttributeId attribute_id)
+{
+	struct SimStrapChange *change = prv_change();
+	change->service_id = service_id;
+	change->attribute_id = attribute_id;
+	sim_schedule(at_ms, prv_apply_notify, change);
+}
+
+// ---------------------------------------------------------------------------
+// request completion
+
+struct SimStrapCompletion {
+	SmartstrapAttribute *attr;
+	SmartstrapResult result;
+	uint64_t issued_ms;
+	bool is_write;
+	bool request_read;
+};
+
+static void prv_complete(void *context)
+{
+	struct SimStrapCompletion *completion = context;
+	SmartstrapAttribute *attr = completion->attr;
+	SimStrapEndpoint *endpoint = attr->endpoint;
+	SmartstrapResult result = completion->result;
+
+	attr->pending = false;
+	s_in_flight--;
+
+	if (result == SmartstrapResultOk && !s_present) {
+		result = SmartstrapResultTimeOut;
+	}
+
+	bool ndef = endpoint->service_id == SERVICE_NFC && (endpoint->attribute_id == ATTR_NFC_READ_NDEF ||
+		endpoint->attribute_id == ATTR_NFC_WRITE_NDEF || endpoint->attribute_id == ATTR_NFC_ERASE_NDEF);
+	bool bulk = endpoint->service_id == SMARTSTRAP_RAW_DATA_SERVICE_ID &&
+		endpoint->attribute_id == SMARTSTRAP_RAW_DATA_ATTRIBUTE_ID;
+	if (ndef && !s_ndef_length) {
+		prv_ndef_default();
+	}
+
+	if (completion->is_write) {
+		if (ndef && endpoint->attribute_id != ATTR_NFC_READ_NDEF && result == SmartstrapResultOk) {
+			prv_ndef_write(attr);
+		}
+		if (s_subscribed && s_handlers.did_write) {
+			s_handlers.did_write(attr, result);
+		}
+		if (!completion->request_read || result != SmartstrapResultOk) {
+			free(completion);
+			return;
+		}
+	}
+
+	size_t length = 0;
+	switch (result) {
+	case SmartstrapResultOk:
+		if (ndef) {
+			length = prv_ndef_read(attr);
+		}
+		else if (bulk) {
+			length = prv_bulk_reply(attr);
+		}
+		else if (endpoint->service_id == SERVICE_GPS && endpoint->attribute_id == ATTR_GPS_NMEA) {
+			length = prv_nmea_read(attr);
+		}
+		else {
+			length = prv_encode_response(endpoint, attr->buffer, attr->buffer_length);
+		}
+		endpoint->ok++;
+		endpoint->latency_total_ms += sim_now_ms() - completion->issued_ms;
+		endpoint->last_ok_ms = sim_now_ms();
+		endpoint->value_length = prv_value_length(endpoint, MIN(length, sizeof(endpoint->value)));
+		memcpy(endpoint->value, attr->buffer, endpoint->value_length);
+		endpoint->diverged_ms = 0;
+		break;
+	case SmartstrapResultTimeOut:
+		endpoint->timeouts++;
+		break;
+	case SmartstrapResultAttributeUnsupported:
+		endpoint->unsupported_replies++;
+		break;
+	default:
+		break;
+	}
+
+	if (s_subscribed && s_handlers.did_read) {
+		s_handlers.did_read(attr, result, attr->buffer, length);
+	}
+	free(completion);
+}
+
+static SmartstrapResult prv_submit(SmartstrapAttribute *attr, bool is_write, bool request_read)
+{
+	SimStrapEndpoint *endpoint = attr->endpoint;
+
+	if (!s_present) {
+		endpoint->unavailable++;
+		return SmartstrapResultNotPresent;
+	}
+	if (!smartstrap_service_is_available(endpoint->service_id)) {
+		endpoint->unavailable++;
+		return SmartstrapResultServiceUnavailable;
+	}
+	if (attr->pending || s_in_flight >= s_max_in_flight ||
+		(endpoint->busy_pct && sim_random() % 100 < endpoint->busy_pct)) {
+		endpoint->busy++;
+		return SmartstrapResultBusy;
+	}
+
+	struct SimStrapCompletion *completion = calloc(1, sizeof(*completion));
+	completion->attr = attr;
+	completion->issued_ms = sim_now_ms();
+	completion->is_write = is_write;
+	completion->request_read = request_read;
+
+	uint32_t latency = endpoint->latency_ms + sim_random_range(0, endpoint->jitter_ms);
+	if (latency > s_timeout_ms || (endpoint->timeout_pct && sim_random() % 100 < endpoint->timeout_pct)) {
+		completion->result = SmartstrapResultTimeOut;
+		latency = s_timeout_ms;
+	}
+	else if (endpoint->unsupported) {
+		completion->result = SmartstrapResultAttributeUnsupported;
+	}
+	else {
+		completion->result = SmartstrapResultOk;
+	}
+
+	attr->pending = true;
+	s_in_flight++;
+	sim_schedule(sim_now_ms() + latency, prv_complete, completion);
+	return SmartstrapResultOk;
+}
+
+// ---------------------------------------------------------------------------
+// smartstrap API
+
+SmartstrapResult smartstrap_subscribe(SmartstrapHandlers handlers)
+{
+	s_handlers = handlers;
+	s_subscribed = true;
+	return SmartstrapResultOk;
+}
+
+void smartstrap_unsubscribe(void)
+{
+	s_subscribed = false;
+}
+
+void smartstrap_set_timeout(uint16_t timeout_ms)
+{
+	s_timeout_ms = timeout_ms;
+}
+
+SmartstrapAttribute *smartstrap_attribute_create(SmartstrapServiceId service_id,
+	SmartstrapAttributeId attribute_id, size_t buffer_length)
+{
+	if (s_num_attributes == MAX_ATTRIBUTES) {
+		return NULL;
+	}
+	SmartstrapAttribute *attr = calloc(1, sizeof(SmartstrapAttribute));
+	attr->endpoint = sim_strap_endpoint(service_id, attribute_id);
+	attr->endpoint->created = true;
+	attr->buffer = calloc(1, buffer_length);
+	attr->buffer_length = buffer_length;
+	s_attributes[s_num_attributes++] = attr;
+	return attr;
+}
+
+void smartstrap_attribute_destroy(SmartstrapAttribute *attribute)
+{
+	for (int i = 0; i < s_num_attributes; i++) {
+		if (s_attributes[i] == attribute) {
+			s_attributes[i] = s_attributes[--s_num_attributes];
+			free(attribute->buffer);
+			free(attribute);
+			return;
+		}
+	}
+}
+
+bool smartstrap_service_is_available(SmartstrapServiceId service_id)
+{
+	if (!s_present) {
+		return false;
+	}
+	if (service_id == SMARTSTRAP_RAW_DATA_SERVICE_ID) {
+		return true;
+	}
+	struct SimStrapService *service = prv_service(service_id);
+	return service && service->available;
+}
+
+SmartstrapServiceId smartstrap_attribute_get_service_id(SmartstrapAttribute *attribute)
+{
+	return attribute->endpoint->service_id;
+}
+
+SmartstrapAttributeId smartstrap_attribute_get_attribute_id(SmartstrapAttribute *attribute)
+{
+	return attribute->endpoint->attribute_id;
+}
+
+SmartstrapResult smartstrap_attribute_read(SmartstrapAttribute *attribute)
+{
+	if (!attribute) {
+		return SmartstrapResultInvalidArgs;
+	}
+	if (attribute->writing) {
+		return SmartstrapResultBusy;
+	}
+	SmartstrapResult result = prv_submit(attribute, false, false);
+	if (result == SmartstrapResultOk) {
+		attribute->endpoint->reads++;
+	}
+	return result;
+}
+
+SmartstrapResult smartstrap_attribute_begin_write(SmartstrapAttribute *attribute, uint8_t **buffer,
+	size_t *buffer_length)
+{
+	if (!attribute || !buffer || !buffer_length) {
+		return SmartstrapResultInvalidArgs;
+	}
+	if (attribute->pending || attribute->writing) {
+		return SmartstrapResultBusy;
+	}
+	attribute->writing = true;
+	*buffer = attribute->buffer;
+	*buffer_length = attribute->buffer_length;
+	return SmartstrapResultOk;
+}
+
+SmartstrapResult smartstrap_attribute_end_write(SmartstrapAttribute *attribute, size_t write_length,
+	bool request_read)
+{
+	if (!attribute || !attribute->writing) {
+		return SmartstrapResultInvalidArgs;
+	}
+	attribute->writing = false;
+	attribute->write_length = write_length;
+	SmartstrapResult result = prv_submit(attribute, true, request_read);
+	if (result == SmartstrapResultOk) {
+		attribute->endpoint->writes++;
+	}
+	return result;
+}
+
+// ---------------------------------------------------------------------------
+// reporting
+
+void sim_strap_sample_staleness(void)
+{
+	uint64_t now = sim_now_ms();
+	for (int i = 0; i < s_num_endpoints; i++) {
+		SimStrapEndpoint *endpoint = &s_endpoints[i];
+		if (!endpoint->created || !endpoint->ok) {
+			continue;
+		}
+		uint8_t current[sizeof(endpoint->value)];
+		size_t length = prv_encode_response(endpoint, current, sizeof(current));
+		if (!endpoint->diverged_ms && (prv_value_length(endpoint, length) != endpoint->value_length ||
+			memcmp(current, endpoint->value, endpoint->value_length) != 0)) {
+			endpoint->diverged_ms = now;
+		}
+
+		uint64_t stale = endpoint->diverged_ms ? now - endpoint->diverged_ms : 0;
+		endpoint->age_total_ms += now - endpoint->last_ok_ms;
+		endpoint->staleness_total_ms += stale;
+		endpoint->staleness_samples++;
+		if (stale > endpoint->staleness_max_ms) {
+			endpoint->staleness_max_ms = stale;
+		}
+	}
+}
+
+void sim_strap_report(FILE *out, uint64_t duration_ms)
+{
+	uint32_t total_reads = 0, total_ok = 0;
+
+	fprintf(out, "%-11s %6s %6s %6s %6s %6s %6s %6s %8s %8s %9s %9s\n",
+		"endpoint", "reads", "ok", "busy", "unavl", "tmo", "unsup", "ntfy", "lat(ms)", "age(ms)", "stale(ms)", "max(ms)");
+	for (int i = 0; i < s_num_endpoints; i++) {
+		SimStrapEndpoint *endpoint = &s_endpoints[i];
+		if (!endpoint->reads && !endpoint->writes && !endpoint->busy && !endpoint->unavailable) {
+			continue;
+		}
+		total_reads += endpoint->reads;
+		total_ok += endpoint->ok;
+		fprintf(out, "%04x:%04x   %6u %6u %6u %6u %6u %6u %6u %8.1f %8.1f %9.1f %9llu\n",
+			endpoint->service_id, endpoint->attribute_id,
+			endpoint->reads, endpoint->ok, endpoint->busy, endpoint->unavailable,
+			endpoint->timeouts, endpoint->unsupported_replies, endpoint->notifications,
+			endpoint->ok ? (double)endpoint->latency_total_ms / endpoint->ok : 0.0,
+			endpoint->staleness_samples ? (double)endpoint->age_total_ms / endpoint->staleness_samples : 0.0,
+			endpoint->staleness_samples ? (double)endpoint->staleness_total_ms / endpoint->staleness_samples : 0.0,
+			(unsigned long long)endpoint->staleness_max_ms);
+	}
+	fprintf(out, "reads/s: %.2f  ok/s: %.2f\n",
+		total_reads * 1000.0 / duration_ms, total_ok * 1000.0 / duration_ms);
+}
@@ -0,0 +1,244 @@
+// bulk_transfer.c : fetches the strap's log of fixes in framed bulk reads on the raw data service
+
+#include "bulk_transfer.h"
+
+#define FRAME_DATA_MAX  (XADOW_BULK_FIXES * sizeof(xadow_gps_snapshot))
+
+static struct
+{
+	bool     active;
+	uint32_t since;
+	uint16_t delivered;     //first frame not handed on yet
+	uint16_t next;          //first frame not asked for yet
+	int32_t  last;          //frame flagged XADOW_BULK_LAST, -1 until one arrives
+	uint8_t  attempts;      //requests since the last one that brought a new frame
+} s_bulk;
+
+//frames that arrived ahead of one still missing, by seq % BULK_WINDOW
+static struct
+{
+	bool     held;
+	uint16_t seq;
+	uint8_t  count;
+	uint8_t  data[FRAME_DATA_MAX];
+} s_window[BULK_WINDOW];
+
+static bulk_stats s_stats;
+static BulkFixHandler s_on_fix;
+static BulkDoneHandler s_on_done;
+
+void bulk_transfer_set_handlers(BulkFixHandler on_fix, BulkDoneHandler on_done)
+{
+	s_on_fix = on_fix;
+	s_on_done = on_done;
+}
+
+//crc-16/ccitt-false
+uint16_t bulk_crc16(const uint8_t *data, size_t length)
+{
+	uint16_t crc = 0xffff;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		crc ^= data[i] << 8;
+		for (int bit = 0; bit < 8; bit++)
+		{
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+//the log from the first fix after since, in strap uptime
+bool bulk_transfer_start(uint32_t since)
+{
+	if (s_bulk.active)
+	{
+		return false;
+	}
+	memset(&s_bulk, 0, sizeof(s_bulk));
+	memset(s_window, 0, sizeof(s_window));
+	s_bulk.active = true;
+	s_bulk.since = since;
+	s_bulk.last = -1;
+	return true;
+}
+
+bool bulk_transfer_active(void)
+{
+	return s_bulk.active;
+}
+
+const bulk_stats *bulk_transfer_stats(void)
+{
+	return &s_stats;
+}
+
+static void finish(bool ok)
+{
+	if (!ok)
+	{
+		APP_LOG(APP_LOG_LEVEL_WARNING, "Bulk: gave up at frame %d", s_bulk.delivered);
+	}
+	s_bulk.active = false;
+	if (s_on_done)
+	{
+		s_on_done(ok);
+	}
+}
+
+bool bulk_transfer_due(SmartstrapAttribute *attr)
+{
+	if (!s_bulk.active)
+	{
+		return false;
+	}
+	if (s_bulk.attempts > BULK_RETRIES)
+	{
+		finish(false);
+		return false;
+	}
+	return true;
+}
+
+static bool frame_held(uint16_t seq)
+{
+	return s_window[seq % BULK_WINDOW].held && s_window[seq % BULK_WINDOW].seq == seq;
+}
+
+SmartstrapResult bulk_transfer_issue(SmartstrapAttribute *attr)
+{
+	uint8_t *buffer;
+	size_t size;
+	SmartstrapResult result = smartstrap_attribute_begin_write(attr, &buffer, &size);
+
+	if (result != SmartstrapResultOk)
+	{
+		return result;
+	}
+
+	xadow_bulk_request request = {
+		.since = s_bulk.since,
+		.next = s_bulk.next,
+	};
+	for (uint16_t seq = s_bulk.delivered; seq != s_bulk.next && request.missing_count < XADOW_BULK_MISSING; seq++)
+	{
+		if (!frame_held(seq))
+		{
+			request.missing[request.missing_count++] = seq;
+		}
+	}
+	//none past the last frame, and no more than the window can hold
+	if (s_bulk.last < 0)
+	{
+		request.limit = min(BULK_FRAMES_PER_READ, s_bulk.delivered + BULK_WINDOW - s_bulk.next);
+	}
+	memcpy(buffer, &request, sizeof(request));
+
+	result = smartstrap_attribute_end_write(attr, sizeof(request), true);
+	if (result == SmartstrapResultOk)
+	{
+		s_bulk.attempts++;
+		s_stats.requests++;
+		s_stats.asked_again += request.missing_count;
+	}
+	return result;
+}
+
+static void deliver(const uint8_t *data, uint8_t count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		xadow_gps_snapshot fix;
+		memcpy(&fix, data + i * sizeof(fix), sizeof(fix));
+		if (s_on_fix)
+		{
+			s_on_fix(&fix);
+		}
+	}
+	s_stats.fixes += count;
+	s_bulk.delivered++;
+}
+
+//hands on a good frame, or keeps it until the frames before it are in
+static void accept(const xadow_bulk_frame *frame, const uint8_t *data)
+{
+	uint16_t ahead = frame->seq - s_bulk.delivered;
+
+	if (ahead >= BULK_WINDOW || frame_held(frame->seq))
+	{
+		//seen before, or further ahead than was asked for
+		return;
+	}
+	s_stats.frames++;
+	s_bulk.attempts = 0;
+	if ((uint16_t)(frame->seq + 1 - s_bulk.next) < BULK_WINDOW)
+	{
+		s_bulk.next = frame->seq + 1;
+	}
+	if (frame->flags & XADOW_BULK_LAST)
+	{
+		s_bulk.last = frame->seq;
+	}
+
+	if (ahead)
+	{
+		s_window[frame->seq % BULK_WINDOW].held = true;
+		s_window[frame->seq % BULK_WINDOW].seq = frame->seq;
+		s_window[frame->seq % BULK_WINDOW].count = frame->count;
+		memcpy(s_window[frame->seq % BULK_WINDOW].data, data, frame->count * sizeof(xadow_gps_snapshot));
+		return;
+	}
+	deliver(data, frame->count);
+	while (frame_held(s_bulk.delivered))
+	{
+		s_window[s_bulk.delivered % BULK_WINDOW].held = false;
+		deliver(s_window[s_bulk.delivered % BULK_WINDOW].data, s_window[s_bulk.delivered % BULK_WINDOW].count);
+	}
+}
+
+//the frames of a reply are checked and taken where they lie
+void bulk_transfer_did_read(SmartstrapAttribute *attr, SmartstrapResult result, const uint8_t *data,
+	size_t length)
+{
+	if (!s_bulk.active || result != SmartstrapResultOk)
+	{
+		return;
+	}
+	s_stats.bytes += length;
+
+	const uint8_t *end = data + length;
+	xadow_bulk_frame frame;
+	while (end - data >= (ptrdiff_t)XADOW_BULK_FRAME_SIZE(0))
+	{
+		memcpy(&frame, data, sizeof(frame));
+		size_t size = XADOW_BULK_FRAME_SIZE(frame.count);
+		if (frame.count > XADOW_BULK_FIXES || size > (size_t)(end - data))
+		{
+			//a garbled length, nothing after it can be found
+			s_stats.bad++;
+			break;
+		}
+		uint16_t crc = data[size - 2] | data[size - 1] << 8;
+		if (bulk_crc16(data, size - 2) == crc)
+		{
+			accept(&frame, data + sizeof(frame));
+		}
+		else
+		{
+			s_stats.bad++;
+		}
+		data += size;
+	}
+
+	if (s_bulk.last >= 0 && s_bulk.delivered > s_bulk.last)
+	{
+		finish(true);
+	}
+}
+
+//true when the write completes the request, which it only does when it failed
+bool bulk_transfer_did_write(SmartstrapAttribute *attr, SmartstrapResult result)
+{
+	return result != SmartstrapResultOk;
+}
@@ -0,0 +1,44 @@
+// bulk_transfer.h : fetches the strap's log of fixes in framed bulk reads on the raw data service
+//
+// Each request asks for the frames missing so far and for as many new ones as the window has room
+// for, and the reply packs in as many as fit, so a round trip carries several fixes rather than
+// one. Every frame has its own crc: a bad one is asked for again by sequence number on its own
+// while the frames around it are kept, out of order ones wait in the window until the gap before
+// them is filled. Fixes are handed on strictly in order. A request that brings nothing back is
+// sent again, up to BULK_RETRIES times.
+
+#pragma once
+
+#include <pebble.h>
+#include "xadow.h"
+
+#define BULK_WINDOW             8       //frames held until the ones before them arrive
+#define BULK_FRAMES_PER_READ    XADOW_BULK_READ_FRAMES
+#define BULK_BUFFER_SIZE        sizeof(xadow_bulk_read)
+#define BULK_RETRIES            3
+
+typedef void (*BulkFixHandler)(const xadow_gps_snapshot *fix);
+typedef void (*BulkDoneHandler)(bool ok);
+
+typedef struct bulk_stats
+{
+	uint32_t requests;
+	uint32_t frames;        //good ones, each counted once
+	uint32_t asked_again;   //frames in the missing lists of requests
+	uint32_t bad;           //frames failing the crc
+	uint32_t fixes;
+	uint32_t bytes;         //of replies
+} bulk_stats;
+
+void bulk_transfer_set_handlers(BulkFixHandler on_fix, BulkDoneHandler on_done);
+bool bulk_transfer_start(uint32_t since);
+bool bulk_transfer_active(void);
+const bulk_stats *bulk_transfer_stats(void);
+uint16_t bulk_crc16(const uint8_t *data, size_t length);
+
+//for the read pipeline
+bool bulk_transfer_due(SmartstrapAttribute *attr);
+SmartstrapResult bulk_transfer_issue(SmartstrapAttribute *attr);
+void bulk_transfer_did_read(SmartstrapAttribute *attr, SmartstrapResult result, const uint8_t *data,
+	size_t length);
+bool bulk_transfer_did_write(SmartstrapAttribute *attr, SmartstrapResult result);
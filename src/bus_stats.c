@@ -0,0 +1,217 @@
+// bus_stats.c : counters and latency histograms of the smartstrap reads, per attribute
+
+#include "bus_stats.h"
+#include "xadow.h"
+
+static bus_attr_stats s_slots[BUS_STATS_SLOTS];
+static int s_num_slots = 0;
+
+static struct
+{
+	uint32_t start;         //ms, start of the window being counted
+	uint32_t reads;
+	uint32_t last;          //reads in the last complete window
+} s_rate;
+
+//the slot of an attribute, taken on first use; NULL once all are taken
+static bus_attr_stats *slot(uint16_t service_id, uint16_t attr_id)
+{
+	for (int i = 0; i < s_num_slots; i++)
+	{
+		if (s_slots[i].service_id == service_id && s_slots[i].attr_id == attr_id)
+		{
+			return &s_slots[i];
+		}
+	}
+	if (s_num_slots == BUS_STATS_SLOTS)
+	{
+		return NULL;
+	}
+	bus_attr_stats *stats = &s_slots[s_num_slots++];
+	stats->service_id = service_id;
+	stats->attr_id = attr_id;
+	return stats;
+}
+
+static void count(uint16_t *counter)
+{
+	if (*counter < UINT16_MAX)
+	{
+		(*counter)++;
+	}
+}
+
+static void count_result(bus_attr_stats *stats, SmartstrapResult result)
+{
+	switch (result)
+	{
+	case SmartstrapResultOk:
+		stats->ok++;
+		break;
+	case SmartstrapResultBusy:
+		count(&stats->busy);
+		break;
+	case SmartstrapResultTimeOut:
+		count(&stats->timeouts);
+		break;
+	case SmartstrapResultAttributeUnsupported:
+		count(&stats->unsupported);
+		break;
+	default:
+		count(&stats->errors);
+		break;
+	}
+}
+
+static void roll_rate(uint32_t now)
+{
+	uint32_t elapsed = now - s_rate.start;
+
+	if (elapsed >= BUS_RATE_WINDOW)
+	{
+		//a window with no reads at all may have been skipped
+		s_rate.last = elapsed < 2 * BUS_RATE_WINDOW ? s_rate.reads : 0;
+		s_rate.start = now;
+		s_rate.reads = 0;
+	}
+}
+
+void bus_stats_read_issued(uint16_t service_id, uint16_t attr_id, uint32_t now)
+{
+	bus_attr_stats *stats = slot(service_id, attr_id);
+
+	if (stats)
+	{
+		stats->reads++;
+	}
+	roll_rate(now);
+	s_rate.reads++;
+}
+
+void bus_stats_read_refused(uint16_t service_id, uint16_t attr_id, SmartstrapResult result)
+{
+	bus_attr_stats *stats = slot(service_id, attr_id);
+
+	if (stats)
+	{
+		count_result(stats, result);
+	}
+}
+
+void bus_stats_read_done(uint16_t service_id, uint16_t attr_id, SmartstrapResult result, uint32_t latency,
+	uint32_t now)
+{
+	bus_attr_stats *stats = slot(service_id, attr_id);
+
+	if (!stats)
+	{
+		return;
+	}
+	count_result(stats, result);
+	if (result == SmartstrapResultOk)
+	{
+		stats->last_ok = now;
+	}
+	if (result != SmartstrapResultTimeOut)
+	{
+		int bucket = 0;
+		for (uint32_t bound = BUS_LATENCY_FIRST; latency > bound && bucket < BUS_LATENCY_BUCKETS - 1; bound *= 2)
+		{
+			bucket++;
+		}
+		count(&stats->latency[bucket]);
+	}
+}
+
+void bus_stats_read_lost(uint16_t service_id, uint16_t attr_id)
+{
+	bus_attr_stats *stats = slot(service_id, attr_id);
+
+	if (stats)
+	{
+		count(&stats->lost);
+	}
+}
+
+int bus_stats_count(void)
+{
+	return s_num_slots;
+}
+
+const bus_attr_stats *bus_stats_get(int index)
+{
+	return index < s_num_slots ? &s_slots[index] : NULL;
+}
+
+//ms bound of the bucket the percentile falls in, 0 without replies, UINT16_MAX past the last bound
+uint16_t bus_stats_latency_percentile(const bus_attr_stats *stats, uint8_t percent)
+{
+	uint32_t total = 0;
+
+	for (int i = 0; i < BUS_LATENCY_BUCKETS; i++)
+	{
+		total += stats->latency[i];
+	}
+	if (!total)
+	{
+		return 0;
+	}
+	uint32_t rank = (total * percent + 99) / 100;
+	uint32_t seen = 0;
+	uint16_t bound = BUS_LATENCY_FIRST;
+	for (int i = 0; i < BUS_LATENCY_BUCKETS - 1; i++, bound *= 2)
+	{
+		seen += stats->latency[i];
+		if (seen >= rank)
+		{
+			return bound;
+		}
+	}
+	return UINT16_MAX;
+}
+
+//reads issued over the last BUS_RATE_WINDOW
+uint32_t bus_stats_reads_per_window(uint32_t now)
+{
+	roll_rate(now);
+	return s_rate.last;
+}
+
+#if BUS_TRACE
+
+static bus_trace_record s_trace[BUS_TRACE_SIZE];
+static uint16_t s_trace_next = 0;
+static uint16_t s_trace_count = 0;
+
+void bus_trace(enum bus_event event, uint16_t service_id, uint16_t attr_id, uint8_t result, uint32_t now)
+{
+	bus_trace_record *record = &s_trace[s_trace_next];
+
+	record->time = now;
+	record->service_id = service_id;
+	record->attr_id = attr_id;
+	record->event = event;
+	record->result = result;
+	s_trace_next = (s_trace_next + 1) % BUS_TRACE_SIZE;
+	if (s_trace_count < BUS_TRACE_SIZE)
+	{
+		s_trace_count++;
+	}
+}
+
+uint16_t bus_trace_count(void)
+{
+	return s_trace_count;
+}
+
+//oldest first
+const bus_trace_record *bus_trace_get(uint16_t index)
+{
+	if (index >= s_trace_count)
+	{
+		return NULL;
+	}
+	return &s_trace[(s_trace_next + BUS_TRACE_SIZE - s_trace_count + index) % BUS_TRACE_SIZE];
+}
+
+#endif
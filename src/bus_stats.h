@@ -0,0 +1,75 @@
+// bus_stats.h : counters and latency histograms of the smartstrap reads, per attribute
+//
+// Always on: a read issued, refused or answered costs a lookup among a handful of slots and a
+// few increments. Latencies go into fixed buckets doubling from 25 ms, so percentiles come out
+// as the bucket bound they fall in.
+//
+// Built with BUS_TRACE=1 (./waf build --bus-trace), the per-read log lines and the result
+// strings they need are left out; every bus event goes into a binary ring instead, which the
+// diagnostics window counts and the app dumps when it exits.
+
+#pragma once
+
+#include <pebble.h>
+#include "xadow.h"
+
+#ifndef BUS_TRACE
+#define BUS_TRACE               0
+#endif
+
+#define BUS_STATS_SLOTS         XADOW_NUM_ATTRIBUTES    //one per attribute of the schema
+#define BUS_LATENCY_BUCKETS     8       //up to 25, 50, ... 1600 ms and above
+#define BUS_LATENCY_FIRST       25      //ms, bound of the first bucket
+#define BUS_RATE_WINDOW         10000   //ms the read rate is counted over
+#define BUS_TRACE_SIZE          64      //records
+
+typedef struct bus_attr_stats
+{
+	uint16_t service_id;
+	uint16_t attr_id;
+	uint32_t reads;         //issued
+	uint32_t ok;
+	uint16_t busy;          //refused by the firmware or answered Busy
+	uint16_t timeouts;
+	uint16_t unsupported;
+	uint16_t errors;        //any other result
+	uint16_t lost;          //no reply at all
+	uint16_t latency[BUS_LATENCY_BUCKETS];
+	uint32_t last_ok;       //ms, when the value was last read, 0 for never
+} bus_attr_stats;
+
+enum bus_event
+{
+	BUS_READ,               //issued
+	BUS_READ_REFUSED,       //smartstrap_attribute_read didn't take it
+	BUS_READ_DONE,
+	BUS_READ_LOST,
+	BUS_WRITE_DONE,
+	BUS_NOTIFIED,
+};
+
+typedef struct __attribute__((__packed__)) bus_trace_record
+{
+	uint32_t time;          //ms
+	uint16_t service_id;
+	uint16_t attr_id;
+	uint8_t  event;         //enum bus_event
+	uint8_t  result;        //SmartstrapResult
+} bus_trace_record;
+
+void bus_stats_read_issued(uint16_t service_id, uint16_t attr_id, uint32_t now);
+void bus_stats_read_refused(uint16_t service_id, uint16_t attr_id, SmartstrapResult result);
+void bus_stats_read_done(uint16_t service_id, uint16_t attr_id, SmartstrapResult result, uint32_t latency,
+	uint32_t now);
+void bus_stats_read_lost(uint16_t service_id, uint16_t attr_id);
+
+int bus_stats_count(void);
+const bus_attr_stats *bus_stats_get(int index);
+uint16_t bus_stats_latency_percentile(const bus_attr_stats *stats, uint8_t percent);
+uint32_t bus_stats_reads_per_window(uint32_t now);
+
+#if BUS_TRACE
+void bus_trace(enum bus_event event, uint16_t service_id, uint16_t attr_id, uint8_t result, uint32_t now);
+uint16_t bus_trace_count(void);
+const bus_trace_record *bus_trace_get(uint16_t index);
+#endif
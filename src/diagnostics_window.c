@@ -0,0 +1,142 @@
+// diagnostics_window.c : smartstrap bus counters, latencies and value ages, a page per two attributes
+
+#include "diagnostics_window.h"
+#include "bus_stats.h"
+#include "xadow.h"
+
+static Window *s_window;
+static TextLayer *s_text_layer;
+static AppTimer *s_timer;
+static int s_page = 0;
+static char s_text[320];
+
+static uint32_t now_ms(void)
+{
+	time_t sec;
+	uint16_t ms;
+	time_ms(&sec, &ms);
+	return (uint32_t)sec * 1000 + ms;
+}
+
+static int num_pages(void)
+{
+	return max(1, (bus_stats_count() + DIAGNOSTICS_PER_PAGE - 1) / DIAGNOSTICS_PER_PAGE);
+}
+
+static char *append_latency(char *output, char *end, uint8_t percent, uint16_t bound)
+{
+	if (!bound)
+	{
+		return output + snprintf(output, end - output, "%d%% -  ", percent);
+	}
+	if (bound == UINT16_MAX)
+	{
+		return output + snprintf(output, end - output, "%d%% >%d  ", percent,
+			BUS_LATENCY_FIRST << (BUS_LATENCY_BUCKETS - 2));
+	}
+	return output + snprintf(output, end - output, "%d%% <%d  ", percent, bound);
+}
+
+static void update_text(void)
+{
+	uint32_t now = now_ms();
+	uint32_t tenths = bus_stats_reads_per_window(now) * 10000 / BUS_RATE_WINDOW;
+	char *output = s_text;
+	char *end = s_text + sizeof(s_text);
+
+	output += snprintf(output, end - output, "%lu.%lu reads/s  %d/%d", tenths / 10, tenths % 10,
+		s_page + 1, num_pages());
+#if BUS_TRACE
+	output += snprintf(output, end - output, "  trace %d", bus_trace_count());
+#endif
+	for (int i = s_page * DIAGNOSTICS_PER_PAGE; i < (s_page + 1) * DIAGNOSTICS_PER_PAGE; i++)
+	{
+		const bus_attr_stats *stats = bus_stats_get(i);
+		if (!stats)
+		{
+			break;
+		}
+		output += snprintf(output, end - output, "\n%04x:%04x %lu rd %lu ok\nbusy %d  t/o %d  lost %d\n"
+			"uns %d  err %d  ", stats->service_id, stats->attr_id, stats->reads, stats->ok, stats->busy,
+			stats->timeouts, stats->lost, stats->unsupported, stats->errors);
+		if (stats->last_ok)
+		{
+			uint32_t age = (now - stats->last_ok) / 100;
+			output += snprintf(output, end - output, "age %lu.%lu s", age / 10, age % 10);
+		}
+		else
+		{
+			output += snprintf(output, end - output, "never read");
+		}
+		output += snprintf(output, end - output, "\n");
+		output = append_latency(output, end, 50, bus_stats_latency_percentile(stats, 50));
+		output = append_latency(output, end, 95, bus_stats_latency_percentile(stats, 95));
+		output += snprintf(output, end - output, "ms");
+	}
+	text_layer_set_text(s_text_layer, s_text);
+}
+
+static void refresh_timer_fired(void *context)
+{
+	s_timer = app_timer_register(DIAGNOSTICS_REFRESH, refresh_timer_fired, NULL);
+	update_text();
+}
+
+static void up_click_handler(ClickRecognizerRef recognizer, void *context)
+{
+	s_page = (s_page + num_pages() - 1) % num_pages();
+	update_text();
+}
+
+static void down_click_handler(ClickRecognizerRef recognizer, void *context)
+{
+	s_page = (s_page + 1) % num_pages();
+	update_text();
+}
+
+static void click_config_provider(void *context)
+{
+	window_single_click_subscribe(BUTTON_ID_UP, up_click_handler);
+	window_single_click_subscribe(BUTTON_ID_DOWN, down_click_handler);
+}
+
+static void window_load(Window *window)
+{
+	Layer *window_layer = window_get_root_layer(window);
+	GRect bounds = layer_get_bounds(window_layer);
+
+	s_text_layer = text_layer_create(GRect(2, 0, bounds.size.w - 4, bounds.size.h));
+	text_layer_set_font(s_text_layer, fonts_get_system_font(FONT_KEY_GOTHIC_14));
+	text_layer_set_text_color(s_text_layer, GColorBlack);
+	text_layer_set_background_color(s_text_layer, GColorClear);
+	text_layer_set_overflow_mode(s_text_layer, GTextOverflowModeWordWrap);
+	layer_add_child(window_layer, text_layer_get_layer(s_text_layer));
+
+	s_page = 0;
+	update_text();
+	s_timer = app_timer_register(DIAGNOSTICS_REFRESH, refresh_timer_fired, NULL);
+}
+
+static void window_unload(Window *window)
+{
+	app_timer_cancel(s_timer);
+	s_timer = NULL;
+	text_layer_destroy(s_text_layer);
+	window_destroy(window);
+	s_window = NULL;
+}
+
+void diagnostics_window_push(void)
+{
+	if (!s_window)
+	{
+		s_window = window_create();
+		window_set_background_color(s_window, GColorWhite);
+		window_set_click_config_provider(s_window, click_config_provider);
+		window_set_window_handlers(s_window, (WindowHandlers){
+			.load = window_load,
+			.unload = window_unload,
+		});
+	}
+	window_stack_push(s_window, true);
+}
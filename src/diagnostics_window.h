@@ -0,0 +1,10 @@
+// diagnostics_window.h : smartstrap bus counters, latencies and value ages, a page per two attributes
+
+#pragma once
+
+#include <pebble.h>
+
+#define DIAGNOSTICS_REFRESH     1000    //ms
+#define DIAGNOSTICS_PER_PAGE    2       //attributes
+
+void diagnostics_window_push(void);
@@ -9,8 +9,6 @@ static Window *s_diag_window;
 static TextLayer *s_label_layer;
 static BitmapLayer *s_icon_layer;
 static ActionBarLayer *s_action_bar_layer;
-static uint8_t resp_buffer[3];
-static SmartstrapAttribute *s_attr_bat_chg;
 
 static GBitmap *s_icon_bitmap, *s_tick_bitmap, *s_cross_bitmap;
 
@@ -0,0 +1,362 @@
+// fix_log.c : compressed in-memory ring of recorded gps fixes
+//
+// block layout:
+//   [0]      number of fixes in the block
+//   [1..18]  keyframe, the first fix as a packed gps_fix
+//   [19..]   one record per further fix: a flags byte, then only the fields named by the flags,
+//            each as the zigzag varint of its difference to the previous fix (fix and sat as
+//            plain bytes). A fix read exactly one second after the previous one with nothing
+//            changed is a single zero byte.
+
+#include "fix_log.h"
+
+#define FIX_BLOCK_HEADER  (1 + sizeof(gps_fix))
+#define FIX_RECORD_MAX    24    //flags, 5 byte varints for time, lat and lon, 3 for speed and alt, 2 status
+
+#define FIX_DT      0x01        //time difference other than one second
+#define FIX_POS     0x02        //lat and lon
+#define FIX_SPEED   0x04
+#define FIX_ALT     0x08
+#define FIX_STATUS  0x10        //fix quality and satellites
+
+static uint8_t s_blocks[FIX_LOG_BLOCKS][FIX_BLOCK_SIZE];
+static uint16_t s_first = 0;        //oldest block
+static uint16_t s_num_blocks = 0;
+static uint32_t s_dropped = 0;      //blocks dropped from the ring since it was cleared
+static uint16_t s_used = 0;         //bytes used in the newest block
+static bool s_open = false;         //whether fixes may still go into the newest block
+static uint32_t s_count = 0;
+static gps_fix s_last;
+static FixBlockSealedHandler s_sealed_handler;
+
+static uint32_t zigzag(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+	return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+	while (v >= 0x80)
+	{
+		*p++ = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+//differences are taken modulo 2^32, so that even a jump across the date line round-trips
+static uint8_t *put_delta(uint8_t *p, uint32_t value, uint32_t previous)
+{
+	return put_varint(p, zigzag((int32_t)(value - previous)));
+}
+
+static size_t encode_record(uint8_t *record, const gps_fix *prev, const gps_fix *fix)
+{
+	uint8_t *p = record + 1;
+	uint8_t flags = 0;
+
+	if (fix->time != prev->time + 1)
+	{
+		flags |= FIX_DT;
+		p = put_delta(p, fix->time, prev->time);
+	}
+	if (fix->lat != prev->lat || fix->lon != prev->lon)
+	{
+		flags |= FIX_POS;
+		p = put_delta(p, fix->lat, prev->lat);
+		p = put_delta(p, fix->lon, prev->lon);
+	}
+	if (fix->speed != prev->speed)
+	{
+		flags |= FIX_SPEED;
+		p = put_delta(p, fix->speed, prev->speed);
+	}
+	if (fix->alt != prev->alt)
+	{
+		flags |= FIX_ALT;
+		p = put_delta(p, fix->alt, prev->alt);
+	}
+	if (fix->fix != prev->fix || fix->sat != prev->sat)
+	{
+		flags |= FIX_STATUS;
+		*p++ = fix->fix;
+		*p++ = fix->sat;
+	}
+	record[0] = flags;
+	return p - record;
+}
+
+static uint8_t *newest_block(void)
+{
+	return s_blocks[(s_first + s_num_blocks - 1) % FIX_LOG_BLOCKS];
+}
+
+//makes room for one more block at the newest end, dropping the oldest if the ring is full
+static uint8_t *add_block(void)
+{
+	if (s_num_blocks == FIX_LOG_BLOCKS)
+	{
+		s_count -= s_blocks[s_first][0];
+		s_first = (s_first + 1) % FIX_LOG_BLOCKS;
+		s_num_blocks--;
+		s_dropped++;
+	}
+	s_num_blocks++;
+	return newest_block();
+}
+
+static void start_block(const gps_fix *fix)
+{
+	if (s_open && s_sealed_handler)
+	{
+		s_sealed_handler(newest_block());
+	}
+
+	uint8_t *block = add_block();
+	memset(block, 0, FIX_BLOCK_SIZE);
+	block[0] = 1;
+	memcpy(block + 1, fix, sizeof(gps_fix));
+	s_used = FIX_BLOCK_HEADER;
+	s_open = true;
+}
+
+void fix_log_set_sealed_handler(FixBlockSealedHandler handler)
+{
+	s_sealed_handler = handler;
+}
+
+//puts back a block written out earlier as the newest one, e.g. when resuming a recording;
+//further fixes are appended to an open block while it has room, a sealed one is left alone
+void fix_log_load_block(const uint8_t *block, bool open)
+{
+	fix_block_reader reader;
+	gps_fix fix;
+	uint8_t count = 0;
+
+	fix_block_reader_init(&reader, block);
+	while (fix_block_reader_next(&reader, &fix))
+	{
+		count++;
+	}
+	if (!count)
+	{
+		return;
+	}
+
+	uint8_t *slot = add_block();
+	memcpy(slot, block, FIX_BLOCK_SIZE);
+	slot[0] = count;
+	s_used = reader.offset;
+	s_last = reader.fix;
+	s_count += count;
+	s_open = open;
+}
+
+//the block the next fixes go into, NULL until there is one
+const uint8_t *fix_log_open_block(void)
+{
+	return s_open ? newest_block() : NULL;
+}
+
+void fix_log_clear(void)
+{
+	s_first = 0;
+	s_num_blocks = 0;
+	s_dropped = 0;
+	s_used = 0;
+	s_count = 0;
+	s_open = false;
+}
+
+void fix_log_append(const gps_fix *fix)
+{
+	uint8_t record[FIX_RECORD_MAX];
+	uint8_t *block = s_open ? newest_block() : NULL;
+
+	size_t length = block ? encode_record(record, &s_last, fix) : 0;
+	if (!block || block[0] == 0xff || s_used + length > FIX_BLOCK_SIZE)
+	{
+		start_block(fix);
+	}
+	else
+	{
+		memcpy(block + s_used, record, length);
+		s_used += length;
+		block[0]++;
+	}
+	s_last = *fix;
+	s_count++;
+}
+
+uint32_t fix_log_first_block(void)
+{
+	return s_dropped;
+}
+
+uint32_t fix_log_end_block(void)
+{
+	return s_dropped + s_num_blocks;
+}
+
+//NULL once the block has been dropped
+const uint8_t *fix_log_block(uint32_t number)
+{
+	if (number < s_dropped || number >= s_dropped + s_num_blocks)
+	{
+		return NULL;
+	}
+	return s_blocks[(s_first + number - s_dropped) % FIX_LOG_BLOCKS];
+}
+
+uint32_t fix_log_count(void)
+{
+	return s_count;
+}
+
+//bytes taken by the recorded fixes, the ring itself is always FIX_LOG_BLOCKS * FIX_BLOCK_SIZE
+size_t fix_log_size(void)
+{
+	return s_num_blocks ? (s_num_blocks - 1) * FIX_BLOCK_SIZE + s_used : 0;
+}
+
+void fix_log_iter_init(fix_log_iter *it)
+{
+	it->block = s_first;
+	it->blocks_left = s_num_blocks;
+	it->reader.left = 0;
+}
+
+bool fix_log_iter_next(fix_log_iter *it, gps_fix *fix)
+{
+	while (!fix_block_reader_next(&it->reader, fix))
+	{
+		if (!it->blocks_left)
+		{
+			return false;
+		}
+		fix_block_reader_init(&it->reader, s_blocks[it->block]);
+		it->block = (it->block + 1) % FIX_LOG_BLOCKS;
+		it->blocks_left--;
+	}
+	return true;
+}
+
+//time of the first fix in a block, 0 for an empty one
+uint32_t fix_block_start(const uint8_t *block)
+{
+	gps_fix keyframe;
+	if (!block[0])
+	{
+		return 0;
+	}
+	memcpy(&keyframe, block + 1, sizeof(keyframe));
+	return keyframe.time;
+}
+
+void fix_block_reader_init(fix_block_reader *reader, const uint8_t *block)
+{
+	reader->data = block;
+	reader->offset = 0;
+	reader->left = block[0];
+}
+
+static bool get_varint(fix_block_reader *reader, uint32_t *v)
+{
+	*v = 0;
+	for (int shift = 0; shift < 35 && reader->offset < FIX_BLOCK_SIZE; shift += 7)
+	{
+		uint8_t b = reader->data[reader->offset++];
+		*v |= (uint32_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool get_delta(fix_block_reader *reader, uint32_t *value)
+{
+	uint32_t v;
+	if (!get_varint(reader, &v))
+	{
+		return false;
+	}
+	*value += (uint32_t)unzigzag(v);
+	return true;
+}
+
+bool fix_block_reader_next(fix_block_reader *reader, gps_fix *fix)
+{
+	if (!reader->left)
+	{
+		return false;
+	}
+	reader->left--;
+
+	if (reader->offset == 0)
+	{
+		memcpy(&reader->fix, reader->data + 1, sizeof(gps_fix));
+		reader->offset = FIX_BLOCK_HEADER;
+		*fix = reader->fix;
+		return true;
+	}
+
+	if (reader->offset >= FIX_BLOCK_SIZE)
+	{
+		reader->left = 0;
+		return false;
+	}
+
+	gps_fix *f = &reader->fix;
+	uint32_t time = f->time + 1, lat = f->lat, lon = f->lon, speed = f->speed, alt = f->alt;
+	uint8_t flags = reader->data[reader->offset++];
+	bool ok = true;
+
+	if (flags & FIX_DT)
+	{
+		time = f->time;
+		ok = ok && get_delta(reader, &time);
+	}
+	if (flags & FIX_POS)
+	{
+		ok = ok && get_delta(reader, &lat) && get_delta(reader, &lon);
+	}
+	if (flags & FIX_SPEED)
+	{
+		ok = ok && get_delta(reader, &speed);
+	}
+	if (flags & FIX_ALT)
+	{
+		ok = ok && get_delta(reader, &alt);
+	}
+	if (flags & FIX_STATUS)
+	{
+		ok = ok && reader->offset + 2 <= FIX_BLOCK_SIZE;
+		if (ok)
+		{
+			f->fix = reader->data[reader->offset++];
+			f->sat = reader->data[reader->offset++];
+		}
+	}
+	if (!ok)
+	{
+		//truncated or corrupt block, nothing after this can be trusted
+		reader->left = 0;
+		return false;
+	}
+
+	f->time = time;
+	f->lat = (int32_t)lat;
+	f->lon = (int32_t)lon;
+	f->speed = (uint16_t)speed;
+	f->alt = (uint16_t)alt;
+	*fix = *f;
+	return true;
+}
@@ -0,0 +1,71 @@
+// fix_log.h : compressed in-memory ring of recorded gps fixes
+//
+// Fixes are packed into fixed size blocks. Every block starts with a full copy of its first fix
+// (the keyframe), later fixes only store what changed since the previous one as zigzag varint
+// deltas, so a fix taken while walking costs about 7 bytes and one taken while standing still a
+// single byte. Blocks are self-contained, a sealed block can be decoded or stored on its own.
+// When the ring is full the oldest block is dropped.
+
+#pragma once
+
+#include <pebble.h>
+
+#define FIX_BLOCK_SIZE  256   //bytes, also the largest value persist_write_data takes
+#define FIX_BLOCK_FIXES (FIX_BLOCK_SIZE - 18)   //at most: the keyframe, then a byte per fix
+
+#ifndef FIX_LOG_BLOCKS
+#define FIX_LOG_BLOCKS  16    //4 KB, roughly 500 fixes on the move and several thousand standing still
+#endif
+
+typedef struct __attribute__((__packed__)) gps_fix
+{
+	uint32_t time;      //s, watch clock when the fix was read
+	int32_t  lat;       //degrees * 10^7
+	int32_t  lon;
+	uint16_t speed;     //m/s * 100
+	uint16_t alt;       //m * 100
+	uint8_t  fix;       //nmea gga fix quality, 0 for none
+	uint8_t  sat;
+} gps_fix;
+
+//walks the fixes of a single block
+typedef struct fix_block_reader
+{
+	const uint8_t *data;
+	uint16_t       offset;
+	uint8_t        left;    //fixes not yet returned
+	gps_fix        fix;     //the one returned last
+} fix_block_reader;
+
+//walks the whole ring from the oldest fix to the newest, must not be kept across appends
+typedef struct fix_log_iter
+{
+	uint16_t         block;
+	uint16_t         blocks_left;
+	fix_block_reader reader;
+} fix_log_iter;
+
+//called with a block once no more fixes go into it, e.g. to store it
+typedef void (*FixBlockSealedHandler)(const uint8_t *block);
+
+void fix_log_set_sealed_handler(FixBlockSealedHandler handler);
+void fix_log_load_block(const uint8_t *block, bool open);
+const uint8_t *fix_log_open_block(void);
+
+//blocks by number, counting from the first one since the log was cleared, so that a number
+//stays valid while older blocks are dropped
+uint32_t fix_log_first_block(void);
+uint32_t fix_log_end_block(void);
+const uint8_t *fix_log_block(uint32_t number);
+
+void fix_log_clear(void);
+void fix_log_append(const gps_fix *fix);
+uint32_t fix_log_count(void);
+size_t fix_log_size(void);
+
+void fix_log_iter_init(fix_log_iter *it);
+bool fix_log_iter_next(fix_log_iter *it, gps_fix *fix);
+
+uint32_t fix_block_start(const uint8_t *block);
+void fix_block_reader_init(fix_block_reader *reader, const uint8_t *block);
+bool fix_block_reader_next(fix_block_reader *reader, gps_fix *fix);
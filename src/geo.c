@@ -0,0 +1,209 @@
+// geo.c : distance, bearing and pace between fixes, in integers
+
+#include "geo.h"
+
+#define DEGREES_E7_360    3600000000LL
+#define CM_PER_UNIT_Q16   72873     //1.11195 cm per 10^-7 degrees on a 6371 km sphere, * 2^16
+#define PI_NUM            355       //pi as 355/113, good to 10^-7
+#define PI_DEN            113
+
+uint32_t geo_isqrt(uint64_t v)
+{
+	uint64_t root = 0;
+	uint64_t bit;
+
+	if (!v)
+	{
+		return 0;
+	}
+	//the highest power of four not above v
+	bit = 1ULL << ((63 - __builtin_clzll(v)) & ~1);
+	while (bit)
+	{
+		if (v >= root + bit)
+		{
+			v -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)root;
+}
+
+uint32_t geo_units_to_cm(uint32_t units)
+{
+	return (uint32_t)(((uint64_t)units * CM_PER_UNIT_Q16 + (1 << 15)) >> 16);
+}
+
+//the lookups take whole trig angles, 0.0055 degrees apart; interpolating between two of them
+//keeps that step out of every distance measured in the frame
+static int32_t interpolated_lookup(int32_t (*lookup)(int32_t), int32_t lat)
+{
+	int64_t angle = ((int64_t)lat << 32) / DEGREES_E7_360;   //trig angle * 2^16
+	int32_t whole = (int32_t)(angle >> 16);
+	int32_t fraction = (int32_t)(angle & 0xffff);
+	int32_t lo = lookup(whole), hi = lookup(whole + 1);
+	return lo + (int32_t)(((int64_t)(hi - lo) * fraction) >> 16);
+}
+
+void geo_frame_init(geo_frame *frame, geo_point origin)
+{
+	frame->origin = origin;
+	frame->cos_lat = interpolated_lookup(cos_lookup, origin.lat);
+	frame->sin_lat = interpolated_lookup(sin_lookup, origin.lat);
+}
+
+//cosine of a latitude near the origin, cos(a + d) = cos a - d sin a to first order
+static int32_t frame_cos(const geo_frame *frame, int32_t lat)
+{
+	int64_t d = (int64_t)lat - frame->origin.lat;
+	return frame->cos_lat - (int32_t)((int64_t)frame->sin_lat * d * PI_NUM / (PI_DEN * (DEGREES_E7_360 / 2)));
+}
+
+static int64_t wrap_lon(int64_t dlon)
+{
+	//the short way round across the date line
+	if (dlon > DEGREES_E7_360 / 2)
+	{
+		return dlon - DEGREES_E7_360;
+	}
+	if (dlon < -DEGREES_E7_360 / 2)
+	{
+		return dlon + DEGREES_E7_360;
+	}
+	return dlon;
+}
+
+//east and north from one point to another, scaled at their mean latitude
+static bool frame_offset(const geo_frame *frame, geo_point from, geo_point to, int32_t *east, int32_t *north)
+{
+	int64_t dlat = (int64_t)to.lat - from.lat;
+	int64_t dlon = wrap_lon((int64_t)to.lon - from.lon);
+
+	dlon = dlon * frame_cos(frame, (int32_t)(((int64_t)from.lat + to.lat) / 2)) / TRIG_MAX_RATIO;
+	if (dlon <= -GEO_MAX_SPAN || dlon >= GEO_MAX_SPAN || dlat <= -GEO_MAX_SPAN || dlat >= GEO_MAX_SPAN)
+	{
+		return false;
+	}
+	*east = (int32_t)dlon;
+	*north = (int32_t)dlat;
+	return true;
+}
+
+//whether the frame's cosine is still good enough for the point
+bool geo_frame_near(const geo_frame *frame, geo_point point)
+{
+	int32_t dlat = point.lat - frame->origin.lat;
+	return dlat > -GEO_FRAME_REFRESH && dlat < GEO_FRAME_REFRESH;
+}
+
+//position relative to the frame origin, false when too far away to compare
+bool geo_project(const geo_frame *frame, geo_point point, int32_t *x, int32_t *y)
+{
+	int64_t dlon = wrap_lon((int64_t)point.lon - frame->origin.lon);
+	int64_t dlat = (int64_t)point.lat - frame->origin.lat;
+
+	dlon = dlon * frame->cos_lat / TRIG_MAX_RATIO;
+	if (dlon <= -GEO_MAX_SPAN || dlon >= GEO_MAX_SPAN || dlat <= -GEO_MAX_SPAN || dlat >= GEO_MAX_SPAN)
+	{
+		return false;
+	}
+	*x = (int32_t)dlon;
+	*y = (int32_t)dlat;
+	return true;
+}
+
+//cm, UINT32_MAX when the points are too far apart to compare
+uint32_t geo_distance(const geo_frame *frame, geo_point from, geo_point to)
+{
+	int32_t east, north;
+
+	if (!frame_offset(frame, from, to, &east, &north))
+	{
+		return UINT32_MAX;
+	}
+	return geo_units_to_cm(geo_isqrt((int64_t)east * east + (int64_t)north * north));
+}
+
+//clockwise from north, TRIG_MAX_ANGLE is a full turn; -1 when the points can't be compared
+int32_t geo_bearing(const geo_frame *frame, geo_point from, geo_point to)
+{
+	int32_t east, north;
+
+	if (!frame_offset(frame, from, to, &east, &north))
+	{
+		return -1;
+	}
+	//atan2_lookup takes 16 bit values, drop the same number of bits from both
+	while (east > INT16_MAX || east < -INT16_MAX || north > INT16_MAX || north < -INT16_MAX)
+	{
+		east /= 2;
+		north /= 2;
+	}
+	return (atan2_lookup((int16_t)east, (int16_t)north) + TRIG_MAX_ANGLE) % TRIG_MAX_ANGLE;
+}
+
+void geo_odometer_reset(geo_odometer *odometer)
+{
+	memset(odometer, 0, sizeof(*odometer));
+}
+
+void geo_odometer_add(geo_odometer *odometer, uint32_t time, geo_point point)
+{
+	if (!odometer->started || !geo_frame_near(&odometer->frame, point))
+	{
+		geo_frame_init(&odometer->frame, point);
+	}
+	if (!odometer->started)
+	{
+		odometer->started = true;
+		odometer->last = point;
+	}
+
+	uint32_t step = geo_distance(&odometer->frame, odometer->last, point);
+	if (step == UINT32_MAX)
+	{
+		//a jump no walker makes, start over from here
+		odometer->last = point;
+	}
+	else if (step >= GEO_MIN_STEP)
+	{
+		odometer->distance += step;
+		odometer->last = point;
+	}
+	odometer->last_time = time;
+
+	uint8_t newest = (odometer->next_sample + GEO_PACE_SAMPLES - 1) % GEO_PACE_SAMPLES;
+	if (!odometer->samples || time - odometer->sample_time[newest] >= GEO_PACE_PERIOD)
+	{
+		odometer->sample_time[odometer->next_sample] = time;
+		odometer->sample_distance[odometer->next_sample] = odometer->distance;
+		odometer->next_sample = (odometer->next_sample + 1) % GEO_PACE_SAMPLES;
+		if (odometer->samples < GEO_PACE_SAMPLES)
+		{
+			odometer->samples++;
+		}
+	}
+}
+
+//s per km over the last half minute or so, 0 while standing still
+uint32_t geo_odometer_pace(const geo_odometer *odometer)
+{
+	if (!odometer->samples)
+	{
+		return 0;
+	}
+	uint8_t oldest = (odometer->next_sample + GEO_PACE_SAMPLES - odometer->samples) % GEO_PACE_SAMPLES;
+	uint32_t distance = odometer->distance - odometer->sample_distance[oldest];
+	uint32_t time = odometer->last_time - odometer->sample_time[oldest];
+
+	if (distance < 2 * GEO_MIN_STEP)
+	{
+		return 0;
+	}
+	return (uint32_t)((uint64_t)time * 100000 / distance);
+}
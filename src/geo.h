@@ -0,0 +1,66 @@
+// geo.h : distance, bearing and pace between fixes, in integers
+//
+// Positions are the receiver's lat/lon in 10^-7 degrees. They are projected onto a flat frame
+// around a nearby origin (a local equirectangular projection): y is the latitude difference, x
+// the longitude difference scaled by the cosine of the origin's latitude, both in units of 10^-7
+// degrees of latitude, about 1.1 cm. The cosine comes from cos_lookup once per frame, after that
+// a distance is a few multiplications and an integer square root.
+//
+// Error against a double precision haversine on the same sphere, measured by host/bench.c over
+// hops of 1 m to 10 km with both ends within GEO_FRAME_REFRESH of the frame origin:
+//   distance  within 0.006% + 2 cm below 45 degrees latitude, 0.011% + 2 cm below 70
+//   bearing   within 0.07 degrees below 45, 0.13 below 70, for hops longer than 10 m; most of
+//             that is the straight line on the map against the great circle on long hops
+// The sphere itself is off the WGS84 ellipsoid by up to 0.5%, which no receiver track notices.
+
+#pragma once
+
+#include <pebble.h>
+
+#define GEO_UNITS_PER_METRE   90        //10^-7 degrees of latitude, rounded
+#define GEO_MAX_SPAN          (1 << 24) //units, about 186 km, keeps squared distances in 64 bits
+#define GEO_FRAME_REFRESH     100000    //units of latitude (1.1 km) before the cosine is looked up again
+
+#define GEO_MIN_STEP          500       //cm, smaller moves are taken as receiver noise
+#define GEO_PACE_SAMPLES      8
+#define GEO_PACE_PERIOD       4         //s between pace samples, pace covers about half a minute
+
+typedef struct geo_point
+{
+	int32_t lat;      //degrees * 10^7
+	int32_t lon;
+} geo_point;
+
+typedef struct geo_frame
+{
+	geo_point origin;
+	int32_t   cos_lat;  //TRIG_MAX_RATIO is 1
+	int32_t   sin_lat;
+} geo_frame;
+
+//distance covered along a track and the recent pace
+typedef struct geo_odometer
+{
+	geo_frame frame;
+	bool      started;
+	geo_point last;     //the last point counted
+	uint32_t  last_time;
+	uint32_t  distance; //cm
+	uint32_t  sample_time[GEO_PACE_SAMPLES];
+	uint32_t  sample_distance[GEO_PACE_SAMPLES];
+	uint8_t   samples;
+	uint8_t   next_sample;
+} geo_odometer;
+
+uint32_t geo_isqrt(uint64_t v);
+uint32_t geo_units_to_cm(uint32_t units);
+
+void geo_frame_init(geo_frame *frame, geo_point origin);
+bool geo_frame_near(const geo_frame *frame, geo_point point);
+bool geo_project(const geo_frame *frame, geo_point point, int32_t *x, int32_t *y);
+uint32_t geo_distance(const geo_frame *frame, geo_point from, geo_point to);
+int32_t geo_bearing(const geo_frame *frame, geo_point from, geo_point to);
+
+void geo_odometer_reset(geo_odometer *odometer);
+void geo_odometer_add(geo_odometer *odometer, uint32_t time, geo_point point);
+uint32_t geo_odometer_pace(const geo_odometer *odometer);
@@ -0,0 +1,104 @@
+// health_cache.c : today's steps, the daily goal and the typical day, without whole-day queries
+
+#include "health_cache.h"
+#include "xadow.h"
+
+#define BUCKET_SECONDS  (HEALTH_BUCKET_MINUTES * SECONDS_PER_MINUTE)
+#define UNKNOWN         -1
+
+static struct
+{
+	time_t   day;               //start of the day the cache is for, 0 before the first update
+	int32_t  goal;
+	int32_t  settled;           //steps from the start of the day to settled_until
+	time_t   settled_until;     //a whole minute
+	int32_t  steps;             //settled plus the steps since
+	int32_t  typical[HEALTH_BUCKETS];   //typical steps from the start of the day to the end of each bucket
+	uint32_t queries;
+} s_cache;
+
+static HealthValue sum(time_t start, time_t end)
+{
+	s_cache.queries++;
+	return health_service_sum(HealthMetricStepCount, start, end);
+}
+
+static HealthValue sum_averaged(time_t start, time_t end)
+{
+	s_cache.queries++;
+	return health_service_sum_averaged(HealthMetricStepCount, start, end, HealthServiceTimeScopeDaily);
+}
+
+static void start_day(time_t day, time_t now)
+{
+	s_cache.day = day;
+	s_cache.goal = sum_averaged(day, day + SECONDS_PER_DAY);
+	for (int i = 0; i < HEALTH_BUCKETS; i++)
+	{
+		s_cache.typical[i] = UNKNOWN;
+	}
+	s_cache.settled_until = now - now % SECONDS_PER_MINUTE;
+	s_cache.settled = sum(day, s_cache.settled_until);
+}
+
+//typical steps from the start of the day to the end of a bucket
+static int32_t typical(int bucket)
+{
+	if (bucket < 0)
+	{
+		return 0;
+	}
+	if (s_cache.typical[bucket] == UNKNOWN)
+	{
+		s_cache.typical[bucket] = sum_averaged(s_cache.day, s_cache.day + (bucket + 1) * BUCKET_SECONDS);
+	}
+	return s_cache.typical[bucket];
+}
+
+void health_cache_update(bool significant)
+{
+	time_t now = time(NULL);
+	time_t day = time_start_of_today();
+
+	if (significant || day != s_cache.day)
+	{
+		start_day(day, now);
+	}
+
+	//the minutes since the settled count are summed as one range with the current one, and only
+	//added to the settled count once they make up a bucket, so an event costs one short query
+	time_t minute = now - now % SECONDS_PER_MINUTE;
+	if (minute - s_cache.settled_until >= BUCKET_SECONDS)
+	{
+		s_cache.settled += sum(s_cache.settled_until, minute);
+		s_cache.settled_until = minute;
+	}
+	s_cache.steps = s_cache.settled + (now > s_cache.settled_until ? sum(s_cache.settled_until, now) : 0);
+}
+
+int health_cache_steps(void)
+{
+	return s_cache.steps;
+}
+
+int health_cache_goal(void)
+{
+	return s_cache.goal;
+}
+
+//typical steps by this time of the day
+int health_cache_average(void)
+{
+	time_t elapsed = time(NULL) - s_cache.day;
+	int bucket = min(elapsed / BUCKET_SECONDS, HEALTH_BUCKETS - 1);
+	int32_t before = typical(bucket - 1);
+	int32_t after = typical(bucket);
+
+	return before + (after - before) * (elapsed - bucket * BUCKET_SECONDS) / BUCKET_SECONDS;
+}
+
+//aggregate queries asked of the firmware so far
+uint32_t health_cache_queries(void)
+{
+	return s_cache.queries;
+}
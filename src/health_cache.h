@@ -0,0 +1,22 @@
+// health_cache.h : today's steps, the daily goal and the typical day, without whole-day queries
+//
+// The firmware's aggregate queries cost more the longer the range they sum. Health events don't
+// say how many steps were taken, so one query per event can't be avoided; the cache makes it a
+// short one. It keeps today's steps up to a settled minute and on a health event sums only the
+// minutes since then, at most a bucket's worth; once they make up a whole bucket they are settled
+// with a second query. The goal is asked for once a day, and the typical day is filled in bucket
+// by bucket as the day goes on and interpolated within a bucket. A significant update, or a new
+// day, starts over from a full query.
+
+#pragma once
+
+#include <pebble.h>
+
+#define HEALTH_BUCKET_MINUTES   15
+#define HEALTH_BUCKETS          (24 * 60 / HEALTH_BUCKET_MINUTES)
+
+void health_cache_update(bool significant);
+int health_cache_steps(void);
+int health_cache_goal(void);
+int health_cache_average(void);
+uint32_t health_cache_queries(void);
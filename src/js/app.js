@@ -0,0 +1,182 @@
+// app.js : fetches the recorded track from the watch and builds a gpx file from it
+//
+// The watch sends its fix log blocks as they are (see src/fix_log.c): a fix count, a 18 byte
+// keyframe, then one record per fix with a flags byte and zigzag varint deltas, and alongside
+// them the steps since the previous fix and the cadence of each fix, 3 bytes a fix, when the
+// watch counts steps (see src/track_fusion.h). Messages are
+// numbered; only the next one in order is taken, and every message is answered with the number
+// taken so far, which tells the watch where to carry on.
+//
+// The track is kept in localStorage as one point per line, the newest MAX_POINTS of them; older
+// points are dropped as new ones come in, so storage stays bounded however long the watch records.
+
+var BLOCK_SIZE = 256;
+var REQUEST_RETRY = 5000;   // ms without an answer before asking again
+var REQUEST_ATTEMPTS = 5;   // before waiting for the next time the app starts
+var MAX_POINTS = 5000;      // about a megabyte of gpx
+
+var FUSED_SIZE = 3, FUSION_UNKNOWN = 0xff;
+var FIX_DT = 0x01, FIX_POS = 0x02, FIX_SPEED = 0x04, FIX_ALT = 0x08, FIX_STATUS = 0x10;
+
+var transfer = null;
+
+function u16(b, o) { return b[o] | (b[o + 1] << 8); }
+function u32(b, o) { return (b[o] | (b[o + 1] << 8) | (b[o + 2] << 16) | (b[o + 3] << 24)) >>> 0; }
+function s32(b, o) { return u32(b, o) | 0; }
+
+// calls onFix for every fix of a block, fields as in struct gps_fix
+function decodeBlock(b, start, onFix) {
+  var count = b[start];
+  if (!count) {
+    return;
+  }
+  var k = start + 1;
+  var fix = {
+    time: u32(b, k), lat: s32(b, k + 4), lon: s32(b, k + 8),
+    speed: u16(b, k + 12), alt: u16(b, k + 14), fix: b[k + 16], sat: b[k + 17]
+  };
+  var o = start + 19, end = start + BLOCK_SIZE;
+  onFix(fix);
+
+  function varint() {
+    var v = 0, shift = 0, byte;
+    do {
+      if (o >= end) {
+        throw new Error('truncated block');
+      }
+      byte = b[o++];
+      v += (byte & 0x7f) * Math.pow(2, shift);
+      shift += 7;
+    } while (byte & 0x80);
+    return v;
+  }
+  function delta(previous, bits) {
+    var v = varint();
+    var d = v % 2 ? -(v + 1) / 2 : v / 2;
+    return bits === 32 ? (previous + d) | 0 : (previous + d) & 0xffff;
+  }
+
+  for (var i = 1; i < count; i++) {
+    var flags = b[o++];
+    var next = {
+      time: fix.time + 1, lat: fix.lat, lon: fix.lon,
+      speed: fix.speed, alt: fix.alt, fix: fix.fix, sat: fix.sat
+    };
+    if (flags & FIX_DT) { next.time = delta(fix.time, 32) >>> 0; }
+    if (flags & FIX_POS) { next.lat = delta(fix.lat, 32); next.lon = delta(fix.lon, 32); }
+    if (flags & FIX_SPEED) { next.speed = delta(fix.speed, 16); }
+    if (flags & FIX_ALT) { next.alt = delta(fix.alt, 16); }
+    if (flags & FIX_STATUS) { next.fix = b[o++]; next.sat = b[o++]; }
+    fix = next;
+    onFix(fix);
+  }
+}
+
+function trackPoint(fix) {
+  var kind = { 2: 'dgps', 3: 'pps' }[fix.fix] || '3d';
+  return '<trkpt lat="' + (fix.lat / 1e7).toFixed(7) + '" lon="' + (fix.lon / 1e7).toFixed(7) + '">' +
+    '<ele>' + (fix.alt / 100).toFixed(2) + '</ele>' +
+    '<time>' + new Date(fix.time * 1000).toISOString().replace('.000', '') + '</time>' +
+    '<fix>' + kind + '</fix><sat>' + fix.sat + '</sat>' + extensions(fix) + '</trkpt>';
+}
+
+// cadence in steps per minute as garmin's track point extension has it, and the steps since
+// the previous point
+function extensions(fix) {
+  if (fix.cadence === undefined) {
+    return '';
+  }
+  return '<extensions><gpxtpx:TrackPointExtension><gpxtpx:cad>' + fix.cadence +
+    '</gpxtpx:cad></gpxtpx:TrackPointExtension><zen:steps>' + fix.steps + '</zen:steps></extensions>';
+}
+
+function gpx(points) {
+  return '<?xml version="1.0" encoding="UTF-8"?>\n' +
+    '<gpx version="1.1" creator="Zen Smart Tracker" xmlns="http://www.topografix.com/GPX/1/1"' +
+    ' xmlns:gpxtpx="http://www.garmin.com/xmlschemas/TrackPointExtension/v1"' +
+    ' xmlns:zen="urn:zen-smart-tracker:gpx:1">\n' +
+    '<trk><name>Zen Smart Tracker</name><trkseg>\n' + points + '</trkseg></trk>\n</gpx>\n';
+}
+
+function send(message) {
+  Pebble.sendAppMessage(message, null, function(e) {
+    console.log('Sending ' + JSON.stringify(message) + ' failed: ' + JSON.stringify(e));
+  });
+}
+
+function requestExport(attempt) {
+  var since = parseInt(localStorage.getItem('since') || '0', 10);
+  transfer = { expected: 0, messages: -1, since: since, points: [], started: Date.now() };
+  send({ ExportRequest: since });
+  setTimeout(function() {
+    // the request or the first answer got lost
+    if (transfer && transfer.expected === 0) {
+      if (attempt < REQUEST_ATTEMPTS) {
+        requestExport(attempt + 1);
+      } else {
+        console.log('Export: the watch did not answer');
+        transfer = null;
+      }
+    }
+  }, REQUEST_RETRY);
+}
+
+// the stored points followed by the new ones, the oldest dropped beyond MAX_POINTS
+function keepPoints(stored, points) {
+  var lines = (stored ? stored.split('\n').slice(0, -1) : []).concat(points.map(function(point) {
+    return point.replace(/\n$/, '');
+  }));
+  if (lines.length > MAX_POINTS) {
+    console.log('Export: dropping the ' + (lines.length - MAX_POINTS) + ' oldest points');
+    lines = lines.slice(lines.length - MAX_POINTS);
+  }
+  return lines.length ? lines.join('\n') + '\n' : '';
+}
+
+function finishExport() {
+  var points = keepPoints(localStorage.getItem('track.points'), transfer.points);
+  var seconds = (Date.now() - transfer.started) / 1000;
+  localStorage.setItem('track.points', points);
+  localStorage.setItem('track.gpx', gpx(points));
+  localStorage.setItem('since', String(transfer.since));
+  console.log('Export: ' + transfer.points.length + ' fixes in ' + seconds.toFixed(1) + ' s (' +
+    Math.round(transfer.points.length / Math.max(seconds, 0.001)) + ' fixes/s)');
+  transfer = null;
+}
+
+Pebble.addEventListener('ready', function() {
+  requestExport(1);
+});
+
+Pebble.addEventListener('appmessage', function(e) {
+  var p = e.payload;
+  if (!transfer || p.ExportSeq === undefined) {
+    return;
+  }
+  if (p.ExportSeq === transfer.expected) {
+    if (p.ExportSeq === 0) {
+      transfer.messages = p.ExportCount;
+    }
+    var data = p.ExportData || [];
+    var steps = p.ExportSteps || [];
+    var index = 0;
+    for (var start = 0; start + BLOCK_SIZE <= data.length; start += BLOCK_SIZE) {
+      decodeBlock(data, start, function(fix) {
+        var o = FUSED_SIZE * index++;
+        if (o + FUSED_SIZE <= steps.length && steps[o + 2] !== FUSION_UNKNOWN) {
+          fix.steps = u16(steps, o);
+          fix.cadence = steps[o + 2];
+        }
+        if (fix.time > transfer.since) {
+          transfer.since = fix.time;
+          transfer.points.push(trackPoint(fix) + '\n');
+        }
+      });
+    }
+    transfer.expected++;
+  }
+  send({ ExportAck: transfer.expected });
+  if (transfer.expected === transfer.messages + 1) {
+    finishExport();
+  }
+});
@@ -0,0 +1,187 @@
+// kalman.c : smooths the receiver's position, speed and altitude with a kalman filter, in integers
+
+#include "kalman.h"
+
+#define GAIN_SHIFT          16
+#define MAX_VARIANCE        (1 << 30)
+#define START_CLIMB         100       //cm/s, standard deviation of the vertical velocity at the start
+#define DEGREES_E7_180      1800000000LL
+#define DEFAULT_NOISE       400       //cm, for fix qualities not in the table
+
+//cm, standard deviation of a fix's position by its nmea gga fix quality, at an hdop of 1
+static const uint16_t s_fix_noise[] = {
+	[1] = 400,    //gps
+	[2] = 200,    //differential
+	[3] = 400,    //pps
+	[4] = 5,      //rtk fixed
+	[5] = 50,     //rtk float
+	[6] = 1500,   //dead reckoning
+	[7] = 1500,   //entered by hand
+	[8] = 400,    //simulated
+};
+
+static int32_t clamp_variance(int64_t value, int32_t low)
+{
+	return (int32_t)(value < low ? low : value > MAX_VARIANCE ? MAX_VARIANCE : value);
+}
+
+//value / 2^shift, rounded
+static int32_t scale_down(int64_t value, int shift)
+{
+	return (int32_t)((value + ((int64_t)1 << (shift - 1))) >> shift);
+}
+
+//cm^2, a fix's position variance: the receiver's hdop spreads it, or without one, fewer
+//satellites in use do. The variance goes with the hdop rather than its square: most of the wander
+//is slow drift, which trusting a bad fix less doesn't average out, it only makes the filter lag.
+static int32_t fix_variance(const gps_fix *fix, uint16_t hdop)
+{
+	int32_t noise = fix->fix < ARRAY_LENGTH(s_fix_noise) && s_fix_noise[fix->fix] ? s_fix_noise[fix->fix] : DEFAULT_NOISE;
+	int32_t sat = fix->sat ? fix->sat : KALMAN_SAT_REF;
+
+	if (hdop)
+	{
+		return clamp_variance((int64_t)noise * noise * hdop / 100, 1);
+	}
+	return clamp_variance((int64_t)noise * noise * KALMAN_SAT_REF / sat, 1);
+}
+
+//the horizontal variance in units^2, the vertical one in cm^2 with the receiver's height about
+//one and a half times as far off as its position
+static int32_t horizontal_variance(int32_t cm2)
+{
+	return clamp_variance((int64_t)cm2 * GEO_UNITS_PER_METRE * GEO_UNITS_PER_METRE / 10000, 1);
+}
+
+static int32_t vertical_variance(int32_t cm2)
+{
+	return clamp_variance((int64_t)cm2 * 9 / 4, 1);
+}
+
+static void start(kalman_filter *filter, const gps_fix *fix, uint16_t hdop)
+{
+	int32_t variance = fix_variance(fix, hdop);
+
+	filter->started = true;
+	filter->time = fix->time;
+	filter->position = (geo_point){ fix->lat, fix->lon };
+	filter->alt = fix->alt;
+	filter->v_east = filter->v_north = filter->v_up = 0;
+	filter->horizontal = (kalman_covariance){ horizontal_variance(variance), 0,
+		KALMAN_START_SPEED * KALMAN_START_SPEED };
+	filter->vertical = (kalman_covariance){ vertical_variance(variance), 0, START_CLIMB * START_CLIMB };
+	geo_frame_init(&filter->frame, filter->position);
+}
+
+//the uncertainty dt seconds on, for a walker whose acceleration is white noise of density q
+static void predict(kalman_covariance *c, int32_t dt, int32_t q)
+{
+	int64_t dt2 = (int64_t)dt * dt;
+	int64_t pp = c->pp + dt * (2 * (int64_t)c->pv + dt * (int64_t)c->vv) + q * dt2 * dt / 3;
+	int64_t pv = c->pv + dt * (int64_t)c->vv + q * dt2 / 2;
+	int64_t vv = c->vv + (int64_t)q * dt;
+
+	c->pp = clamp_variance(pp, 1);
+	c->pv = clamp_variance(pv, -MAX_VARIANCE);
+	c->vv = clamp_variance(vv, 1);
+}
+
+//takes in a measurement of variance r, the gains of the position and the velocity (in 1/s) are
+//returned scaled by 2^GAIN_SHIFT
+static void correct(kalman_covariance *c, int32_t r, int32_t *gain_p, int32_t *gain_v)
+{
+	int64_t s = (int64_t)c->pp + r;
+	int64_t pv = c->pv;
+
+	*gain_p = (int32_t)(((int64_t)c->pp << GAIN_SHIFT) / s);
+	*gain_v = (int32_t)((pv << GAIN_SHIFT) / s);
+	c->pp = clamp_variance((int64_t)c->pp * r / s, 1);
+	c->pv = (int32_t)(pv * r / s);
+	c->vv = clamp_variance(c->vv - pv * pv / s, 1);
+}
+
+//moves the position by east and north units of the frame
+static void move(kalman_filter *filter, int32_t east, int32_t north)
+{
+	int32_t cos_lat = filter->frame.cos_lat > 0 ? filter->frame.cos_lat : 1;
+	int64_t lon = filter->position.lon + (int64_t)east * TRIG_MAX_RATIO / cos_lat;
+
+	//the short way round across the date line
+	if (lon > DEGREES_E7_180)
+	{
+		lon -= 2 * DEGREES_E7_180;
+	}
+	else if (lon < -DEGREES_E7_180)
+	{
+		lon += 2 * DEGREES_E7_180;
+	}
+	filter->position.lat += north;
+	filter->position.lon = (int32_t)lon;
+}
+
+void kalman_reset(kalman_filter *filter)
+{
+	memset(filter, 0, sizeof(*filter));
+}
+
+//takes in a fix and replaces its position, speed and altitude with the filtered ones, hdop is
+//the receiver's in 1/100, 0 when it gives none
+void kalman_add(kalman_filter *filter, gps_fix *fix, uint16_t hdop)
+{
+	uint32_t dt = fix->time - filter->time;
+	int32_t mx, my, px, py;
+
+	if (!fix->fix)
+	{
+		return;
+	}
+	filter->fixes++;
+	if (!filter->started || dt > KALMAN_MAX_GAP)
+	{
+		filter->restarts += filter->started;
+		start(filter, fix, hdop);
+		return;
+	}
+
+	if (dt)
+	{
+		predict(&filter->horizontal, dt, KALMAN_ACCEL_H);
+		predict(&filter->vertical, dt, KALMAN_ACCEL_V);
+		move(filter, scale_down((int64_t)filter->v_east * dt, KALMAN_V_SHIFT),
+			scale_down((int64_t)filter->v_north * dt, KALMAN_V_SHIFT));
+		filter->alt += scale_down((int64_t)filter->v_up * dt, KALMAN_V_SHIFT);
+	}
+	if (!geo_frame_near(&filter->frame, filter->position))
+	{
+		geo_frame_init(&filter->frame, filter->position);
+	}
+	if (!geo_project(&filter->frame, (geo_point){ fix->lat, fix->lon }, &mx, &my) ||
+		!geo_project(&filter->frame, filter->position, &px, &py))
+	{
+		//a jump no walker makes, start over from here
+		filter->restarts++;
+		start(filter, fix, hdop);
+		return;
+	}
+	filter->time = fix->time;
+
+	int32_t variance = fix_variance(fix, hdop);
+	int32_t gain_p, gain_v;
+	int32_t east = mx - px, north = my - py, up = (int32_t)fix->alt - filter->alt;
+
+	correct(&filter->horizontal, horizontal_variance(variance), &gain_p, &gain_v);
+	move(filter, scale_down((int64_t)gain_p * east, GAIN_SHIFT), scale_down((int64_t)gain_p * north, GAIN_SHIFT));
+	filter->v_east += scale_down((int64_t)gain_v * east, GAIN_SHIFT - KALMAN_V_SHIFT);
+	filter->v_north += scale_down((int64_t)gain_v * north, GAIN_SHIFT - KALMAN_V_SHIFT);
+
+	correct(&filter->vertical, vertical_variance(variance), &gain_p, &gain_v);
+	filter->alt += scale_down((int64_t)gain_p * up, GAIN_SHIFT);
+	filter->v_up += scale_down((int64_t)gain_v * up, GAIN_SHIFT - KALMAN_V_SHIFT);
+
+	uint32_t v = geo_isqrt((int64_t)filter->v_east * filter->v_east + (int64_t)filter->v_north * filter->v_north);
+	int32_t speed = scale_down(geo_units_to_cm(v), KALMAN_V_SHIFT);
+	fix->lat = filter->position.lat;
+	fix->lon = filter->position.lon;
+	fix->alt = (uint16_t)(filter->alt < 0 ? 0 : filter->alt > UINT16_MAX ? UINT16_MAX : filter->alt);
+	fix->speed = (uint16_t)(speed > UINT16_MAX ? UINT16_MAX : speed);
+}
@@ -0,0 +1,63 @@
+// kalman.h : smooths the receiver's position, speed and altitude with a kalman filter, in integers
+//
+// A constant velocity model: between fixes the walker keeps going the way the filter thinks it
+// was going, and how far off that may be grows with the time since the last fix. Each fix then
+// pulls the estimate towards itself by how much it is trusted, which is set by its fix quality
+// and the receiver's hdop, or the satellites in use where the receiver gives no hdop. The three
+// axes, east, north and up, are filtered on their own. East and north share their noise, so they
+// share their covariance too, and a fix costs the same couple of dozen multiplications whatever
+// came before it.
+//
+// East and north are in the units of geo.h, 10^-7 degrees of latitude, up is in cm; velocities
+// are kept with KALMAN_V_SHIFT bits of fraction. Speed is the length of the filtered velocity,
+// which the receiver's own speed doesn't go into. A gap of more than KALMAN_MAX_GAP between
+// fixes, or a jump the frame can't hold, starts the filter over from the fix.
+//
+// Against an hour's walk at 1 Hz with a receiver wandering 2 m times its hdop, replayed by
+// host/bench.c, the filter takes the distance from 9% over to 2% over, and the elevation gain from
+// eleven times the real one to 56% over. The position error only goes from 2.48 m rms to 2.39 m,
+// as most of the wander is slow drift, which looks just like walking, and the speed error gets
+// worse, 0.17 m/s rms for the receiver's own speed against 0.19 for the filtered velocity.
+// Trusting a fix by its hdop rather than by the satellites alone takes the climb from 59% over to
+// 56% and leaves the distance, the position and the speed error where they were, each within
+// 0.01 of the satellites-only figure.
+
+#pragma once
+
+#include <pebble.h>
+#include "fix_log.h"
+#include "geo.h"
+
+#define KALMAN_V_SHIFT      8         //fraction bits of the velocities
+#define KALMAN_MAX_GAP      10        //s between fixes after which the filter starts over
+#define KALMAN_ACCEL_H      1000      //units^2/s^3, spectral density of horizontal acceleration, ~0.35 m/s^2
+#define KALMAN_ACCEL_V      25        //cm^2/s^3, vertical, ~0.05 m/s^2
+#define KALMAN_SAT_REF      8         //satellites in use at which a fix without hdop has its base noise
+#define KALMAN_START_SPEED  450       //units/s, standard deviation of the velocity at the start, 5 m/s
+
+//variances of one axis' position and velocity, and their covariance
+typedef struct kalman_covariance
+{
+	int32_t pp;
+	int32_t pv;
+	int32_t vv;
+} kalman_covariance;
+
+typedef struct kalman_filter
+{
+	bool              started;
+	uint32_t          time;       //s, of the last fix
+	geo_frame         frame;
+	geo_point         position;
+	int32_t           alt;        //cm
+	int32_t           v_east;     //units/s << KALMAN_V_SHIFT
+	int32_t           v_north;
+	int32_t           v_up;       //cm/s << KALMAN_V_SHIFT
+	kalman_covariance horizontal;
+	kalman_covariance vertical;
+	uint32_t          fixes;
+	uint32_t          restarts;
+} kalman_filter;
+
+void kalman_reset(kalman_filter *filter);
+void kalman_add(kalman_filter *filter, gps_fix *fix, uint16_t hdop);
@@ -0,0 +1,179 @@
+// ndef.c : streaming parser for ndef messages
+
+#include "ndef.h"
+#include "xadow.h"
+
+enum parser_state
+{
+	STATE_HEADER,
+	STATE_TYPE_LENGTH,
+	STATE_PAYLOAD_LENGTH,
+	STATE_ID_LENGTH,
+	STATE_TYPE,
+	STATE_ID,
+	STATE_PAYLOAD,
+	STATE_END,
+};
+
+void ndef_parser_init(ndef_parser *parser, NdefRecordHandler on_record, NdefPayloadHandler on_payload,
+	void *context)
+{
+	memset(parser, 0, sizeof(*parser));
+	parser->state = STATE_HEADER;
+	parser->status = NDEF_MORE;
+	parser->on_record = on_record;
+	parser->on_payload = on_payload;
+	parser->context = context;
+}
+
+//moves on to the next field that has bytes to come, announcing the record on the way to its payload
+static void next_field(ndef_parser *parser)
+{
+	ndef_record *record = &parser->record;
+
+	switch (parser->state)
+	{
+	case STATE_TYPE_LENGTH:
+		parser->state = STATE_PAYLOAD_LENGTH;
+		parser->left = record->flags & NDEF_FLAG_SR ? 1 : 4;
+		return;
+	case STATE_PAYLOAD_LENGTH:
+		if (record->flags & NDEF_FLAG_IL)
+		{
+			parser->state = STATE_ID_LENGTH;
+			parser->left = 1;
+			return;
+		}
+		//fall through
+	case STATE_ID_LENGTH:
+		parser->state = STATE_TYPE;
+		parser->left = record->type_length;
+		break;
+	case STATE_TYPE:
+		parser->state = STATE_ID;
+		parser->left = record->id_length;
+		break;
+	case STATE_ID:
+		if (parser->on_record)
+		{
+			parser->on_record(record, parser->context);
+		}
+		parser->state = STATE_PAYLOAD;
+		parser->left = record->payload_length;
+		break;
+	case STATE_PAYLOAD:
+		if (record->flags & NDEF_FLAG_ME)
+		{
+			parser->state = STATE_END;
+			parser->status = NDEF_DONE;
+			return;
+		}
+		parser->state = STATE_HEADER;
+		parser->left = 1;
+		record->index++;
+		return;
+	default:
+		return;
+	}
+	//empty type, id or payload
+	if (!parser->left)
+	{
+		next_field(parser);
+	}
+}
+
+enum ndef_status ndef_parser_feed(ndef_parser *parser, const uint8_t *data, size_t length)
+{
+	ndef_record *record = &parser->record;
+	const uint8_t *end = data + length;
+
+	while (data < end && parser->status == NDEF_MORE)
+	{
+		switch (parser->state)
+		{
+		case STATE_HEADER:
+		{
+			uint16_t index = record->index;
+			memset(record, 0, sizeof(*record));
+			record->index = index;
+			record->flags = *(data++);
+			//the first record, and only the first, begins the message
+			if (!(record->flags & NDEF_FLAG_MB) != (index != 0))
+			{
+				parser->status = NDEF_ERROR;
+				break;
+			}
+			parser->state = STATE_TYPE_LENGTH;
+			break;
+		}
+		case STATE_TYPE_LENGTH:
+			record->type_length = *(data++);
+			next_field(parser);
+			break;
+		case STATE_PAYLOAD_LENGTH:
+			//big endian
+			record->payload_length = (record->payload_length << 8) | *(data++);
+			if (!--parser->left)
+			{
+				next_field(parser);
+			}
+			break;
+		case STATE_ID_LENGTH:
+			record->id_length = *(data++);
+			next_field(parser);
+			break;
+		case STATE_TYPE:
+		{
+			uint8_t at = record->type_length - parser->left;
+			if (at < NDEF_MAX_TYPE)
+			{
+				record->type[at] = *data;
+			}
+			data++;
+			if (!--parser->left)
+			{
+				next_field(parser);
+			}
+			break;
+		}
+		case STATE_ID:
+		{
+			uint32_t skip = min(parser->left, (uint32_t)(end - data));
+			data += skip;
+			parser->left -= skip;
+			if (!parser->left)
+			{
+				next_field(parser);
+			}
+			break;
+		}
+		case STATE_PAYLOAD:
+		{
+			uint32_t slice = min(parser->left, (uint32_t)(end - data));
+			if (parser->on_payload)
+			{
+				parser->on_payload(record, record->payload_length - parser->left, data, slice, parser->context);
+			}
+			data += slice;
+			parser->left -= slice;
+			if (!parser->left)
+			{
+				next_field(parser);
+			}
+			break;
+		}
+		default:
+			parser->status = NDEF_ERROR;
+			break;
+		}
+	}
+	return parser->status;
+}
+
+//whether a record has the given type name format and type, e.g. NDEF_TNF_WELL_KNOWN and "T"
+bool ndef_record_is(const ndef_record *record, uint8_t tnf, const char *type)
+{
+	size_t length = strlen(type);
+	return (record->flags & NDEF_TNF_MASK) == tnf && record->type_length == length && length <= NDEF_MAX_TYPE &&
+		!memcmp(record->type, type, length);
+}
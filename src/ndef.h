@@ -0,0 +1,57 @@
+// ndef.h : streaming parser for ndef messages
+//
+// Fed the message a piece at a time, in whatever pieces it arrives in, the parser keeps only the
+// header of the record it is in. Each record is announced once its header, type and id have gone
+// by; its payload is then handed on as slices of the pieces fed in, never copied.
+
+#pragma once
+
+#include <pebble.h>
+
+#define NDEF_MAX_TYPE       8       //type bytes kept, longer types are cut
+
+#define NDEF_FLAG_MB        0x80    //message begin
+#define NDEF_FLAG_ME        0x40    //message end
+#define NDEF_FLAG_CF        0x20    //chunked payload
+#define NDEF_FLAG_SR        0x10    //short record, one byte payload length
+#define NDEF_FLAG_IL        0x08    //id length present
+#define NDEF_TNF_MASK       0x07
+
+#define NDEF_TNF_WELL_KNOWN 0x01
+
+enum ndef_status
+{
+	NDEF_MORE,              //fine so far, the message goes on
+	NDEF_DONE,              //the record flagged as the last one has ended
+	NDEF_ERROR,
+};
+
+typedef struct ndef_record
+{
+	uint8_t  flags;
+	uint8_t  type_length;
+	uint8_t  id_length;
+	uint32_t payload_length;
+	uint8_t  type[NDEF_MAX_TYPE];
+	uint16_t index;         //of the record in the message
+} ndef_record;
+
+typedef void (*NdefRecordHandler)(const ndef_record *record, void *context);
+typedef void (*NdefPayloadHandler)(const ndef_record *record, uint32_t offset, const uint8_t *data, size_t length,
+	void *context);
+
+typedef struct ndef_parser
+{
+	uint8_t            state;
+	uint8_t            status;      //enum ndef_status
+	uint32_t           left;        //bytes of the current field still to come
+	ndef_record        record;
+	NdefRecordHandler  on_record;
+	NdefPayloadHandler on_payload;
+	void              *context;
+} ndef_parser;
+
+void ndef_parser_init(ndef_parser *parser, NdefRecordHandler on_record, NdefPayloadHandler on_payload,
+	void *context);
+enum ndef_status ndef_parser_feed(ndef_parser *parser, const uint8_t *data, size_t length);
+bool ndef_record_is(const ndef_record *record, uint8_t tnf, const char *type);
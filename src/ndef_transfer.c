@@ -0,0 +1,186 @@
+// ndef_transfer.c : reads, writes and erases the tag's ndef message in chunks over the strap
+
+#include "ndef_transfer.h"
+
+static struct
+{
+	uint16_t       attr_id;     //of the transfer running, 0 for none
+	uint16_t       offset;      //of the next chunk
+	uint16_t       total;       //message length, for a read 0 until the first reply
+	uint8_t        length;      //data bytes in the chunk last sent
+	uint8_t        attempts;    //at the current chunk
+	ndef_parser   *parser;
+	const uint8_t *message;
+} s_transfer;
+
+static NdefTransferHandler s_handler;
+
+void ndef_transfer_set_handler(NdefTransferHandler handler)
+{
+	s_handler = handler;
+}
+
+static bool start(uint16_t attr_id)
+{
+	if (s_transfer.attr_id)
+	{
+		return false;
+	}
+	memset(&s_transfer, 0, sizeof(s_transfer));
+	s_transfer.attr_id = attr_id;
+	return true;
+}
+
+static void finish(bool ok)
+{
+	uint16_t attr_id = s_transfer.attr_id;
+
+	if (!ok)
+	{
+		APP_LOG(APP_LOG_LEVEL_WARNING, "NDEF: %04x failed at %d of %d", attr_id, s_transfer.offset, s_transfer.total);
+	}
+	s_transfer.attr_id = 0;
+	if (s_handler)
+	{
+		s_handler(attr_id, ok);
+	}
+}
+
+//reads the message into the parser
+bool ndef_read_start(ndef_parser *parser)
+{
+	if (!start(ATTR_NFC_READ_NDEF))
+	{
+		return false;
+	}
+	s_transfer.parser = parser;
+	return true;
+}
+
+bool ndef_write_start(const uint8_t *message, uint16_t length)
+{
+	if (!length || !start(ATTR_NFC_WRITE_NDEF))
+	{
+		return false;
+	}
+	s_transfer.message = message;
+	s_transfer.total = length;
+	return true;
+}
+
+bool ndef_erase_start(void)
+{
+	return start(ATTR_NFC_ERASE_NDEF);
+}
+
+bool ndef_transfer_active(void)
+{
+	return s_transfer.attr_id != 0;
+}
+
+//whether the attribute has a chunk to send; gives up on a chunk sent too often
+bool ndef_transfer_due(SmartstrapAttribute *attr)
+{
+	if (!s_transfer.attr_id || smartstrap_attribute_get_attribute_id(attr) != s_transfer.attr_id)
+	{
+		return false;
+	}
+	if (s_transfer.attempts > NDEF_RETRIES)
+	{
+		finish(false);
+		return false;
+	}
+	return true;
+}
+
+SmartstrapResult ndef_transfer_issue(SmartstrapAttribute *attr)
+{
+	uint8_t *buffer;
+	size_t size;
+	SmartstrapResult result = smartstrap_attribute_begin_write(attr, &buffer, &size);
+
+	if (result != SmartstrapResultOk)
+	{
+		return result;
+	}
+
+	xadow_ndef_chunk chunk = {
+		.offset = s_transfer.offset,
+		.total = s_transfer.attr_id == ATTR_NFC_WRITE_NDEF ? s_transfer.total : 0,
+	};
+	if (s_transfer.attr_id == ATTR_NFC_READ_NDEF)
+	{
+		chunk.length = min(XADOW_NDEF_CHUNK, size - sizeof(chunk));
+	}
+	else if (s_transfer.attr_id == ATTR_NFC_WRITE_NDEF)
+	{
+		chunk.length = min(min(XADOW_NDEF_CHUNK, size - sizeof(chunk)), s_transfer.total - s_transfer.offset);
+		memcpy(buffer + sizeof(chunk), s_transfer.message + s_transfer.offset, chunk.length);
+	}
+	memcpy(buffer, &chunk, sizeof(chunk));
+	size_t length = sizeof(chunk) + (s_transfer.attr_id == ATTR_NFC_WRITE_NDEF ? chunk.length : 0);
+	s_transfer.length = chunk.length;
+
+	result = smartstrap_attribute_end_write(attr, length, s_transfer.attr_id == ATTR_NFC_READ_NDEF);
+	if (result == SmartstrapResultOk)
+	{
+		s_transfer.attempts++;
+	}
+	return result;
+}
+
+//a chunk of the message came in, it is parsed where it lies
+void ndef_transfer_did_read(SmartstrapAttribute *attr, SmartstrapResult result, const uint8_t *data,
+	size_t length)
+{
+	xadow_ndef_chunk chunk;
+
+	if (s_transfer.attr_id != ATTR_NFC_READ_NDEF || result != SmartstrapResultOk || length < sizeof(chunk))
+	{
+		return;
+	}
+	memcpy(&chunk, data, sizeof(chunk));
+	if (chunk.offset != s_transfer.offset || chunk.length > length - sizeof(chunk) ||
+		(!chunk.length && chunk.offset < chunk.total))
+	{
+		//a reply to an earlier request, or garbled: ask again
+		return;
+	}
+	s_transfer.total = chunk.total;
+	s_transfer.offset += chunk.length;
+	s_transfer.attempts = 0;
+
+	enum ndef_status status = ndef_parser_feed(s_transfer.parser, data + sizeof(chunk), chunk.length);
+	if (status == NDEF_ERROR)
+	{
+		finish(false);
+	}
+	else if (status == NDEF_DONE || s_transfer.offset >= s_transfer.total)
+	{
+		//a message that ends before its last record does is cut short, one with no bytes at all is
+		//just a tag with nothing on it
+		finish(status == NDEF_DONE || !s_transfer.total);
+	}
+}
+
+//true when the write completes the request, false when a read of the reply is still to come
+bool ndef_transfer_did_write(SmartstrapAttribute *attr, SmartstrapResult result)
+{
+	uint16_t attr_id = smartstrap_attribute_get_attribute_id(attr);
+
+	if (attr_id == ATTR_NFC_READ_NDEF)
+	{
+		return result != SmartstrapResultOk;
+	}
+	if (attr_id != s_transfer.attr_id || result != SmartstrapResultOk)
+	{
+		return true;
+	}
+	s_transfer.offset += s_transfer.length;
+	s_transfer.attempts = 0;
+	if (s_transfer.offset >= s_transfer.total)
+	{
+		finish(true);
+	}
+	return true;
+}
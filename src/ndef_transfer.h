@@ -0,0 +1,32 @@
+// ndef_transfer.h : reads, writes and erases the tag's ndef message in chunks over the strap
+//
+// One transfer at a time, a chunk at a time, see xadow_ndef_chunk. The requests go out through
+// the read pipeline like any endpoint, so a tag being read shares the bus with the gps polls
+// instead of holding it up. Read chunks are parsed straight out of the attribute buffer, and
+// write chunks are taken straight from the caller's message, which has to stay put until the
+// transfer is done. A chunk that fails is sent again, up to NDEF_RETRIES times.
+
+#pragma once
+
+#include <pebble.h>
+#include "ndef.h"
+#include "xadow.h"
+
+#define NDEF_RETRIES        3
+#define NDEF_BUFFER_SIZE    sizeof(xadow_ndef_buffer)
+
+//the attribute the transfer was on, and whether it went through
+typedef void (*NdefTransferHandler)(uint16_t attr_id, bool ok);
+
+void ndef_transfer_set_handler(NdefTransferHandler handler);
+bool ndef_read_start(ndef_parser *parser);
+bool ndef_write_start(const uint8_t *message, uint16_t length);
+bool ndef_erase_start(void);
+bool ndef_transfer_active(void);
+
+//for the read pipeline
+bool ndef_transfer_due(SmartstrapAttribute *attr);
+SmartstrapResult ndef_transfer_issue(SmartstrapAttribute *attr);
+void ndef_transfer_did_read(SmartstrapAttribute *attr, SmartstrapResult result, const uint8_t *data,
+	size_t length);
+bool ndef_transfer_did_write(SmartstrapAttribute *attr, SmartstrapResult result);
@@ -0,0 +1,311 @@
+// nmea.c : streaming parser for the receiver's nmea sentences
+
+#include "nmea.h"
+
+#define MAX_DECIMALS    5
+
+enum parser_state
+{
+	STATE_IDLE,                 //waiting for a $
+	STATE_ADDRESS,
+	STATE_FIELDS,
+	STATE_CHECKSUM_HIGH,
+	STATE_CHECKSUM_LOW,
+};
+
+#define TYPE(a, b, c)   ((uint32_t)(a) << 16 | (uint32_t)(b) << 8 | (c))
+
+void nmea_parser_init(nmea_parser *parser, NmeaSentenceHandler on_sentence, void *context)
+{
+	memset(parser, 0, sizeof(*parser));
+	parser->state = STATE_IDLE;
+	parser->on_sentence = on_sentence;
+	parser->context = context;
+}
+
+static void start_field(nmea_parser *parser)
+{
+	memset(&parser->field, 0, sizeof(parser->field));
+	parser->field.empty = true;
+}
+
+static void add_char(nmea_field *field, char c)
+{
+	field->empty = false;
+	if (c >= '0' && c <= '9')
+	{
+		if (field->point)
+		{
+			//finer than any field needs
+			if (field->decimals == MAX_DECIMALS)
+			{
+				return;
+			}
+			field->decimals++;
+		}
+		else if (field->value > (UINT32_MAX - 9) / 10)
+		{
+			return;
+		}
+		field->value = field->value * 10 + (c - '0');
+	}
+	else if (c == '.')
+	{
+		field->point = true;
+	}
+	else if (c == '-')
+	{
+		field->negative = true;
+	}
+	else if (!field->letter)
+	{
+		field->letter = c;
+	}
+}
+
+//the field's value with the given number of decimals, e.g. 12.5 with 2 is 1250
+static uint32_t scaled(const nmea_field *field, uint8_t decimals)
+{
+	uint32_t value = field->value;
+
+	for (uint8_t d = field->decimals; d < decimals; d++)
+	{
+		value *= 10;
+	}
+	for (uint8_t d = field->decimals; d > decimals; d--)
+	{
+		value /= 10;
+	}
+	return value;
+}
+
+//dddmm.mmmmm to 1/10^7 degrees
+static int32_t coordinate(const nmea_field *field)
+{
+	uint32_t value = scaled(field, 5);
+	uint32_t minutes = value % 10000000;
+
+	//minutes * 10^5 / 60 is degrees * 10^5
+	return value / 10000000 * 10000000 + (minutes * 5 + 1) / 3;
+}
+
+//hhmmss.sss to ms of the day
+static uint32_t time_of_day(const nmea_field *field)
+{
+	uint32_t value = scaled(field, 3);
+	uint32_t seconds = value / 10000000 * 3600 + value / 100000 % 100 * 60 + value / 1000 % 100;
+
+	return seconds * 1000 + value % 1000;
+}
+
+static void gga_field(nmea_parser *parser, const nmea_field *field)
+{
+	nmea_data *pending = &parser->pending;
+
+	if (field->empty)
+	{
+		return;
+	}
+	switch (parser->index)
+	{
+	case 1:
+		pending->time = time_of_day(field);
+		break;
+	case 2:
+		pending->lat = coordinate(field);
+		break;
+	case 3:
+		if (field->letter == 'S')
+		{
+			pending->lat = -pending->lat;
+		}
+		break;
+	case 4:
+		pending->lon = coordinate(field);
+		break;
+	case 5:
+		if (field->letter == 'W')
+		{
+			pending->lon = -pending->lon;
+		}
+		break;
+	case 6:
+		pending->fix = field->value;
+		break;
+	case 7:
+		pending->sat = field->value;
+		break;
+	case 8:
+		pending->hdop = scaled(field, 2);
+		break;
+	case 9:
+		pending->alt = field->negative ? -(int32_t)scaled(field, 2) : (int32_t)scaled(field, 2);
+		break;
+	}
+}
+
+static void rmc_field(nmea_parser *parser, const nmea_field *field)
+{
+	nmea_data *pending = &parser->pending;
+
+	if (field->empty)
+	{
+		return;
+	}
+	switch (parser->index)
+	{
+	case 1:
+		pending->time = time_of_day(field);
+		break;
+	case 7:
+		//knots, 1852 m an hour
+		pending->speed = scaled(field, 2) * 463 / 900;
+		break;
+	}
+}
+
+static void end_field(nmea_parser *parser)
+{
+	switch (parser->sentence)
+	{
+	case NMEA_GGA:
+		gga_field(parser, &parser->field);
+		break;
+	case NMEA_RMC:
+		rmc_field(parser, &parser->field);
+		break;
+	}
+	parser->index++;
+	start_field(parser);
+}
+
+//the address field is the talker, e.g. GP or GN, and the sentence type
+static void end_address(nmea_parser *parser)
+{
+	switch (parser->type & 0xffffff)
+	{
+	case TYPE('G', 'G', 'A'):
+		parser->sentence = NMEA_GGA;
+		break;
+	case TYPE('R', 'M', 'C'):
+		parser->sentence = NMEA_RMC;
+		break;
+	default:
+		//not one to read, skip it
+		parser->state = STATE_IDLE;
+		return;
+	}
+	parser->pending = parser->data;
+	parser->index = 1;
+	start_field(parser);
+	parser->state = STATE_FIELDS;
+}
+
+static int8_t hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	if (c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+	if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+static void fail(nmea_parser *parser)
+{
+	parser->errors++;
+	parser->state = STATE_IDLE;
+}
+
+void nmea_parser_feed(nmea_parser *parser, const uint8_t *data, size_t length)
+{
+	for (const uint8_t *end = data + length; data < end; data++)
+	{
+		char c = *data;
+
+		if (c == '$')
+		{
+			//one still going was cut off
+			if (parser->state != STATE_IDLE)
+			{
+				parser->errors++;
+			}
+			parser->state = STATE_ADDRESS;
+			parser->checksum = 0;
+			parser->length = 1;
+			parser->type = 0;
+			continue;
+		}
+		if (parser->state == STATE_IDLE)
+		{
+			continue;
+		}
+		if (++parser->length > NMEA_MAX_SENTENCE || c == '\r' || c == '\n')
+		{
+			fail(parser);
+			continue;
+		}
+
+		switch (parser->state)
+		{
+		case STATE_ADDRESS:
+			parser->checksum ^= c;
+			if (c == ',')
+			{
+				end_address(parser);
+			}
+			else
+			{
+				parser->type = parser->type << 8 | c;
+			}
+			break;
+		case STATE_FIELDS:
+			if (c == '*')
+			{
+				end_field(parser);
+				parser->state = STATE_CHECKSUM_HIGH;
+				break;
+			}
+			parser->checksum ^= c;
+			if (c == ',')
+			{
+				end_field(parser);
+			}
+			else
+			{
+				add_char(&parser->field, c);
+			}
+			break;
+		case STATE_CHECKSUM_HIGH:
+			if (hex_digit(c) < 0)
+			{
+				fail(parser);
+				break;
+			}
+			parser->expected = hex_digit(c) << 4;
+			parser->state = STATE_CHECKSUM_LOW;
+			break;
+		case STATE_CHECKSUM_LOW:
+			if (hex_digit(c) < 0 || (parser->expected | hex_digit(c)) != parser->checksum)
+			{
+				fail(parser);
+				break;
+			}
+			parser->data = parser->pending;
+			parser->sentences++;
+			parser->state = STATE_IDLE;
+			if (parser->on_sentence)
+			{
+				parser->on_sentence(parser->sentence, &parser->data, parser->context);
+			}
+			break;
+		}
+	}
+}
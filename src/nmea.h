@@ -0,0 +1,66 @@
+// nmea.h : streaming parser for the receiver's nmea sentences
+//
+// Fed the stream a piece at a time, however the sentences are split between reads, the parser
+// keeps no line buffer: each character is folded into the checksum and into the field it
+// belongs to as it goes by, numbers straight into integers. A sentence's values only take effect
+// once its checksum has matched, so a garbled or cut off sentence changes nothing. Known are
+// GGA (position, fix, hdop, altitude) and RMC (speed); the rest, e.g. GSV, are skipped unread.
+
+#pragma once
+
+#include <pebble.h>
+
+#define NMEA_MAX_SENTENCE       82      //characters from $ to the end of the checksum
+
+enum nmea_sentence
+{
+	NMEA_OTHER,
+	NMEA_GGA,
+	NMEA_RMC,
+};
+
+//everything the sentences tell, as of the last one that checked out
+typedef struct nmea_data
+{
+	int32_t  lat;               //1/10^7 degrees, as ATTR_GPS_LOCATION
+	int32_t  lon;
+	int32_t  alt;               //1/100 m
+	uint16_t speed;             //1/100 m/s
+	uint16_t hdop;              //1/100
+	uint8_t  fix;               //GGA fix quality
+	uint8_t  sat;               //satellites used in the fix
+	uint32_t time;              //ms of the utc day, of the last fix
+} nmea_data;
+
+typedef struct nmea_field
+{
+	uint32_t value;             //digits read so far, without the point
+	uint8_t  decimals;          //of them after the point
+	bool     point;
+	bool     negative;
+	bool     empty;
+	char     letter;            //first non-numeric character, e.g. N or A
+} nmea_field;
+
+typedef void (*NmeaSentenceHandler)(enum nmea_sentence sentence, const nmea_data *data, void *context);
+
+typedef struct nmea_parser
+{
+	uint8_t  state;
+	uint8_t  sentence;          //enum nmea_sentence
+	uint8_t  checksum;          //of the characters so far
+	uint8_t  expected;          //the one the sentence ends with
+	uint8_t  length;            //characters so far
+	uint8_t  index;             //of the field being read
+	uint32_t type;              //address characters, packed
+	nmea_field field;
+	nmea_data pending;          //what the sentence will change once it checks out
+	nmea_data data;
+	uint32_t sentences;         //that checked out
+	uint32_t errors;            //bad checksums, cut off or overlong sentences
+	NmeaSentenceHandler on_sentence;
+	void    *context;
+} nmea_parser;
+
+void nmea_parser_init(nmea_parser *parser, NmeaSentenceHandler on_sentence, void *context);
+void nmea_parser_feed(nmea_parser *parser, const uint8_t *data, size_t length);
@@ -0,0 +1,17 @@
+// persist_keys.h : every persistent storage key used by the app
+//
+// The watch keeps at most 4 KB per app and 256 bytes per key, so the budget of each user is
+// noted next to its keys.
+
+#pragma once
+
+//track store, see track_store.h: index and open block 2 x 256, chunks 10 x 256 bytes
+#define PERSIST_KEY_TRACK_INDEX     1
+#define PERSIST_KEY_TRACK_TAIL      2
+#define PERSIST_KEY_TRACK_CHUNK     16    //up to PERSIST_KEY_TRACK_CHUNK + TRACK_STORE_CHUNKS - 1
+
+//gps source, whether to stream the receiver's nmea sentences: a bool
+#define PERSIST_KEY_GPS_NMEA        3
+
+//tag registry, see tag_registry.h: 3 x 256 bytes, which leaves 256 of the 4 KB
+#define PERSIST_KEY_TAG_REGISTRY    4     //up to PERSIST_KEY_TAG_REGISTRY + TAG_REGISTRY_KEYS - 1
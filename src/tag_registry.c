@@ -0,0 +1,144 @@
+// tag_registry.c : the nfc tags known as course checkpoints
+
+#include "tag_registry.h"
+#include "persist_keys.h"
+#include "xadow.h"
+
+#define TAG_REGISTRY_VERSION    1
+
+typedef struct __attribute__((__packed__)) tag_slot
+{
+	uint16_t fingerprint;   //top half of the uid hash
+	uint8_t  checkpoint;    //0 for a free slot
+} tag_slot;
+
+typedef struct __attribute__((__packed__)) tag_registry_key
+{
+	uint8_t  version;
+	tag_slot slots[TAG_SLOTS_PER_KEY];
+} tag_registry_key;
+
+static tag_registry_key s_keys[TAG_REGISTRY_KEYS];
+static uint16_t s_count;
+static uint8_t s_highest;       //checkpoint id
+
+static tag_slot *slot(uint16_t index)
+{
+	return &s_keys[index / TAG_SLOTS_PER_KEY].slots[index % TAG_SLOTS_PER_KEY];
+}
+
+//fnv-1a
+static uint32_t uid_hash(const uint8_t *uid, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash = (hash ^ uid[i]) * 16777619u;
+	}
+	return hash;
+}
+
+//index of the slot holding the uid, or of the free one it would go in; -1 when neither is found
+static int probe(const uint8_t *uid, size_t length)
+{
+	uint32_t hash = uid_hash(uid, length);
+	uint16_t fingerprint = hash >> 16;
+	uint16_t index = hash % TAG_SLOTS;
+
+	for (int i = 0; i < TAG_SLOTS; i++)
+	{
+		tag_slot *s = slot(index);
+		if (!s->checkpoint || s->fingerprint == fingerprint)
+		{
+			return index;
+		}
+		index = (index + 1) % TAG_SLOTS;
+	}
+	return -1;
+}
+
+//loads the table in one pass; a key missing or from another version drops the lot, as the
+//probe sequences run across keys
+void tag_registry_init(void)
+{
+	bool valid = true;
+
+	for (int k = 0; k < TAG_REGISTRY_KEYS; k++)
+	{
+		valid = valid && persist_read_data(PERSIST_KEY_TAG_REGISTRY + k, &s_keys[k], sizeof(s_keys[k])) ==
+			sizeof(s_keys[k]) && s_keys[k].version == TAG_REGISTRY_VERSION;
+	}
+	if (!valid)
+	{
+		if (persist_exists(PERSIST_KEY_TAG_REGISTRY))
+		{
+			APP_LOG(APP_LOG_LEVEL_WARNING, "Dropping a tag registry that doesn't load");
+		}
+		memset(s_keys, 0, sizeof(s_keys));
+		for (int k = 0; k < TAG_REGISTRY_KEYS; k++)
+		{
+			s_keys[k].version = TAG_REGISTRY_VERSION;
+		}
+	}
+
+	s_count = 0;
+	s_highest = 0;
+	for (int i = 0; i < TAG_SLOTS; i++)
+	{
+		uint8_t checkpoint = slot(i)->checkpoint;
+		if (checkpoint)
+		{
+			s_count++;
+			s_highest = max(s_highest, checkpoint);
+		}
+	}
+}
+
+//the checkpoint of a tag, 0 for one not registered
+uint8_t tag_registry_find(const uint8_t *uid, size_t length)
+{
+	int index = probe(uid, length);
+	return index < 0 ? 0 : slot(index)->checkpoint;
+}
+
+//registers a tag, or moves it to another checkpoint; only the key holding its slot is written
+bool tag_registry_add(const uint8_t *uid, size_t length, uint8_t checkpoint)
+{
+	int index = probe(uid, length);
+
+	if (!checkpoint || index < 0)
+	{
+		return false;
+	}
+	tag_slot *s = slot(index);
+	if (!s->checkpoint && s_count >= TAG_REGISTRY_MAX)
+	{
+		return false;
+	}
+	if (!s->checkpoint)
+	{
+		s_count++;
+	}
+	s->fingerprint = uid_hash(uid, length) >> 16;
+	s->checkpoint = checkpoint;
+	s_highest = max(s_highest, checkpoint);
+
+	int k = index / TAG_SLOTS_PER_KEY;
+	int result = persist_write_data(PERSIST_KEY_TAG_REGISTRY + k, &s_keys[k], sizeof(s_keys[k]));
+	if (result < 0)
+	{
+		APP_LOG(APP_LOG_LEVEL_ERROR, "Writing the tag registry failed with %d", result);
+		return false;
+	}
+	return true;
+}
+
+uint16_t tag_registry_count(void)
+{
+	return s_count;
+}
+
+uint8_t tag_registry_highest(void)
+{
+	return s_highest;
+}
@@ -0,0 +1,23 @@
+// tag_registry.h : the nfc tags known as course checkpoints
+//
+// An open addressing table with linear probing, keyed by a hash of the tag uid. A slot keeps 16
+// bits of the hash and the checkpoint id, three bytes, so the whole table fits in three persist
+// keys and is loaded with three reads at start up. Kept at most three quarters full, a lookup is
+// a hash and a probe or two. Two uids that share their home slot and those 16 bits can't be told
+// apart, which over a few hundred tags is unlikely enough for a checkpoint.
+
+#pragma once
+
+#include <pebble.h>
+
+#define TAG_REGISTRY_KEYS       3
+#define TAG_SLOTS_PER_KEY       85    //after a version byte, 256 bytes a key
+#define TAG_SLOTS               (TAG_REGISTRY_KEYS * TAG_SLOTS_PER_KEY)
+#define TAG_REGISTRY_MAX        (TAG_SLOTS * 3 / 4)
+
+void tag_registry_init(void);
+uint8_t tag_registry_find(const uint8_t *uid, size_t length);
+bool tag_registry_add(const uint8_t *uid, size_t length, uint8_t checkpoint);
+
+uint16_t tag_registry_count(void);
+uint8_t tag_registry_highest(void);
@@ -0,0 +1,258 @@
+// track_export.c : streams the recorded track to the phone, which turns it into a gpx file
+//
+// The outbox only takes one message at a time, so "in flight" here means sent but not yet
+// acknowledged by the phone: the next message goes out as soon as the previous one has been
+// delivered, while the phone is still decoding the ones before.
+
+#include "track_export.h"
+#include "fix_log.h"
+#include "track_fusion.h"
+#include "xadow.h"
+
+#define EXPORT_INBOX_SIZE   64
+#define EXPORT_OUTBOX_SIZE  (sizeof(s_message) + sizeof(s_fused) + 64)
+
+static struct
+{
+	bool      active;
+	bool      sending;      //a message is in the outbox
+	uint32_t  first_block;  //fix log block numbers being exported
+	uint32_t  end_block;
+	uint16_t  messages;     //data messages, the phone gets messages + 1 in all
+	uint16_t  next;         //sequence number to send next
+	uint16_t  acked;        //messages the phone has received in order
+	uint16_t  in_outbox;    //sequence number of the message in the outbox
+	uint8_t   retries;      //since the phone last took a message
+	AppTimer *timer;
+} s_export;
+
+static export_stats s_stats;
+static uint8_t s_message[EXPORT_BLOCKS_PER_MESSAGE * FIX_BLOCK_SIZE];
+static fused_fix s_fused[EXPORT_BLOCKS_PER_MESSAGE * FIX_BLOCK_FIXES];
+
+static uint32_t now_ms(void)
+{
+	time_t sec;
+	uint16_t ms;
+	time_ms(&sec, &ms);
+	return (uint32_t)sec * 1000 + ms;
+}
+
+static void export_send_next(void);
+
+static void export_finish(bool ok)
+{
+	s_export.active = false;
+	s_stats.finished = now_ms();
+	s_stats.gave_up = !ok;
+	if (s_export.timer)
+	{
+		app_timer_cancel(s_export.timer);
+		s_export.timer = NULL;
+	}
+	APP_LOG(ok ? APP_LOG_LEVEL_INFO : APP_LOG_LEVEL_WARNING, "Export: %d messages (%d resent), %lu blocks in %lu ms%s",
+		s_stats.messages, s_stats.resent, s_stats.blocks, s_stats.finished - s_stats.started,
+		ok ? "" : ", phone gone");
+}
+
+//counts a message resent or a send that failed, false once the phone has had enough chances
+static bool export_count_retry(void)
+{
+	if (++s_export.retries > EXPORT_MAX_RETRIES)
+	{
+		export_finish(false);
+		return false;
+	}
+	return true;
+}
+
+static void export_timer_fired(void *context)
+{
+	s_export.timer = NULL;
+	if (s_export.next > s_export.acked)
+	{
+		//the phone went quiet, go back to the first message it hasn't confirmed
+		if (!export_count_retry())
+		{
+			return;
+		}
+		APP_LOG(APP_LOG_LEVEL_WARNING, "Export: no ack beyond %d, resending", s_export.acked);
+		s_stats.resent += s_export.next - s_export.acked;
+		s_export.next = s_export.acked;
+	}
+	export_send_next();
+}
+
+static void export_arm(uint32_t delay)
+{
+	if (!s_export.timer || !app_timer_reschedule(s_export.timer, delay))
+	{
+		s_export.timer = app_timer_register(delay, export_timer_fired, NULL);
+	}
+}
+
+static void export_retry(void)
+{
+	if (export_count_retry())
+	{
+		export_arm(EXPORT_RETRY);
+	}
+}
+
+static void export_send_next(void)
+{
+	DictionaryIterator *iter;
+
+	if (!s_export.active || s_export.sending || s_export.next > s_export.messages ||
+		s_export.next - s_export.acked >= EXPORT_WINDOW)
+	{
+		return;
+	}
+	AppMessageResult result = app_message_outbox_begin(&iter);
+	if (result != APP_MSG_OK)
+	{
+		APP_LOG(APP_LOG_LEVEL_ERROR, "Export: outbox_begin failed with %d", result);
+		export_retry();
+		return;
+	}
+
+	dict_write_uint32(iter, APP_KEY_EXPORT_SEQ, s_export.next);
+	if (s_export.next == 0)
+	{
+		dict_write_uint32(iter, APP_KEY_EXPORT_COUNT, s_export.messages);
+	}
+	else
+	{
+		//blocks dropped from the ring since the export started go out empty
+		uint32_t block = s_export.first_block + (s_export.next - 1) * EXPORT_BLOCKS_PER_MESSAGE;
+		uint16_t count = min(EXPORT_BLOCKS_PER_MESSAGE, s_export.end_block - block);
+		uint16_t fixes = 0;
+		track_fusion_start(fix_log_block(block - 1));
+		for (uint16_t i = 0; i < count; i++)
+		{
+			const uint8_t *data = fix_log_block(block + i);
+			if (data)
+			{
+				memcpy(s_message + i * FIX_BLOCK_SIZE, data, FIX_BLOCK_SIZE);
+				fixes += track_fusion_block(data, s_fused + fixes);
+			}
+			else
+			{
+				memset(s_message + i * FIX_BLOCK_SIZE, 0, FIX_BLOCK_SIZE);
+			}
+		}
+		dict_write_data(iter, APP_KEY_EXPORT_DATA, s_message, count * FIX_BLOCK_SIZE);
+		if (fixes)
+		{
+			dict_write_data(iter, APP_KEY_EXPORT_STEPS, (const uint8_t *)s_fused, fixes * sizeof(fused_fix));
+		}
+		s_stats.blocks += count;
+	}
+
+	result = app_message_outbox_send();
+	if (result != APP_MSG_OK)
+	{
+		APP_LOG(APP_LOG_LEVEL_ERROR, "Export: outbox_send failed with %d", result);
+		export_retry();
+		return;
+	}
+	s_export.sending = true;
+	s_export.in_outbox = s_export.next++;
+	s_stats.messages++;
+	export_arm(EXPORT_ACK_TIMEOUT);
+}
+
+static void export_outbox_sent(DictionaryIterator *iter, void *context)
+{
+	s_export.sending = false;
+	export_send_next();
+}
+
+static void export_outbox_failed(DictionaryIterator *iter, AppMessageResult reason, void *context)
+{
+	APP_LOG(APP_LOG_LEVEL_WARNING, "Export: message %d failed with %d", s_export.in_outbox, reason);
+	s_export.sending = false;
+	if (s_export.active && s_export.in_outbox < s_export.next)
+	{
+		s_stats.resent += s_export.next - s_export.in_outbox;
+		s_export.next = s_export.in_outbox;
+	}
+	if (s_export.active)
+	{
+		export_retry();
+	}
+}
+
+static void export_inbox_received(DictionaryIterator *iter, void *context)
+{
+	Tuple *request = dict_find(iter, APP_KEY_EXPORT_REQUEST);
+	Tuple *ack = dict_find(iter, APP_KEY_EXPORT_ACK);
+
+	if (request)
+	{
+		track_export_start(request->value->uint32);
+	}
+	else if (ack && s_export.active && ack->value->uint32 > s_export.acked)
+	{
+		s_export.acked = min(ack->value->uint32, s_export.next);
+		s_export.retries = 0;
+		if (s_export.acked > s_export.messages)
+		{
+			export_finish(true);
+			return;
+		}
+		export_arm(EXPORT_ACK_TIMEOUT);
+		export_send_next();
+	}
+}
+
+static void export_inbox_dropped(AppMessageResult reason, void *context)
+{
+	APP_LOG(APP_LOG_LEVEL_WARNING, "Export: incoming message dropped with %d", reason);
+}
+
+void track_export_init(void)
+{
+	app_message_register_inbox_received(export_inbox_received);
+	app_message_register_inbox_dropped(export_inbox_dropped);
+	app_message_register_outbox_sent(export_outbox_sent);
+	app_message_register_outbox_failed(export_outbox_failed);
+	app_message_open(EXPORT_INBOX_SIZE, EXPORT_OUTBOX_SIZE);
+}
+
+//exports the blocks holding fixes after the given time, the phone drops the older ones
+void track_export_start(uint32_t since)
+{
+	uint32_t first = fix_log_first_block();
+	uint32_t end = fix_log_end_block();
+
+	while (first + 1 < end && fix_block_start(fix_log_block(first + 1)) <= since)
+	{
+		first++;
+	}
+
+	if (s_export.timer)
+	{
+		app_timer_cancel(s_export.timer);
+	}
+	memset(&s_export, 0, sizeof(s_export));
+	memset(&s_stats, 0, sizeof(s_stats));
+	s_export.active = true;
+	s_export.first_block = first;
+	s_export.end_block = end;
+	s_export.messages = (end - first + EXPORT_BLOCKS_PER_MESSAGE - 1) / EXPORT_BLOCKS_PER_MESSAGE;
+	s_stats.started = now_ms();
+
+	APP_LOG(APP_LOG_LEVEL_INFO, "Export: %lu blocks after %lu in %d messages", end - first, since, s_export.messages);
+	export_send_next();
+}
+
+bool track_export_active(void)
+{
+	return s_export.active;
+}
+
+const export_stats *track_export_stats(void)
+{
+	return &s_stats;
+}
@@ -0,0 +1,43 @@
+// track_export.h : streams the recorded track to the phone, which turns it into a gpx file
+//
+// The phone asks for everything recorded after a given time. The watch replies with the number
+// of messages to expect (sequence number 0), then sends the fix log blocks that cover that time,
+// several per message, exactly as they are kept in memory (sequence numbers 1 to n), along with
+// the steps and cadence of each of their fixes when the watch counts steps. The phone
+// acknowledges the number of messages it has received in order; up to EXPORT_WINDOW messages
+// may go unacknowledged before the watch waits, and if the acknowledgements stop coming the
+// watch goes back to the first unacknowledged message. After EXPORT_MAX_RETRIES of those in a
+// row without the phone taking anything new, the watch gives up; the phone asks again later.
+
+#pragma once
+
+#include <pebble.h>
+
+//app message keys, see appKeys in appinfo.json
+#define APP_KEY_EXPORT_REQUEST      100   //phone: uint32, time after which fixes are wanted
+#define APP_KEY_EXPORT_SEQ          101   //watch: uint32, sequence number of the message
+#define APP_KEY_EXPORT_COUNT        102   //watch: uint32, number of data messages that follow
+#define APP_KEY_EXPORT_DATA         103   //watch: fix log blocks
+#define APP_KEY_EXPORT_ACK          104   //phone: uint32, messages received in order
+#define APP_KEY_EXPORT_STEPS        105   //watch: a fused_fix per fix of the blocks, see track_fusion.h
+
+#define EXPORT_BLOCKS_PER_MESSAGE   4     //1 KB of fixes per message, about 140 while walking
+#define EXPORT_WINDOW               4     //messages that may be waiting for an acknowledgement
+#define EXPORT_ACK_TIMEOUT          3000  //ms without one before sending again from the first
+#define EXPORT_RETRY                500   //ms after a message couldn't be sent
+#define EXPORT_MAX_RETRIES          10    //resends or failed sends in a row before giving up
+
+typedef struct export_stats
+{
+	uint16_t messages;
+	uint16_t resent;
+	uint32_t blocks;
+	uint32_t started;       //ms
+	uint32_t finished;      //ms, 0 while running
+	bool     gave_up;       //the phone stopped answering
+} export_stats;
+
+void track_export_init(void);
+void track_export_start(uint32_t since);
+bool track_export_active(void);
+const export_stats *track_export_stats(void);
@@ -0,0 +1,168 @@
+// track_fusion.c : steps and cadence for the recorded fixes, from the health minute history
+
+#include "track_fusion.h"
+#include "xadow.h"
+
+#define FUSION_HISTORY_LAG  (15 * SECONDS_PER_MINUTE)   //minutes older than this the watch won't fill in any more
+
+static struct
+{
+	bool      enabled;      //step data is there to fuse
+	uint32_t  fused_until;  //time of the last fix fused, 0 before the first
+	uint32_t  remainder;    //step seconds not handed out yet, carried over to the next fix
+	time_t    known_from;   //minutes whose steps are known, from the last batch fetched
+	time_t    known_to;
+	time_t    batch_start;  //minute of the first record in s_minutes
+	uint16_t  batch_count;
+} s_fusion;
+
+static HealthMinuteData s_minutes[FUSION_BATCH];
+static fusion_stats s_stats;
+
+static void fetch_batch(time_t minute)
+{
+	time_t start = minute;
+	time_t end = minute + FUSION_BATCH * SECONDS_PER_MINUTE;
+	time_t lag_limit = time(NULL) - FUSION_HISTORY_LAG;
+
+	s_fusion.batch_count = health_service_get_minute_history(s_minutes, FUSION_BATCH, &start, &end);
+	s_fusion.batch_start = start;
+	s_stats.queries++;
+	s_stats.minutes += s_fusion.batch_count;
+
+	//the history skips minutes it has nothing for; those older than the lag it never will have
+	lag_limit -= lag_limit % SECONDS_PER_MINUTE;
+	s_fusion.known_from = minute;
+	s_fusion.known_to = s_fusion.batch_count ? start + s_fusion.batch_count * SECONDS_PER_MINUTE : minute;
+	s_fusion.known_to = max(s_fusion.known_to, min(minute + FUSION_BATCH * SECONDS_PER_MINUTE, lag_limit));
+}
+
+//steps in the minute starting at the given time, -1 when the history doesn't have it yet
+static int minute_steps(time_t minute)
+{
+	if (minute < s_fusion.known_from || minute >= s_fusion.known_to)
+	{
+		fetch_batch(minute);
+		if (minute >= s_fusion.known_to)
+		{
+			return -1;
+		}
+	}
+	if (minute < s_fusion.batch_start || minute >= s_fusion.batch_start + s_fusion.batch_count * SECONDS_PER_MINUTE)
+	{
+		return 0;
+	}
+	const HealthMinuteData *data = &s_minutes[(minute - s_fusion.batch_start) / SECONDS_PER_MINUTE];
+	return data->is_invalid ? 0 : data->steps;
+}
+
+//steps * seconds between two times, and the steps of the minute the later one falls in; false
+//when the history doesn't reach that far yet
+static bool steps_between(time_t from, time_t to, uint32_t *step_seconds, int *cadence)
+{
+	uint32_t total = 0;
+	int steps = 0;
+
+	for (time_t minute = from - from % SECONDS_PER_MINUTE; minute < to; minute += SECONDS_PER_MINUTE)
+	{
+		steps = minute_steps(minute);
+		if (steps < 0)
+		{
+			return false;
+		}
+		total += steps * (min(to, minute + SECONDS_PER_MINUTE) - max(from, minute));
+	}
+	*step_seconds = total;
+	*cadence = steps;
+	return true;
+}
+
+//FUSION_UNKNOWN when the history doesn't reach the fix yet, which holds up the fixes after it too
+static fused_fix fuse(const gps_fix *fix)
+{
+	fused_fix fused = { 0, FUSION_UNKNOWN };
+	uint32_t step_seconds;
+	int cadence;
+
+	if (!s_fusion.fused_until || fix->time - s_fusion.fused_until > FUSION_MAX_GAP)
+	{
+		//the start of a track, there's nothing to count the steps from
+		if (!steps_between(fix->time - 1, fix->time, &step_seconds, &cadence))
+		{
+			return fused;
+		}
+		step_seconds = 0;
+		s_fusion.remainder = 0;
+	}
+	else if (!steps_between(s_fusion.fused_until, fix->time, &step_seconds, &cadence))
+	{
+		return fused;
+	}
+	step_seconds += s_fusion.remainder;
+
+	fused.steps = min(step_seconds / SECONDS_PER_MINUTE, UINT16_MAX);
+	fused.cadence = min(cadence, FUSION_UNKNOWN - 1);
+	s_fusion.remainder = step_seconds % SECONDS_PER_MINUTE;
+	s_fusion.fused_until = fix->time;
+	s_stats.fixes++;
+	s_stats.steps += fused.steps;
+	return fused;
+}
+
+void track_fusion_init(void)
+{
+	memset(&s_fusion, 0, sizeof(s_fusion));
+	memset(&s_stats, 0, sizeof(s_stats));
+	s_fusion.enabled = true;
+}
+
+//carries on after the last fix of the previous block, a track starts over without one; the
+//minute records already fetched are kept for the next block
+void track_fusion_start(const uint8_t *previous)
+{
+	fix_block_reader reader;
+	gps_fix fix = { 0 };
+
+	if (previous)
+	{
+		fix_block_reader_init(&reader, previous);
+		while (fix_block_reader_next(&reader, &fix))
+		{
+		}
+	}
+	s_fusion.fused_until = fix.time;
+	s_fusion.remainder = 0;
+}
+
+//the steps and cadence of every fix of the block, returns the number of fixes, 0 without step data
+uint16_t track_fusion_block(const uint8_t *block, fused_fix *fused)
+{
+	fix_block_reader reader;
+	gps_fix fix;
+	uint16_t count = 0;
+
+	if (!s_fusion.enabled)
+	{
+		return 0;
+	}
+	s_stats.blocks++;
+	fix_block_reader_init(&reader, block);
+	while (fix_block_reader_next(&reader, &fix))
+	{
+		if (!count || fused[count - 1].cadence != FUSION_UNKNOWN)
+		{
+			fused[count] = fuse(&fix);
+		}
+		else
+		{
+			fused[count] = (fused_fix){ 0, FUSION_UNKNOWN };
+		}
+		count++;
+	}
+	return count;
+}
+
+const fusion_stats *track_fusion_stats(void)
+{
+	return &s_stats;
+}
@@ -0,0 +1,38 @@
+// track_fusion.h : steps and cadence for the recorded fixes, from the health minute history
+//
+// Runs as the track is exported, a block at a time, never from the strap read path. A block's
+// fixes are walked in order along with the minute records covering them, which are fetched a
+// batch at a time, so each fix and each minute is looked at once. The steps of a minute are
+// spread evenly over it: a fix gets the steps between the previous fix and itself, and the step
+// rate of the minute it was taken in. Nothing is kept on the watch, the firmware holds on to
+// the minute history; fixes it doesn't cover yet go out with FUSION_UNKNOWN.
+
+#pragma once
+
+#include <pebble.h>
+#include "fix_log.h"
+
+#define FUSION_BATCH      60                //minute records fetched at a time
+#define FUSION_MAX_GAP    600               //s between fixes after which steps start over from 0
+#define FUSION_UNKNOWN    0xFF              //cadence of a fix the minute history doesn't reach yet
+
+//what the export sends for every fix, in the order of the fixes
+typedef struct __attribute__((__packed__)) fused_fix
+{
+	uint16_t steps;     //since the previous fix
+	uint8_t  cadence;   //steps per minute in the minute of the fix
+} fused_fix;
+
+typedef struct fusion_stats
+{
+	uint32_t blocks;
+	uint32_t queries;   //minute history requests
+	uint32_t minutes;   //minute records received
+	uint32_t fixes;
+	uint32_t steps;
+} fusion_stats;
+
+void track_fusion_init(void);
+void track_fusion_start(const uint8_t *previous);
+uint16_t track_fusion_block(const uint8_t *block, fused_fix *fused);
+const fusion_stats *track_fusion_stats(void);
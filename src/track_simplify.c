@@ -0,0 +1,146 @@
+// track_simplify.c : drops recorded fixes that add nothing to the shape of the track
+//
+// Positions are compared in the geo frame of the last fix passed on. Squared distances need
+// 64 bits, which is why the window is also broken once a line would get longer than
+// GEO_MAX_SPAN.
+
+#include "track_simplify.h"
+#include "geo.h"
+
+static struct
+{
+	FixHandler output;
+	int32_t    tolerance;       //units
+	bool       started;
+	gps_fix    anchor;          //the last fix passed on
+	geo_frame  frame;           //around the anchor
+	bool       holding;
+	gps_fix    candidate;       //the newest fix, not passed on yet
+	uint8_t    held;
+	int32_t    window[SIMPLIFY_WINDOW][2];  //x, y of the fixes since the anchor outside the tolerance
+} s_simplify = { .tolerance = SIMPLIFY_TOLERANCE * GEO_UNITS_PER_METRE };
+
+static simplify_stats s_stats;
+
+//sets the anchor and the scale of its frame
+static void pass_on(const gps_fix *fix)
+{
+	s_simplify.anchor = *fix;
+	geo_frame_init(&s_simplify.frame, (geo_point){ fix->lat, fix->lon });
+	s_simplify.held = 0;
+	s_stats.out++;
+	s_simplify.output(fix);
+}
+
+//position relative to the anchor, false when too far away to compare
+static bool project(const gps_fix *fix, int32_t *x, int32_t *y)
+{
+	return geo_project(&s_simplify.frame, (geo_point){ fix->lat, fix->lon }, x, y);
+}
+
+//whether the line from the anchor to x, y passes all fixes in the window within the tolerance
+static bool line_fits(int32_t x, int32_t y)
+{
+	int64_t tolerance = s_simplify.tolerance;
+	int64_t length2 = (int64_t)x * x + (int64_t)y * y;
+	int64_t length = geo_isqrt(length2);
+
+	for (uint8_t i = 0; i < s_simplify.held; i++)
+	{
+		int64_t px = s_simplify.window[i][0];
+		int64_t py = s_simplify.window[i][1];
+		int64_t along = px * x + py * y;
+
+		if (along <= 0 || along >= length2)
+		{
+			//beyond one end of the line, the nearest point is the anchor or the new fix
+			if (along > 0)
+			{
+				px -= x;
+				py -= y;
+			}
+			if (px * px + py * py > tolerance * tolerance)
+			{
+				return false;
+			}
+		}
+		else
+		{
+			int64_t across = px * y - py * x;
+			if ((across < 0 ? -across : across) > tolerance * length)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void track_simplify_init(FixHandler output)
+{
+	s_simplify.output = output;
+	s_simplify.started = false;
+	s_simplify.holding = false;
+	s_simplify.held = 0;
+	memset(&s_stats, 0, sizeof(s_stats));
+}
+
+void track_simplify_set_tolerance(uint16_t metres)
+{
+	s_simplify.tolerance = metres * GEO_UNITS_PER_METRE;
+}
+
+void track_simplify_add(const gps_fix *fix)
+{
+	int32_t x = 0, y = 0;
+
+	s_stats.in++;
+	if (!s_simplify.started)
+	{
+		s_simplify.started = true;
+		pass_on(fix);
+		return;
+	}
+
+	if (s_simplify.holding)
+	{
+		bool fits = fix->time - s_simplify.candidate.time <= SIMPLIFY_GAP &&
+			fix->time - s_simplify.anchor.time <= SIMPLIFY_MAX_GAP &&
+			s_simplify.held < SIMPLIFY_WINDOW && project(fix, &x, &y) && line_fits(x, y);
+		if (!fits)
+		{
+			pass_on(&s_simplify.candidate);
+		}
+	}
+	if (!project(fix, &x, &y))
+	{
+		//a jump of more than GEO_MAX_SPAN, nothing to compare with on either side
+		pass_on(fix);
+		s_simplify.holding = false;
+		return;
+	}
+
+	s_simplify.candidate = *fix;
+	s_simplify.holding = true;
+	if ((int64_t)x * x + (int64_t)y * y > (int64_t)s_simplify.tolerance * s_simplify.tolerance)
+	{
+		s_simplify.window[s_simplify.held][0] = x;
+		s_simplify.window[s_simplify.held][1] = y;
+		s_simplify.held++;
+	}
+}
+
+//passes on the fix held back, e.g. before the recording is stored for good
+void track_simplify_flush(void)
+{
+	if (s_simplify.holding)
+	{
+		s_simplify.holding = false;
+		pass_on(&s_simplify.candidate);
+	}
+}
+
+const simplify_stats *track_simplify_stats(void)
+{
+	return &s_stats;
+}
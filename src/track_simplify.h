@@ -0,0 +1,32 @@
+// track_simplify.h : drops recorded fixes that add nothing to the shape of the track
+//
+// An opening window line simplifier that runs as the fixes come in. The newest fix is held back
+// until the next one shows whether it is needed: a fix is only passed on once the straight line
+// from the last fix passed on to the new one would leave one of the fixes in between by more than
+// the tolerance. Fixes within the tolerance of the last fix passed on are never kept in the
+// window, so standing still collapses into the fix where the walker stopped and the one where it
+// moved on again, and memory stays bounded whatever the track looks like.
+
+#pragma once
+
+#include <pebble.h>
+#include "fix_log.h"
+
+#define SIMPLIFY_TOLERANCE  5     //m, default cross-track tolerance
+#define SIMPLIFY_WINDOW     32    //fixes the line is checked against at most
+#define SIMPLIFY_GAP        10    //s without fixes after which the track is broken
+#define SIMPLIFY_MAX_GAP    300   //s, fixes passed on are never further apart than this
+
+typedef void (*FixHandler)(const gps_fix *fix);
+
+typedef struct simplify_stats
+{
+	uint32_t in;
+	uint32_t out;
+} simplify_stats;
+
+void track_simplify_init(FixHandler output);
+void track_simplify_set_tolerance(uint16_t metres);
+void track_simplify_add(const gps_fix *fix);
+void track_simplify_flush(void);
+const simplify_stats *track_simplify_stats(void);
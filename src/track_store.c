@@ -0,0 +1,156 @@
+// track_store.c : append-only store of recorded fix blocks in persistent storage
+//
+// A chunk is written before the index that refers to it, so a crash in between leaves the
+// previous index intact and only loses that chunk. Once the ring is full a new chunk replaces
+// the oldest one; if the index didn't make it out, the oldest chunk key then holds data the
+// index doesn't expect, which is caught at start up by comparing its first fix time.
+
+#include "track_store.h"
+#include "persist_keys.h"
+
+#define TRACK_INDEX_VERSION     1
+
+typedef struct track_index
+{
+	uint8_t  version;
+	uint8_t  count;                         //chunks stored
+	uint8_t  first;                         //chunk key offset of the oldest one
+	uint8_t  reserved;
+	uint32_t start[TRACK_STORE_CHUNKS];     //time of the first fix, per chunk key offset
+} track_index;
+
+static track_index s_index;
+static uint32_t s_checkpoint_time;
+
+static uint8_t chunk_slot(uint16_t position)
+{
+	return (s_index.first + position) % TRACK_STORE_CHUNKS;
+}
+
+static bool write_index(void)
+{
+	int result = persist_write_data(PERSIST_KEY_TRACK_INDEX, &s_index, sizeof(s_index));
+	if (result < 0)
+	{
+		APP_LOG(APP_LOG_LEVEL_ERROR, "Writing the track index failed with %d", result);
+		return false;
+	}
+	return true;
+}
+
+//loads the index, checks it against the chunks and puts the stored track back into the fix log
+void track_store_init(void)
+{
+	uint8_t block[FIX_BLOCK_SIZE];
+
+	if (persist_read_data(PERSIST_KEY_TRACK_INDEX, &s_index, sizeof(s_index)) != sizeof(s_index) ||
+		s_index.version != TRACK_INDEX_VERSION || s_index.count > TRACK_STORE_CHUNKS ||
+		s_index.first >= TRACK_STORE_CHUNKS)
+	{
+		memset(&s_index, 0, sizeof(s_index));
+		s_index.version = TRACK_INDEX_VERSION;
+	}
+
+	//only the oldest chunk can have been overwritten without the index knowing
+	if (s_index.count == TRACK_STORE_CHUNKS && (!track_store_read(0, block) ||
+		fix_block_start(block) != s_index.start[s_index.first]))
+	{
+		APP_LOG(APP_LOG_LEVEL_WARNING, "Dropping track chunk overwritten before a crash");
+		s_index.first = chunk_slot(1);
+		s_index.count--;
+		write_index();
+	}
+
+	for (uint16_t i = 0; i < s_index.count; i++)
+	{
+		if (track_store_read(i, block))
+		{
+			fix_log_load_block(block, false);
+		}
+	}
+
+	//a tail that starts with the newest chunk was sealed, but not deleted before a crash
+	memset(block, 0, sizeof(block));
+	if (persist_read_data(PERSIST_KEY_TRACK_TAIL, block, sizeof(block)) > 0 &&
+		(!s_index.count || fix_block_start(block) != s_index.start[chunk_slot(s_index.count - 1)]))
+	{
+		fix_log_load_block(block, true);
+	}
+	s_checkpoint_time = time(NULL);
+
+	APP_LOG(APP_LOG_LEVEL_INFO, "Resumed track: %d chunks, %lu fixes", s_index.count, fix_log_count());
+}
+
+//stores a sealed block: one chunk write and one index write, nothing stored before is touched
+void track_store_append(const uint8_t *block)
+{
+	uint8_t slot = chunk_slot(s_index.count);
+	int result = persist_write_data(PERSIST_KEY_TRACK_CHUNK + slot, block, FIX_BLOCK_SIZE);
+	if (result < 0)
+	{
+		APP_LOG(APP_LOG_LEVEL_ERROR, "Writing track chunk %d failed with %d", slot, result);
+		return;
+	}
+
+	if (s_index.count == TRACK_STORE_CHUNKS)
+	{
+		s_index.first = chunk_slot(1);
+	}
+	else
+	{
+		s_index.count++;
+	}
+	s_index.start[slot] = fix_block_start(block);
+	if (write_index())
+	{
+		//the tail now duplicates the chunk
+		persist_delete(PERSIST_KEY_TRACK_TAIL);
+		s_checkpoint_time = time(NULL);
+	}
+}
+
+//writes the block still being filled, at most every TRACK_TAIL_CHECKPOINT seconds unless forced
+void track_store_checkpoint(const uint8_t *open_block, bool force)
+{
+	uint32_t now = time(NULL);
+
+	if (!open_block || (!force && now - s_checkpoint_time < TRACK_TAIL_CHECKPOINT))
+	{
+		return;
+	}
+	int result = persist_write_data(PERSIST_KEY_TRACK_TAIL, open_block, FIX_BLOCK_SIZE);
+	if (result < 0)
+	{
+		APP_LOG(APP_LOG_LEVEL_ERROR, "Writing the track tail failed with %d", result);
+		return;
+	}
+	s_checkpoint_time = now;
+}
+
+//forgets the stored track, e.g. when a new activity starts
+void track_store_clear(void)
+{
+	for (int i = 0; i < TRACK_STORE_CHUNKS; i++)
+	{
+		persist_delete(PERSIST_KEY_TRACK_CHUNK + i);
+	}
+	persist_delete(PERSIST_KEY_TRACK_TAIL);
+	memset(&s_index, 0, sizeof(s_index));
+	s_index.version = TRACK_INDEX_VERSION;
+	write_index();
+}
+
+uint16_t track_store_count(void)
+{
+	return s_index.count;
+}
+
+//reads the chunk at a position, 0 being the oldest
+bool track_store_read(uint16_t position, uint8_t *block)
+{
+	if (position >= s_index.count)
+	{
+		return false;
+	}
+	return persist_read_data(PERSIST_KEY_TRACK_CHUNK + chunk_slot(position), block, FIX_BLOCK_SIZE) == FIX_BLOCK_SIZE;
+}
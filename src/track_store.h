@@ -0,0 +1,22 @@
+// track_store.h : append-only store of recorded fix blocks in persistent storage
+//
+// Sealed fix_log blocks are written once each, whole, to a ring of chunk keys and never
+// rewritten; a small index record written after every chunk commits it. The block still being
+// filled is checkpointed to a tail key now and then, so that a restart, clean or not, loses at
+// most the fixes since the last checkpoint.
+
+#pragma once
+
+#include <pebble.h>
+#include "fix_log.h"
+
+#define TRACK_STORE_CHUNKS      10    //2.5 KB of the 4 KB persist budget, see persist_keys.h
+#define TRACK_TAIL_CHECKPOINT   60    //s between checkpoints of the open block
+
+void track_store_init(void);
+void track_store_append(const uint8_t *block);
+void track_store_checkpoint(const uint8_t *open_block, bool force);
+void track_store_clear(void);
+
+uint16_t track_store_count(void);
+bool track_store_read(uint16_t position, uint8_t *block);
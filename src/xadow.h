@@ -1,6 +1,9 @@
 // xadow.h : base definitions for xadow smartstrap hardware
 
+#pragma once
+
 #define min(a,b) (((a) < (b)) ? (a) : (b))
+#define max(a,b) (((a) > (b)) ? (a) : (b))
 
 
 #define SERVICE_BAT             0x2003
@@ -13,9 +16,132 @@
 #define ATTR_GPS_ALTITUDE       0x1001
 #define ATTR_GPS_FIX_QUALITY    0x0102    //SPEC
 #define ATTR_GPS_SATELLITES     0x0101    //spec
+#define ATTR_GPS_SNAPSHOT       0x1002    //composite fix, see xadow_gps_snapshot
+#define ATTR_GPS_NMEA           0x1003    //the receiver's nmea sentences as it sends them, see nmea.h
 
 #define SERVICE_NFC             0x1E01   //NFC is not in spec now, we chose id from experimentation range
 #define ATTR_NFC_GET_UID        0x1001
 #define ATTR_NFC_READ_NDEF      0x1002
 #define ATTR_NFC_WRITE_NDEF     0x1003
-#define ATTR_NFC_ERASE_NDEF     0x1004
\ No newline at end of file
+#define ATTR_NFC_ERASE_NDEF     0x1004
+
+//composite gps attribute: everything the five per-attribute reads return, taken from
+//the same fix, in a single frame (little endian, no padding)
+//straps that don't know it reply SmartstrapResultAttributeUnsupported
+typedef struct __attribute__((__packed__)) xadow_gps_snapshot
+{
+	int32_t  lat;           //1/10^7 degrees, as ATTR_GPS_LOCATION
+	int32_t  lon;
+	uint16_t speed;         //1/100 m/s, as ATTR_GPS_SPEED
+	uint16_t alt;           //1/100 m, as ATTR_GPS_ALTITUDE
+	uint8_t  fix;           //as ATTR_GPS_FIX_QUALITY
+	uint8_t  sat;           //as ATTR_GPS_SATELLITES
+	uint32_t timestamp;     //strap uptime in ms when the fix was taken
+} xadow_gps_snapshot;
+
+//ndef transfers: the tag's ndef message moves in chunks of at most XADOW_NDEF_CHUNK bytes, each
+//one a write of this header to the attribute (for ATTR_NFC_WRITE_NDEF followed by the data)
+//ATTR_NFC_READ_NDEF is written with request_read set, the strap replies with the header for the
+//chunk it sends followed by its data; total is 0 in a read request
+//ATTR_NFC_WRITE_NDEF chunks go out in order, the strap writes the tag once it has total bytes
+//ATTR_NFC_ERASE_NDEF takes a bare header and leaves an empty ndef record on the tag
+#define XADOW_NDEF_CHUNK        64
+
+typedef struct __attribute__((__packed__)) xadow_ndef_chunk
+{
+	uint16_t offset;        //of the chunk in the ndef message
+	uint16_t total;         //length of the whole message
+	uint8_t  length;        //data bytes in the chunk, for a read request the most the watch takes
+} xadow_ndef_chunk;
+
+//bulk transfers on the raw data service: the strap logs its fixes, and after a gap in its own
+//track the watch fetches the ones it missed, e.g. while the strap was unplugged
+//the watch writes a xadow_bulk_request with request_read set, the strap replies with as many
+//frames as fit: first the ones asked for again, then up to limit new ones from next on
+//a frame is a xadow_bulk_frame header, count snapshots and a crc16 (ccitt, over the header and
+//snapshots); frame n holds fixes n * XADOW_BULK_FIXES onward of those taken after since
+#define XADOW_BULK_FIXES        3       //snapshots in a full frame
+#define XADOW_BULK_MISSING      4       //frames a request can ask for again
+#define XADOW_BULK_LAST         0x01    //frame flag: the strap has no fixes after this frame yet
+#define XADOW_BULK_FRAME_SIZE(count) (sizeof(xadow_bulk_frame) + (count) * sizeof(xadow_gps_snapshot) + 2)
+
+typedef struct __attribute__((__packed__)) xadow_bulk_request
+{
+	uint32_t since;         //strap uptime in ms, the log starts with the first fix after it
+	uint16_t next;          //first frame not asked for yet
+	uint8_t  limit;         //new frames the watch takes
+	uint8_t  missing_count;
+	uint16_t missing[XADOW_BULK_MISSING];
+} xadow_bulk_request;
+
+typedef struct __attribute__((__packed__)) xadow_bulk_frame
+{
+	uint16_t seq;
+	uint8_t  count;         //snapshots in the frame
+	uint8_t  flags;
+} xadow_bulk_frame;
+
+#define XADOW_BULK_READ_FRAMES  4       //frames in a reply, the most the watch asks for
+
+typedef struct xadow_bulk_read
+{
+	uint8_t frames[XADOW_BULK_READ_FRAMES * XADOW_BULK_FRAME_SIZE(XADOW_BULK_FIXES)];
+} xadow_bulk_read;
+
+//payloads of the other attributes
+typedef struct __attribute__((__packed__)) xadow_gps_location
+{
+	int32_t  lat;           //1/10^7 degrees, latitude first
+	int32_t  lon;
+} xadow_gps_location;
+
+#define XADOW_NMEA_READ_SIZE    512     //a second of sentences in one read
+
+typedef struct xadow_nmea_read
+{
+	uint8_t text[XADOW_NMEA_READ_SIZE];
+} xadow_nmea_read;
+
+#define XADOW_UID_MAX           10      //bytes, the longest iso 14443 uid
+
+typedef struct xadow_nfc_uid
+{
+	uint8_t uid[XADOW_UID_MAX];     //as many bytes as the tag has, none when no tag is in range
+} xadow_nfc_uid;
+
+typedef struct __attribute__((__packed__)) xadow_ndef_buffer
+{
+	xadow_ndef_chunk chunk;
+	uint8_t          data[XADOW_NDEF_CHUNK];
+} xadow_ndef_buffer;
+
+//every attribute the app uses, one line each, in the order they are polled in when equally due:
+//  X(kind, name, service, attribute, payload type, refresh interval in ms or 0 for on request only,
+//    priority)
+//The payload type sizes the attribute's buffer. A VALUE reply is decoded once it holds a whole
+//payload, which is kept; a STREAM reply is handed on as it came, however long; a WRITE attribute
+//is only ever written. The app has a decode_<name> for every attribute that isn't WRITE, and
+//xadow_attribute numbers the attributes in this order.
+#define XADOW_ATTRIBUTES(X) \
+	X(WRITE,  BAT_CHG,         SERVICE_BAT, ATTR_BAT_CHG,           uint8_t,            0,     0) \
+	X(VALUE,  BAT_V,           SERVICE_BAT, ATTR_BAT_V,             uint16_t,           60000, 1) \
+	X(VALUE,  GPS_SNAPSHOT,    SERVICE_GPS, ATTR_GPS_SNAPSHOT,      xadow_gps_snapshot, 1000,  4) \
+	X(STREAM, GPS_NMEA,        SERVICE_GPS, ATTR_GPS_NMEA,          xadow_nmea_read,    1000,  4) \
+	X(VALUE,  GPS_LOCATION,    SERVICE_GPS, ATTR_GPS_LOCATION,      xadow_gps_location, 1000,  4) \
+	X(VALUE,  GPS_SPEED,       SERVICE_GPS, ATTR_GPS_SPEED,         uint16_t,           1000,  3) \
+	X(VALUE,  GPS_ALTITUDE,    SERVICE_GPS, ATTR_GPS_ALTITUDE,      uint16_t,           2000,  2) \
+	X(VALUE,  GPS_FIX_QUALITY, SERVICE_GPS, ATTR_GPS_FIX_QUALITY,   uint8_t,            5000,  2) \
+	X(VALUE,  GPS_SATELLITES,  SERVICE_GPS, ATTR_GPS_SATELLITES,    uint8_t,            5000,  1) \
+	X(STREAM, NFC_UID,         SERVICE_NFC, ATTR_NFC_GET_UID,       xadow_nfc_uid,      0,     8) \
+	X(STREAM, NFC_READ_NDEF,   SERVICE_NFC, ATTR_NFC_READ_NDEF,     xadow_ndef_buffer,  0,     2) \
+	X(WRITE,  NFC_WRITE_NDEF,  SERVICE_NFC, ATTR_NFC_WRITE_NDEF,    xadow_ndef_buffer,  0,     2) \
+	X(WRITE,  NFC_ERASE_NDEF,  SERVICE_NFC, ATTR_NFC_ERASE_NDEF,    xadow_ndef_buffer,  0,     2) \
+	X(STREAM, RAW,             SMARTSTRAP_RAW_DATA_SERVICE_ID, SMARTSTRAP_RAW_DATA_ATTRIBUTE_ID, xadow_bulk_read, 0, 3)
+
+#define XADOW_ATTRIBUTE_ENUM(kind, name, service, attribute, type, interval, priority) XADOW_##name,
+
+enum xadow_attribute
+{
+	XADOW_ATTRIBUTES(XADOW_ATTRIBUTE_ENUM)
+	XADOW_NUM_ATTRIBUTES
+};
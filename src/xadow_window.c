@@ -1,57 +1,236 @@
 #include <pebble.h>
 #include <math.h>
+#include "bus_stats.h"
+#include "diagnostics_window.h"
 #include "dialog_choice_window.h"
+#include "fix_log.h"
+#include "geo.h"
+#include "bulk_transfer.h"
+#include "ndef_transfer.h"
+#include "nmea.h"
+#include "persist_keys.h"
+#include "tag_registry.h"
+#include "health_cache.h"
+#include "kalman.h"
+#include "track_export.h"
+#include "track_fusion.h"
+#include "track_simplify.h"
+#include "track_store.h"
 #include "xadow.h"
 
 static Window *s_main_window;
 static Layer *s_window_layer, *s_dots_layer, *s_progress_layer, *s_average_layer;
 static TextLayer *s_time_layer, *s_step_layer;
 static TextLayer *s_conn_status_layer;
-static TextLayer *s_data_layer;
+
+//polling: every endpoint has a target refresh interval and a priority; the most overdue
+//endpoint (overdue time weighted by priority) is read next, and endpoints that keep
+//returning the same value are read less and less often until the value changes again
+#define IDLE_READS_PER_STEP     4     //identical reads before the interval is doubled
+#define IDLE_MAX_SHIFT          3     //up to 8 times the target interval
+#define MAX_POLL_WAIT           1000  //ms, so that services coming back are noticed quickly
+#define NOTIFY_WATCHDOG_POLL    30000 //ms, polling interval once the strap notifies changes itself
+
+//reads are pipelined: the next read goes out as soon as the firmware accepts it, one per
+//independent service, up to as many in parallel as the firmware has been seen to take
+#define MAX_PIPELINE_DEPTH      3     //BAT, GPS and NFC are independent services
+#define PIPELINE_PROBE_READS    64    //reads at a lowered depth before trying one more again
+#define READ_WATCHDOG_SLACK     250   //ms past its timeout, a read that got no reply at all is given up
+
+//per-endpoint round trip estimate as in tcp (rfc 6298): the strap timeout for a read is the
+//smoothed rtt plus four times its mean deviation, doubled after every timeout until a reply
+//comes in again
+#define RTO_INITIAL             500   //ms, until the first reply
+#define RTO_MIN                 100   //ms
+#define RTO_MAX                 2000  //ms
+
+//connection and polling run as one state machine with a single timer: every event (the timer,
+//a reply, a notification, an availability change) runs link_run(), which does whatever is due
+//and re-arms that one timer for the next thing that will be
+#define LINK_RETRY_BUSY         100   //ms, the firmware refused a read
+#define LINK_RETRY_ERROR        1000  //ms, any other read error
+#define LINK_BACKOFF_MIN        250   //ms, first attempt to reconnect
+#define LINK_BACKOFF_MAX_SHIFT  6     //up to 16 s between attempts
 
 struct endpoint
 {
 	SmartstrapAttribute *attr;
 	bool                 available;
-}readable_end_points[20];
-
-static int num_endpoints = 0;
-static int cur_endpoint = 0;
+	bool                 enabled;    //false while superseded, e.g. per-attribute gps reads behind the snapshot
+	uint32_t             interval;   //target refresh interval in ms
+	uint8_t              priority;
+	uint8_t              compare_len;//leading payload bytes that make up the value, 0 for all
+	uint8_t              unchanged;  //consecutive reads that returned the same value
+	uint32_t             last_read;  //ms, when the last read was issued
+	uint32_t             hash;       //of the last value read
+	bool                 pending;    //read in flight
+	bool                 requested;  //read as soon as possible, e.g. after a notification
+	bool                 notifying;  //the strap notifies changes, polling is only a watchdog
+	uint16_t             srtt;       //smoothed round trip time in ms/8, 0 until the first reply
+	uint16_t             rttvar;     //its mean deviation in ms/4
+	uint16_t             rto;        //ms, strap timeout for reads of this endpoint
+	//requests other than plain reads, e.g. the chunks of an ndef transfer: whether one is due,
+	//sending it, and whether the write that went out completes it; NULL for a plain read
+	bool               (*due)(SmartstrapAttribute *attr);
+	SmartstrapResult   (*issue)(SmartstrapAttribute *attr);
+	bool               (*written)(SmartstrapAttribute *attr, SmartstrapResult result);
+}readable_end_points[XADOW_NUM_ATTRIBUTES];
+
+//one endpoint per attribute of the schema in xadow.h, in its order
+#define ENDPOINT(name)          (&readable_end_points[XADOW_##name])
+
+//replies are dispatched through a hash of their service and attribute ids, with room for twice
+//as many attributes as there are
+#define DISPATCH_BITS           5
+static int8_t s_dispatch[1 << DISPATCH_BITS];   //endpoint index + 1, 0 for an empty slot
+
+//where the gps values come from: the receiver's sentences streamed and parsed on the watch when
+//asked for, else the snapshot, else the five attributes of older strap firmware
+enum gps_source
+{
+	GPS_SOURCE_NMEA,
+	GPS_SOURCE_SNAPSHOT,
+	GPS_SOURCE_ATTRIBUTES,
+};
 
-static SmartstrapAttribute *s_raw_attribute;
-static SmartstrapAttribute *s_attr_bat_chg;
-static SmartstrapAttribute *s_attr_nfc_uid;
+static bool gps_nmea_mode;
+static nmea_parser s_nmea;
 
 static int cnt_dot = 0;
-static int cnt_fail = 0;
 
-static uint8_t s_buffer[256];
 static char connection_text[20];
 static uint8_t connected = 0;
-static uint8_t read_req_pending = 0;
-AppTimer *p_timer;
+
+//read pipeline
+static int in_flight = 0;
+static int pipeline_limit = MAX_PIPELINE_DEPTH;
+static uint32_t idle_since = 0;
+static uint16_t strap_timeout = 0;  //as last passed to smartstrap_set_timeout
+static struct
+{
+	uint32_t reads;
+	uint32_t idle_ms;       //connected with no read in flight
+	uint16_t busy;          //reads refused because the pipeline was deeper than the firmware allows
+	uint8_t  max_depth;
+} pipeline_stats;
+
+enum link_state
+{
+	LINK_CONNECTING,    //waiting for the raw data service, retried with backoff
+	LINK_POLLING,       //connected, reading whatever is due
+	LINK_HOLDING,       //connected, but the firmware refused the last read
+};
+
+static struct
+{
+	enum link_state state;
+	AppTimer *timer;
+	uint32_t  hold_until;   //ms, end of LINK_HOLDING
+	uint8_t   attempts;     //connection checks that failed in a row
+	uint8_t   chains;       //timers armed right now, anything but 0 or 1 is a bug
+	uint8_t   max_chains;
+	uint16_t  reconnects;
+} link;
 
 //gps data
 static uint16_t vbat, speed, alt;
 static int32_t lat, lon;
 static uint8_t fix, sat;
-static char str_vbat[16];
-static char str_lat[16];
-static char str_lon[16];
-static char str_speed[16];
-static char str_alt[16];
+static uint16_t hdop;   //1/100, only the nmea stream has it, 0 otherwise
+static uint32_t gps_timestamp;
+
+//recording
+static uint32_t recorded_time;  //s, of the last fix appended to the fix log
+static kalman_filter smoother;
+static gps_fix smoothed;        //the last fix recorded, as filtered; shown in place of the raw values
+
+//fetching the strap's log of fixes after a gap in the track, once a connection
+#define BACKLOG_MIN_GAP     5       //s
+static struct
+{
+	bool     checked;       //since the strap connected
+	uint32_t anchor_time;   //s, a fix's time on the watch
+	uint32_t anchor_stamp;  //ms, and on the strap
+	uint32_t started;       //ms
+	uint32_t fixes;         //fetched before this one
+	uint32_t took;          //ms, of the last fetch
+} backlog;
+static geo_odometer odometer;
 
 //nfc data
-static uint8_t nfc_valid_tagid = 0;
 static char tagid[16];
+static uint8_t tagid_length;
+static uint8_t tag_checkpoint;  //of the tag in range, 0 for none
+
+//course splits, the last checkpoint passed
+static struct
+{
+	uint8_t  checkpoint;
+	uint32_t time;
+} split;
 
-static void check_connection(void *context);
-static void prv_send_read_request(void *context);
+//data screen, one text layer per field so that a new value only redraws its own field
+enum data_field
+{
+	FIELD_VBAT,
+	FIELD_FIX,
+	FIELD_LAT,
+	FIELD_LON,
+	FIELD_SPEED,
+	FIELD_ALT,
+	FIELD_SAT,
+	FIELD_DISTANCE,
+	FIELD_PACE,
+	FIELD_TAG_LABEL,
+	FIELD_TAG,
+	FIELD_TAG_TEXT,
+	NUM_FIELDS
+};
+
+#define FIELD_ROW_HEIGHT  20
+#define FIELD_TEXT_SIZE   24
+
+static const struct
+{
+	uint8_t row;
+	uint8_t x;
+	uint8_t w;
+	const char *label;
+} data_fields[NUM_FIELDS] = {
+	[FIELD_VBAT]      = { 0, 0,  72,  "VBAT: " },
+	[FIELD_FIX]       = { 0, 72, 72,  "fix: " },
+	[FIELD_LAT]       = { 1, 0,  144, "lat: " },
+	[FIELD_LON]       = { 2, 0,  144, "lon: " },
+	[FIELD_SPEED]     = { 3, 0,  72,  "vel: " },
+	[FIELD_ALT]       = { 3, 72, 72,  "alt: " },
+	[FIELD_SAT]       = { 4, 0,  144, "sat. in view: " },
+	[FIELD_DISTANCE]  = { 5, 0,  72,  "" },
+	[FIELD_PACE]      = { 5, 72, 72,  "" },
+	[FIELD_TAG_LABEL] = { 6, 0,  144, "NFC TAG ID:" },
+	[FIELD_TAG]       = { 7, 0,  80,  "" },
+	[FIELD_TAG_TEXT]  = { 7, 80, 64,  "" },
+};
+
+static Layer *s_data_layer;
+static TextLayer *s_field_layers[NUM_FIELDS];
+static char s_field_text[NUM_FIELDS][FIELD_TEXT_SIZE];
+static uint32_t s_dirty_fields = (1 << NUM_FIELDS) - 1;
+
+//text of the first text record on the tag
+static ndef_parser s_ndef_parser;
+static char s_tag_text[FIELD_TEXT_SIZE];
+static uint8_t s_tag_text_skip;         //status and language bytes at the start of its payload
+static int16_t s_tag_text_record;       //its index, -1 until one is seen
+
+static void link_run(void);
+static void read_completed(struct endpoint *ep);
+static void set_gps_source(enum gps_source source);
 static void connection_status_text_show();
 static void connection_status_text_hide();
 static void data_text_show();
 static void data_text_hide();
-void format_number(int32_t input, int input_precision, char *output, int output_precision);
+static char *format_digits(char *output, uint32_t value, int width);
+char *format_number(int32_t input, int input_precision, char *output, int output_precision);
 
 // health
 static char s_current_steps_buffer[16];
@@ -64,6 +243,18 @@ static char s_current_time_buffer[8];
 GColor color_loser;
 GColor color_winner;
 
+// the dot ring never changes: the dot is drawn once into a small bitmap and its positions are
+// worked out once, a frame only blits it
+#define NUM_DOTS 12
+#define DOT_RADIUS 2
+static GBitmap *s_dot_bitmap;
+static GPoint s_dot_positions[NUM_DOTS];
+
+// arcs as last drawn, in whole degrees so that a step that moves them by less than a pixel
+// doesn't redraw the window
+static int s_progress_degrees = -1, s_average_degrees = -1;
+static bool s_progress_winning;
+
 // is health step data available
 static bool step_data_is_available() {
 	return HealthServiceAccessibilityMaskAvailable &
@@ -71,25 +262,6 @@ static bool step_data_is_available() {
 			time_start_of_today(), time(NULL));
 }
 
-// Daily step goal
-static void get_step_goal() {
-	const time_t start = time_start_of_today();
-	const time_t end = start + SECONDS_PER_DAY;
-	s_step_goal = (int)health_service_sum_averaged(
-		HealthMetricStepCount, start, end, HealthServiceTimeScopeDaily);
-}
-
-static void get_step_count() {
-	s_step_count = (int)health_service_sum_today(HealthMetricStepCount);
-}
-
-static void get_step_average() {
-	const time_t start = time_start_of_today();
-	const time_t end = time(NULL);
-	s_step_average = (int)health_service_sum_averaged(HealthMetricStepCount,
-		start, end, HealthServiceTimeScopeDaily);
-}
-
 static void display_step_count() {
 	int thousands = s_step_count / 1000;
 	int hundreds = s_step_count % 1000;
@@ -106,20 +278,44 @@ static void display_step_count() {
 	text_layer_set_text(s_step_layer, s_current_steps_buffer);
 }
 
-static void health_handler(HealthEventType event, void *context) {
-	if (event == HealthEventSignificantUpdate) {
-		get_step_goal();
+// steps out of the daily goal, in degrees of a full turn
+static int step_degrees(int steps) {
+	if (s_step_goal < 1) {
+		return 0;
 	}
+	return min(360 * steps / s_step_goal, 360);
+}
 
-	if (event != HealthEventSleepUpdate) {
-		get_step_count();
-		get_step_average();
-		display_step_count();
+static void update_rings() {
+	int progress = step_degrees(s_step_count);
+	bool winning = s_step_count >= s_step_average;
+	if (progress != s_progress_degrees || winning != s_progress_winning) {
+		s_progress_degrees = progress;
+		s_progress_winning = winning;
 		layer_mark_dirty(s_progress_layer);
+	}
+
+	int average = s_step_average < 1 ? -1 : step_degrees(s_step_average);
+	if (average != s_average_degrees) {
+		s_average_degrees = average;
 		layer_mark_dirty(s_average_layer);
 	}
 }
 
+static void health_handler(HealthEventType event, void *context) {
+	if (event != HealthEventSleepUpdate) {
+		int steps = s_step_count;
+		health_cache_update(event == HealthEventSignificantUpdate);
+		s_step_goal = health_cache_goal();
+		s_step_count = health_cache_steps();
+		s_step_average = health_cache_average();
+		if (s_step_count != steps || event == HealthEventSignificantUpdate) {
+			display_step_count();
+		}
+		update_rings();
+	}
+}
+
 static void tick_handler(struct tm *tick_time, TimeUnits changed) {
 	strftime(s_current_time_buffer, sizeof(s_current_time_buffer),
 		clock_is_24h_style() ? "%H:%M" : "%l:%M", tick_time);
@@ -127,44 +323,77 @@ static void tick_handler(struct tm *tick_time, TimeUnits changed) {
 	text_layer_set_text(s_time_layer, s_current_time_buffer);
 }
 
-static void dots_layer_update_proc(Layer *layer, GContext *ctx) {
-	const GRect inset = grect_inset(layer_get_bounds(layer), GEdgeInsets(6));
+static void create_dots(GRect bounds) {
+	const GRect inset = grect_inset(bounds, GEdgeInsets(6));
+	for (int i = 0; i < NUM_DOTS; i++) {
+		s_dot_positions[i] = gpoint_from_polar(inset, GOvalScaleModeFitCircle,
+			DEG_TO_TRIGANGLE(i * 360 / NUM_DOTS));
+	}
+
+	// a filled circle of radius 2 on a transparent background
+	const int size = 2 * DOT_RADIUS + 1;
+	s_dot_bitmap = gbitmap_create_blank(GSize(size, size), GBitmapFormat8Bit);
+	if (!s_dot_bitmap) {
+		return;
+	}
+	uint8_t *data = gbitmap_get_data(s_dot_bitmap);
+	const uint16_t row_size = gbitmap_get_bytes_per_row(s_dot_bitmap);
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			int dx = x - DOT_RADIUS, dy = y - DOT_RADIUS;
+			bool inside = dx * dx + dy * dy <= DOT_RADIUS * DOT_RADIUS + 1;
+			data[y * row_size + x] = (inside ? GColorDarkGray : GColorClear).argb;
+		}
+	}
+}
 
-	const int num_dots = 12;
-	for (int i = 0; i < num_dots; i++) {
-		GPoint pos = gpoint_from_polar(inset, GOvalScaleModeFitCircle,
-			DEG_TO_TRIGANGLE(i * 360 / num_dots));
+static void dots_layer_update_proc(Layer *layer, GContext *ctx) {
+	if (!s_dot_bitmap) {
 		graphics_context_set_fill_color(ctx, GColorDarkGray);
-		graphics_fill_circle(ctx, pos, 2);
+		for (int i = 0; i < NUM_DOTS; i++) {
+			graphics_fill_circle(ctx, s_dot_positions[i], DOT_RADIUS);
+		}
+		return;
+	}
+
+	graphics_context_set_compositing_mode(ctx, GCompOpSet);
+	for (int i = 0; i < NUM_DOTS; i++) {
+		graphics_draw_bitmap_in_rect(ctx, s_dot_bitmap, GRect(s_dot_positions[i].x - DOT_RADIUS,
+			s_dot_positions[i].y - DOT_RADIUS, 2 * DOT_RADIUS + 1, 2 * DOT_RADIUS + 1));
 	}
 }
 
 static void progress_layer_update_proc(Layer *layer, GContext *ctx) {
+	if (s_progress_degrees < 1) {
+		return;
+	}
+
 	const GRect inset = grect_inset(layer_get_bounds(layer), GEdgeInsets(2));
 
 	graphics_context_set_fill_color(ctx,
-		s_step_count >= s_step_average ? color_winner : color_loser);
+		s_progress_winning ? color_winner : color_loser);
 
 	graphics_fill_radial(ctx, inset, GOvalScaleModeFitCircle, 12,
 		DEG_TO_TRIGANGLE(0),
-		DEG_TO_TRIGANGLE(360 * (s_step_count / s_step_goal)));
+		DEG_TO_TRIGANGLE(s_progress_degrees));
 }
 
 static void average_layer_update_proc(Layer *layer, GContext *ctx) {
-	if (s_step_average < 1) {
+	if (s_average_degrees < 0) {
 		return;
 	}
 
 	const GRect inset = grect_inset(layer_get_bounds(layer), GEdgeInsets(2));
 	graphics_context_set_fill_color(ctx, GColorYellow);
 
-	int trigangle = DEG_TO_TRIGANGLE(360 * s_step_average / s_step_goal);
+	int trigangle = DEG_TO_TRIGANGLE(s_average_degrees);
 	int line_width_trigangle = 1000;
 	// draw a very narrow radial (it's just a line)
 	graphics_fill_radial(ctx, inset, GOvalScaleModeFitCircle, 12,
 		trigangle - line_width_trigangle, trigangle);
 }
 
+#if !BUS_TRACE
 static char* smartstrap_result_to_string(SmartstrapResult result) {
 	switch (result) {
 	case SmartstrapResultOk:
@@ -185,203 +414,1134 @@ static char* smartstrap_result_to_string(SmartstrapResult result) {
 		return "Not a SmartstrapResult value!";
 	}
 }
+#endif
+
+static void update_connection_status_text(void)
+{
+	if (connected) {
+		memcpy(connection_text, "Connected", 9);
+		connection_text[9] = '\0';
+		text_layer_set_text(s_conn_status_layer, connection_text);
+		return;
+	}
+
+	if (++cnt_dot > 3) {
+		cnt_dot = 1;
+	}
+
+	memcpy(connection_text, "Connecting\n...", 11 + cnt_dot);
+	connection_text[11 + cnt_dot] = '\0';
+	text_layer_set_text(s_conn_status_layer, connection_text);
+}
+
+static void mark_field(enum data_field field)
+{
+	s_dirty_fields |= 1 << field;
+}
+
+static char *append_text(char *output, const char *text)
+{
+	while (*text)
+	{
+		*(output++) = *(text++);
+	}
+	*output = '\0';
+	return output;
+}
+
+static char *append_hex(char *output, uint8_t value)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	*(output++) = digits[value >> 4];
+	*(output++) = digits[value & 0xf];
+	*output = '\0';
+	return output;
+}
+
+static void format_field(enum data_field field, char *output)
+{
+	output = append_text(output, data_fields[field].label);
+
+	switch (field)
+	{
+	case FIELD_VBAT:
+		format_number(vbat, 2, output, 1);
+		break;
+	case FIELD_FIX:
+		format_digits(output, fix, 1);
+		break;
+	case FIELD_LAT:
+		format_number(smoother.started ? smoothed.lat : lat, 7, output, 4);
+		break;
+	case FIELD_LON:
+		format_number(smoother.started ? smoothed.lon : lon, 7, output, 4);
+		break;
+	case FIELD_SPEED:
+		format_number(smoother.started ? smoothed.speed : speed, 2, output, 2);
+		break;
+	case FIELD_ALT:
+		format_number(smoother.started ? smoothed.alt : alt, 2, output, 2);
+		break;
+	case FIELD_SAT:
+		format_digits(output, sat, 1);
+		break;
+	case FIELD_DISTANCE:
+		output = format_number(odometer.distance / 1000, 2, output, 2);
+		append_text(output, " km");
+		break;
+	case FIELD_PACE:
+	{
+		uint32_t pace = geo_odometer_pace(&odometer);
+		if (pace && pace < 100 * 60)
+		{
+			output = format_digits(output, pace / 60, 1);
+			*(output++) = ':';
+			output = format_digits(output, pace % 60, 2);
+			append_text(output, " /km");
+		}
+		else
+		{
+			append_text(output, "- /km");
+		}
+		break;
+	}
+	case FIELD_TAG_LABEL:
+		if (tag_checkpoint)
+		{
+			output = append_text(output, " CP ");
+			output = format_digits(output, tag_checkpoint, 0);
+		}
+		break;
+	case FIELD_TAG:
+		for (int i = 0; i < 4; i++)
+		{
+			*(output++) = ' ';
+			output = append_hex(output, tagid[i]);
+		}
+		break;
+	case FIELD_TAG_TEXT:
+		append_text(output, s_tag_text);
+		break;
+	default:
+		break;
+	}
+}
+
+//reformats the fields whose values changed, and only hands the ones that now read differently
+//to their layers
+static void update_data_text(void)
+{
+	char text[FIELD_TEXT_SIZE];
+
+	if (!connected) {
+		return;
+	}
+
+	for (int field = 0; field < NUM_FIELDS; field++)
+	{
+		if (!(s_dirty_fields & (1 << field)))
+		{
+			continue;
+		}
+		format_field(field, text);
+		if (strcmp(text, s_field_text[field]) != 0)
+		{
+			strcpy(s_field_text[field], text);
+			text_layer_set_text(s_field_layers[field], s_field_text[field]);
+		}
+	}
+	s_dirty_fields = 0;
+}
+
+static uint32_t now_ms(void)
+{
+	time_t sec;
+	uint16_t ms;
+	time_ms(&sec, &ms);
+	return (uint32_t)sec * 1000 + ms;
+}
+
+//a bus event as a log line, or with BUS_TRACE as a record in the trace ring
+static void bus_event(enum bus_event event, SmartstrapAttribute *attr, SmartstrapResult result)
+{
+	uint16_t service_id = smartstrap_attribute_get_service_id(attr);
+	uint16_t attr_id = smartstrap_attribute_get_attribute_id(attr);
+
+#if BUS_TRACE
+	bus_trace(event, service_id, attr_id, result, now_ms());
+#else
+	switch (event)
+	{
+	case BUS_READ_REFUSED:
+		APP_LOG(APP_LOG_LEVEL_ERROR, "Read of %04x failed with result: %s", attr_id, smartstrap_result_to_string(result));
+		break;
+	case BUS_READ_DONE:
+		//every reply goes through here, only the failed ones are worth a line
+		if (result != SmartstrapResultOk)
+		{
+			APP_LOG(APP_LOG_LEVEL_DEBUG, "did_read(%04x, %04x, %s)", service_id, attr_id, smartstrap_result_to_string(result));
+		}
+		break;
+	case BUS_READ_LOST:
+		APP_LOG(APP_LOG_LEVEL_ERROR, "Read of %04x got no reply", attr_id);
+		break;
+	case BUS_WRITE_DONE:
+		if (result != SmartstrapResultOk)
+		{
+			APP_LOG(APP_LOG_LEVEL_DEBUG, "did_write(%04x, %04x, %s)", service_id, attr_id, smartstrap_result_to_string(result));
+		}
+		break;
+	case BUS_NOTIFIED:
+		APP_LOG(APP_LOG_LEVEL_DEBUG, "notified(%04x, %04x)", service_id, attr_id);
+		break;
+	default:
+		break;
+	}
+#endif
+}
+
+static uint32_t dispatch_slot(uint16_t service_id, uint16_t attr_id)
+{
+	return (((uint32_t)service_id << 16 | attr_id) * 2654435761u) >> (32 - DISPATCH_BITS);
+}
+
+static struct endpoint *find_endpoint(SmartstrapAttribute *attr)
+{
+	uint32_t slot = dispatch_slot(smartstrap_attribute_get_service_id(attr), smartstrap_attribute_get_attribute_id(attr));
+
+	for (; s_dispatch[slot]; slot = (slot + 1) & ((1 << DISPATCH_BITS) - 1))
+	{
+		struct endpoint *ep = &readable_end_points[s_dispatch[slot] - 1];
+		if (ep->attr == attr)
+		{
+			return ep;
+		}
+	}
+	return NULL;
+}
+
+static uint32_t endpoint_interval(const struct endpoint *ep)
+{
+	uint32_t interval = ep->interval << min(ep->unchanged / IDLE_READS_PER_STEP, IDLE_MAX_SHIFT);
+	if (ep->notifying && interval < NOTIFY_WATCHDOG_POLL)
+	{
+		interval = NOTIFY_WATCHDOG_POLL;
+	}
+	return interval;
+}
+
+//remembers whether the value changed, which stretches or resets the refresh interval
+static void endpoint_track_value(struct endpoint *ep, const uint8_t *data, size_t length)
+{
+	if (ep->compare_len && length > ep->compare_len)
+	{
+		length = ep->compare_len;
+	}
+
+	//fnv-1a
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	if (hash == ep->hash)
+	{
+		if (ep->unchanged < 0xff) ep->unchanged++;
+	}
+	else
+	{
+		ep->hash = hash;
+		ep->unchanged = 0;
+	}
+}
+
+static void endpoint_rtt_sample(struct endpoint *ep, uint32_t rtt)
+{
+	rtt = min(max(rtt, 1), RTO_MAX);
+	if (!ep->srtt)
+	{
+		ep->srtt = rtt << 3;
+		ep->rttvar = rtt << 1;
+	}
+	else
+	{
+		//srtt += (rtt - srtt) / 8, rttvar += (|rtt - srtt| - rttvar) / 4, both kept scaled
+		int32_t err = (int32_t)rtt - (ep->srtt >> 3);
+		ep->srtt += err;
+		ep->rttvar += (err < 0 ? -err : err) - (ep->rttvar >> 2);
+	}
+	ep->rto = min(max((ep->srtt >> 3) + ep->rttvar, RTO_MIN), RTO_MAX);
+}
+
+static void endpoint_rtt_timeout(struct endpoint *ep)
+{
+	ep->rto = min(ep->rto * 2, RTO_MAX);
+}
+
+//fixes the simplifier keeps go into the fix log
+static void store_fix(const gps_fix *fix)
+{
+	fix_log_append(fix);
+	track_store_checkpoint(fix_log_open_block(), false);
+}
+
+//the receiver's jitter would add up in the distance and the climb, so the track gets the filtered fix
+static void record(const gps_fix *entry, uint16_t dop)
+{
+	smoothed = *entry;
+	kalman_add(&smoother, &smoothed, dop);
+	recorded_time = entry->time;
+	geo_odometer_add(&odometer, smoothed.time, (geo_point){ smoothed.lat, smoothed.lon });
+	mark_field(FIELD_LAT);
+	mark_field(FIELD_LON);
+	mark_field(FIELD_SPEED);
+	mark_field(FIELD_ALT);
+	mark_field(FIELD_DISTANCE);
+	mark_field(FIELD_PACE);
+	track_simplify_add(&smoothed);
+}
+
+//drops the recorded track, stored and in memory, and starts a new one with the next fix
+static void activity_restart(void)
+{
+	track_simplify_init(store_fix);
+	fix_log_clear();
+	track_store_clear();
+	geo_odometer_reset(&odometer);
+	kalman_reset(&smoother);
+	memset(&split, 0, sizeof(split));
+	mark_field(FIELD_DISTANCE);
+	mark_field(FIELD_PACE);
+	update_data_text();
+	APP_LOG(APP_LOG_LEVEL_INFO, "New activity");
+}
+
+//records the current gps values, at most once per second as the receiver doesn't update any faster
+static void record_fix(void)
+{
+	gps_fix current = {
+		.time = time(NULL),
+		.lat = lat,
+		.lon = lon,
+		.speed = speed,
+		.alt = alt,
+		.fix = fix,
+		.sat = sat,
+	};
+	//while the strap's log is being fetched, the fixes it brings in cover the current ones too
+	if (!fix || current.time == recorded_time || bulk_transfer_active())
+	{
+		return;
+	}
+	record(&current, hdop);
+}
+
+//a fix from the strap's log, timed against the snapshot the fetch started from
+static void record_backlog_fix(const xadow_gps_snapshot *snapshot)
+{
+	int32_t ago = (int32_t)(backlog.anchor_stamp - snapshot->timestamp);
+	gps_fix logged = {
+		.time = backlog.anchor_time - (ago + 500) / 1000,
+		.lat = snapshot->lat,
+		.lon = snapshot->lon,
+		.speed = snapshot->speed,
+		.alt = snapshot->alt,
+		.fix = snapshot->fix,
+		.sat = snapshot->sat,
+	};
+	if (snapshot->fix && logged.time > recorded_time)
+	{
+		//the strap's log keeps no hdop
+		record(&logged, 0);
+	}
+}
+
+static void backlog_done(bool ok)
+{
+	backlog.took = now_ms() - backlog.started;
+	APP_LOG(APP_LOG_LEVEL_INFO, "Backlog: %lu fixes in %lu ms%s", bulk_transfer_stats()->fixes - backlog.fixes, backlog.took,
+		ok ? "" : ", incomplete");
+	update_data_text();
+}
+
+//after a gap in the track, e.g. the strap unplugged or the app closed, the strap's log has the
+//fixes the watch missed
+static void backlog_check(const xadow_gps_snapshot *snapshot)
+{
+	uint32_t now = time(NULL);
+
+	if (backlog.checked)
+	{
+		return;
+	}
+	backlog.checked = true;
+	if (!recorded_time || now - recorded_time <= BACKLOG_MIN_GAP)
+	{
+		return;
+	}
+	uint32_t gap = (now - recorded_time) * 1000;
+	backlog.anchor_time = now;
+	backlog.anchor_stamp = snapshot->timestamp;
+	backlog.started = now_ms();
+	backlog.fixes = bulk_transfer_stats()->fixes;
+	if (bulk_transfer_start(snapshot->timestamp > gap ? snapshot->timestamp - gap : 0))
+	{
+		APP_LOG(APP_LOG_LEVEL_INFO, "Backlog: fetching %lu s", now - recorded_time);
+	}
+}
+
+static bool service_has_pending_read(uint16_t service_id)
+{
+	for (int i = 0; i < XADOW_NUM_ATTRIBUTES; i++)
+	{
+		if (readable_end_points[i].pending &&
+			smartstrap_attribute_get_service_id(readable_end_points[i].attr) == service_id)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//picks the requested or most overdue readable endpoint, or returns NULL and sets *wait to the ms until
+//the next one is due (-1 when nothing can be read at all)
+static struct endpoint *next_due_endpoint(int32_t *wait)
+{
+	struct endpoint *best = NULL;
+	int64_t best_score = -1;
+	uint32_t now = now_ms();
+
+	*wait = -1;
+	for (int i = 0; i < XADOW_NUM_ATTRIBUTES; i++)
+	{
+		struct endpoint *ep = &readable_end_points[i];
+		uint16_t service_id = smartstrap_attribute_get_service_id(ep->attr);
+		uint16_t attr_id = smartstrap_attribute_get_attribute_id(ep->attr);
+		if (ep->available && !smartstrap_service_is_available(service_id))
+		{
+			APP_LOG(APP_LOG_LEVEL_DEBUG, "%04x %04x is not available", service_id, attr_id);
+
+			ep->available = false;
+		}
+		if (!ep->enabled || !ep->available || ep->pending || service_has_pending_read(service_id))
+		{
+			continue;
+		}
+		if (ep->requested || (ep->due && ep->due(ep->attr)))
+		{
+			return ep;
+		}
+		if (!ep->interval)
+		{
+			//only read on request
+			continue;
+		}
+
+		int32_t overdue = (int32_t)(now - ep->last_read - endpoint_interval(ep));
+		if (overdue >= 0)
+		{
+			int64_t score = (int64_t)(overdue + 1) * ep->priority;
+			if (score > best_score)
+			{
+				best = ep;
+				best_score = score;
+			}
+		}
+		else if (*wait < 0 || -overdue < *wait)
+		{
+			*wait = -overdue;
+		}
+	}
+	return best;
+}
+
+//the first text record of a tag's ndef message, as much of it as the field shows
+static void tag_text_record(const ndef_record *record, void *context)
+{
+	if (s_tag_text_record < 0 && ndef_record_is(record, NDEF_TNF_WELL_KNOWN, "T"))
+	{
+		s_tag_text_record = record->index;
+	}
+}
+
+static void tag_text_payload(const ndef_record *record, uint32_t offset, const uint8_t *data, size_t length,
+	void *context)
+{
+	if (record->index != s_tag_text_record)
+	{
+		return;
+	}
+	if (offset == 0 && length > 0)
+	{
+		//status byte, its low six bits are the length of the language code that follows
+		s_tag_text_skip = 1 + (data[0] & 0x3f);
+	}
+	for (size_t i = 0; i < length; i++, offset++)
+	{
+		size_t at = offset - s_tag_text_skip;
+		if (offset >= s_tag_text_skip && at < sizeof(s_tag_text) - 1)
+		{
+			s_tag_text[at] = data[i];
+		}
+	}
+}
+
+static void tag_text_read(void)
+{
+	memset(s_tag_text, 0, sizeof(s_tag_text));
+	s_tag_text_record = -1;
+	s_tag_text_skip = 0;
+	ndef_parser_init(&s_ndef_parser, tag_text_record, tag_text_payload, NULL);
+	if (!ndef_read_start(&s_ndef_parser))
+	{
+		APP_LOG(APP_LOG_LEVEL_WARNING, "NDEF: transfer running, tag not read");
+	}
+	mark_field(FIELD_TAG_TEXT);
+}
+
+//a tag registered as a checkpoint counts as passing it
+static void tag_split(void)
+{
+	tag_checkpoint = tag_registry_find((const uint8_t *)tagid, tagid_length);
+	mark_field(FIELD_TAG_LABEL);
+	if (!tag_checkpoint)
+	{
+		return;
+	}
+
+	uint32_t now = time(NULL);
+	if (split.checkpoint)
+	{
+		APP_LOG(APP_LOG_LEVEL_INFO, "split: checkpoint %d, %lu s after checkpoint %d", tag_checkpoint,
+			now - split.time, split.checkpoint);
+	}
+	else
+	{
+		APP_LOG(APP_LOG_LEVEL_INFO, "split: checkpoint %d", tag_checkpoint);
+	}
+	split.checkpoint = tag_checkpoint;
+	split.time = now;
+}
+
+static void ndef_transfer_done(uint16_t attr_id, bool ok)
+{
+	if (attr_id == ATTR_NFC_READ_NDEF)
+	{
+		mark_field(FIELD_TAG_TEXT);
+		update_data_text();
+	}
+}
+
+//the last payload of every VALUE attribute, typed by the schema
+#define STORAGE_VALUE(name, type)   type name;
+#define STORAGE_STREAM(name, type)
+#define STORAGE_WRITE(name, type)
+#define ATTRIBUTE_STORAGE(kind, name, service, attribute, type, interval, priority) STORAGE_##kind(name, type)
+
+static struct
+{
+	XADOW_ATTRIBUTES(ATTRIBUTE_STORAGE)
+	uint8_t none;   //for a schema without any VALUE
+} strap;
+
+//copies a whole payload out of a reply, NULL for a failed or short one
+static const void *load_value(void *value, size_t size, SmartstrapResult result, const uint8_t *data, size_t length)
+{
+	if (result != SmartstrapResultOk || length < size)
+	{
+		return NULL;
+	}
+	memcpy(value, data, size);
+	return value;
+}
+
+//decoders, one per attribute that is read: the endpoint, the result and the payload, NULL for a
+//VALUE reply that failed or is short; a STREAM payload is the reply itself and length bytes long
+static void decode_BAT_V(struct endpoint *ep, SmartstrapResult result, const uint16_t *value, size_t length)
+{
+	if (value)
+	{
+		//100 * volt
+		vbat = *value;
+		mark_field(FIELD_VBAT);
+	}
+}
+
+static void decode_GPS_SNAPSHOT(struct endpoint *ep, SmartstrapResult result, const xadow_gps_snapshot *snapshot,
+	size_t length)
+{
+	if (result == SmartstrapResultAttributeUnsupported)
+	{
+		//older strap firmware, go back to reading the gps attributes one by one
+		set_gps_source(GPS_SOURCE_ATTRIBUTES);
+	}
+	if (!snapshot)
+	{
+		return;
+	}
+	//all gps values from the same fix, see xadow_gps_snapshot
+	bool new_fix = snapshot->timestamp != gps_timestamp;
+	if (snapshot->lat != lat) mark_field(FIELD_LAT);
+	if (snapshot->lon != lon) mark_field(FIELD_LON);
+	if (snapshot->speed != speed) mark_field(FIELD_SPEED);
+	if (snapshot->alt != alt) mark_field(FIELD_ALT);
+	if (snapshot->fix != fix) mark_field(FIELD_FIX);
+	if (snapshot->sat != sat) mark_field(FIELD_SAT);
+	lat = snapshot->lat;
+	lon = snapshot->lon;
+	speed = snapshot->speed;
+	alt = snapshot->alt;
+	fix = snapshot->fix;
+	sat = snapshot->sat;
+	gps_timestamp = snapshot->timestamp;
+	if (new_fix)
+	{
+		backlog_check(snapshot);
+		record_fix();
+	}
+}
+
+static void decode_GPS_NMEA(struct endpoint *ep, SmartstrapResult result, const xadow_nmea_read *read, size_t length)
+{
+	if (result == SmartstrapResultAttributeUnsupported)
+	{
+		//strap firmware that doesn't stream, fall back to the snapshot
+		set_gps_source(GPS_SOURCE_SNAPSHOT);
+	}
+	else if (result == SmartstrapResultOk)
+	{
+		//sentences as they come, a full buffer means more are waiting
+		nmea_parser_feed(&s_nmea, read->text, length);
+		if (length == sizeof(*read))
+		{
+			ep->requested = true;
+		}
+	}
+}
+
+static void decode_GPS_LOCATION(struct endpoint *ep, SmartstrapResult result, const xadow_gps_location *location,
+	size_t length)
+{
+	if (location)
+	{
+		//Pebble HQ is at (37.4400662, -122.1583808), which would be {374400662, -1221583808}
+		lat = location->lat;
+		lon = location->lon;
+		mark_field(FIELD_LAT);
+		mark_field(FIELD_LON);
+		//without the snapshot, the location read paces the recording
+		record_fix();
+	}
+}
+
+static void decode_GPS_SPEED(struct endpoint *ep, SmartstrapResult result, const uint16_t *value, size_t length)
+{
+	if (value)
+	{
+		//m/s with a precision of 1/100, 1.5 m/s is 150
+		speed = *value;
+		mark_field(FIELD_SPEED);
+	}
+}
+
+static void decode_GPS_ALTITUDE(struct endpoint *ep, SmartstrapResult result, const uint16_t *value, size_t length)
+{
+	if (value)
+	{
+		//m with a precision of 1/100, 1.5 m is 150
+		alt = *value;
+		mark_field(FIELD_ALT);
+	}
+}
 
-static void update_connection_status_text(void)
+static void decode_GPS_FIX_QUALITY(struct endpoint *ep, SmartstrapResult result, const uint8_t *value, size_t length)
 {
-	if (connected) {
-		memcpy(connection_text, "Connected", 9);
-		connection_text[9] = '\0';
-		text_layer_set_text(s_conn_status_layer, connection_text);
-		return;
+	if (value)
+	{
+		//http://www.gpsinformation.org/dale/nmea.htm#GGA
+		fix = *value;
+		mark_field(FIELD_FIX);
 	}
+}
 
-	if (++cnt_dot > 3) {
-		cnt_dot = 1;
+static void decode_GPS_SATELLITES(struct endpoint *ep, SmartstrapResult result, const uint8_t *value, size_t length)
+{
+	if (value)
+	{
+		//in use, as the receiver reports them in its nmea sentences
+		sat = *value;
+		mark_field(FIELD_SAT);
 	}
-
-	memcpy(connection_text, "Connecting\n...", 11 + cnt_dot);
-	connection_text[11 + cnt_dot] = '\0';
-	text_layer_set_text(s_conn_status_layer, connection_text);
 }
 
-static void update_data_text(void)
+static void decode_NFC_UID(struct endpoint *ep, SmartstrapResult result, const xadow_nfc_uid *uid, size_t length)
 {
-	if (!connected) {
-		return;
+	//as many bytes as the uid has, none without a tag
+	if (length > 0)
+	{
+		char id[sizeof(tagid)] = { 0 };
+		uint8_t id_length = min(length, sizeof(uid->uid));
+		memcpy(id, uid->uid, id_length);
+		//a new tag, fetch its message
+		if (memcmp(tagid, id, sizeof(id)))
+		{
+			memcpy(tagid, id, sizeof(id));
+			tagid_length = id_length;
+			tag_text_read();
+			tag_split();
+		}
+	}
+	else
+	{
+		memset(tagid, 0, sizeof(tagid));
+		tagid_length = 0;
+		tag_checkpoint = 0;
+		mark_field(FIELD_TAG_LABEL);
 	}
+	mark_field(FIELD_TAG);
+}
+
+static void decode_NFC_READ_NDEF(struct endpoint *ep, SmartstrapResult result, const xadow_ndef_buffer *buffer,
+	size_t length)
+{
+	ndef_transfer_did_read(ep->attr, result, (const uint8_t *)buffer, length);
+}
 
-	snprintf((char *)s_buffer, sizeof(s_buffer), "VBAT: %s\nGPS:\nlat: %s lon: %s\nvel: %s alt: %s\nfix: %d sat. in view: %d\n\nNFC TAG ID:\n %02X %02X %02X %02X", str_vbat, str_lat, str_lon, str_speed, str_alt, fix, sat, tagid[0], tagid[1], tagid[2], tagid[3]);
-	text_layer_set_text(s_data_layer, (const char *)s_buffer);
+static void decode_RAW(struct endpoint *ep, SmartstrapResult result, const xadow_bulk_read *read, size_t length)
+{
+	bulk_transfer_did_read(ep->attr, result, read->frames, length);
 }
 
+//the schema's decoders behind one signature
+typedef void (*AttributeDecoder)(struct endpoint *ep, SmartstrapResult result, const uint8_t *data, size_t length);
+
+#define DISPATCH_VALUE(name, type) \
+	static void dispatch_##name(struct endpoint *ep, SmartstrapResult result, const uint8_t *data, size_t length) \
+	{ \
+		decode_##name(ep, result, load_value(&strap.name, sizeof(type), result, data, length), length); \
+	}
+#define DISPATCH_STREAM(name, type) \
+	static void dispatch_##name(struct endpoint *ep, SmartstrapResult result, const uint8_t *data, size_t length) \
+	{ \
+		decode_##name(ep, result, (const type *)data, length); \
+	}
+#define DISPATCH_WRITE(name, type)
+#define ATTRIBUTE_DISPATCH(kind, name, service, attribute, type, interval, priority) DISPATCH_##kind(name, type)
+
+XADOW_ATTRIBUTES(ATTRIBUTE_DISPATCH)
+
+#define DECODER_VALUE(name)     dispatch_##name
+#define DECODER_STREAM(name)    dispatch_##name
+#define DECODER_WRITE(name)     NULL
+#define ATTRIBUTE_SCHEMA(kind, name, service, attribute, type, interval, priority) \
+	[XADOW_##name] = { service, attribute, sizeof(type), interval, priority, DECODER_##kind(name) },
+
+static const struct attribute_schema
+{
+	uint16_t         service_id;
+	uint16_t         attr_id;
+	uint16_t         size;       //of the attribute's buffer
+	uint32_t         interval;
+	uint8_t          priority;
+	AttributeDecoder decode;     //NULL for an attribute that is only written
+} s_schema[XADOW_NUM_ATTRIBUTES] = {
+	XADOW_ATTRIBUTES(ATTRIBUTE_SCHEMA)
+};
+
 static void prv_did_read(SmartstrapAttribute *attr, SmartstrapResult result,
 	const uint8_t *data, size_t length)
 {
 	uint16_t service_id = smartstrap_attribute_get_service_id(attr);
 	uint16_t attr_id = smartstrap_attribute_get_attribute_id(attr);
-	APP_LOG(APP_LOG_LEVEL_DEBUG, "did_read(%04x, %04x, %s)", service_id, attr_id, smartstrap_result_to_string(result));
+	bus_event(BUS_READ_DONE, attr, result);
+
+	struct endpoint *ep = find_endpoint(attr);
+	if (ep && ep->pending)
+	{
+		bus_stats_read_done(service_id, attr_id, result, now_ms() - ep->last_read, now_ms());
+		//timed out reads say nothing about the round trip time (karn's algorithm), retry
+		//right away with the longer timeout rather than waiting for the next poll
+		if (result == SmartstrapResultTimeOut)
+		{
+			endpoint_rtt_timeout(ep);
+			ep->requested = !ep->due;
+		}
+		else
+		{
+			endpoint_rtt_sample(ep, now_ms() - ep->last_read);
+		}
+	}
+	if (ep)
+	{
+		read_completed(ep);
+		if (result == SmartstrapResultOk)
+		{
+			endpoint_track_value(ep, data, length);
+		}
+		//straight to the attribute's decoder, by its place in the schema
+		AttributeDecoder decode = s_schema[ep - readable_end_points].decode;
+		if (decode)
+		{
+			decode(ep, result, data, length);
+		}
+	}
+
+	update_data_text();
+	link_run();
+}
 
-	read_req_pending = 0;
-	app_timer_cancel(p_timer);
+//gives up reads that got no reply at all, returns the ms until the next pending one expires
+//or -1 when none is pending
+static int32_t read_watchdog(uint32_t now)
+{
+	int32_t next = -1;
+
+	for (int i = 0; i < XADOW_NUM_ATTRIBUTES; i++)
+	{
+		struct endpoint *ep = &readable_end_points[i];
+		if (!ep->pending)
+		{
+			continue;
+		}
+		int32_t left = ep->rto + READ_WATCHDOG_SLACK - (int32_t)(now - ep->last_read);
+		if (left <= 0)
+		{
+			bus_event(BUS_READ_LOST, ep->attr, SmartstrapResultTimeOut);
+			bus_stats_read_lost(smartstrap_attribute_get_service_id(ep->attr),
+				smartstrap_attribute_get_attribute_id(ep->attr));
+			endpoint_rtt_timeout(ep);
+			read_completed(ep);
+		}
+		else if (next < 0 || left < next)
+		{
+			next = left;
+		}
+	}
+	return next;
+}
 
-	if (service_id == SERVICE_BAT && attr_id == ATTR_BAT_V && length >= 2)
+//one stream read or one snapshot replaces the five per-attribute gps reads when the strap supports it
+static void set_gps_source(enum gps_source source)
+{
+	for (int i = 0; i < XADOW_NUM_ATTRIBUTES; i++)
 	{
-		//the returned value is uint16_t,  it's 100 * volt
-		memcpy(&vbat, data, 2);
-		//APP_LOG(APP_LOG_LEVEL_DEBUG, "vbat: %d", vbat);
-		format_number(vbat, 2, str_vbat, 1);
+		struct endpoint *ep = &readable_end_points[i];
+		if (smartstrap_attribute_get_service_id(ep->attr) == SERVICE_GPS)
+		{
+			if (ep == ENDPOINT(GPS_NMEA))
+			{
+				ep->enabled = source == GPS_SOURCE_NMEA;
+			}
+			else if (ep == ENDPOINT(GPS_SNAPSHOT))
+			{
+				ep->enabled = source == GPS_SOURCE_SNAPSHOT;
+			}
+			else
+			{
+				ep->enabled = source == GPS_SOURCE_ATTRIBUTES;
+			}
+		}
 	}
-	else if (service_id == SERVICE_GPS && attr_id == ATTR_GPS_LOCATION && length >= 8)
+	//the other sources would leave the stream's last one standing
+	if (source != GPS_SOURCE_NMEA)
 	{
-		//sint32[2],The current longitude and latitude in degrees with a precision of 1/10^7.
-		//The latitude comes before the longitude in the data.
-		//For example, Pebble HQ is at (37.4400662, -122.1583808), which would be specified as {374400662, -1221583808}.
-		memcpy(&lat, data, 4);
-		memcpy(&lon, data + 4, 4);
-		format_number(lat, 7, str_lat, 4);
-		format_number(lon, 7, str_lon, 4);
+		hdop = 0;
 	}
-	else if (service_id == SERVICE_GPS && attr_id == ATTR_GPS_SPEED && length >= 2)
+}
+
+static enum gps_source preferred_gps_source(void)
+{
+	return gps_nmea_mode ? GPS_SOURCE_NMEA : GPS_SOURCE_SNAPSHOT;
+}
+
+//a sentence that checked out, its values go where the attribute reads would have put them
+static void nmea_sentence(enum nmea_sentence sentence, const nmea_data *data, void *context)
+{
+	static uint32_t fix_time;
+
+	if (sentence == NMEA_GGA && data->fix)
 	{
-		//the returned value is uint16_t
-		//The current speed in meters per second with a precision of 1/100. For example, 1.5 m/s would be specified as 150.
-		memcpy(&speed, data, 2);
-		format_number(speed, 2, str_speed, 2);
+		uint16_t altitude = data->alt < 0 ? 0 : min(data->alt, UINT16_MAX);
+		if (data->lat != lat) mark_field(FIELD_LAT);
+		if (data->lon != lon) mark_field(FIELD_LON);
+		if (altitude != alt) mark_field(FIELD_ALT);
+		if (data->fix != fix) mark_field(FIELD_FIX);
+		if (data->sat != sat) mark_field(FIELD_SAT);
+		lat = data->lat;
+		lon = data->lon;
+		alt = altitude;
+		fix = data->fix;
+		sat = data->sat;
+		hdop = data->hdop;
+		if (data->time != fix_time)
+		{
+			fix_time = data->time;
+			record_fix();
+		}
 	}
-	else if (service_id == SERVICE_GPS && attr_id == ATTR_GPS_ALTITUDE && length >= 2)
+	else if (sentence == NMEA_GGA && data->fix != fix)
 	{
-		//the returned value is uint16_t
-		//The current altitude in meters with a precision of 1/100. For example, 1.5 m would be specified as 150.
-		memcpy(&alt, data, 2);
-		format_number(alt, 2, str_alt, 2);
+		//lost the fix, the position stays as it was
+		fix = data->fix;
+		mark_field(FIELD_FIX);
 	}
-	else if (service_id == SERVICE_GPS && attr_id == ATTR_GPS_FIX_QUALITY && length >= 1)
+	else if (sentence == NMEA_RMC && data->speed != speed)
 	{
-		//the returned value is uint8_t
-		//http://www.gpsinformation.org/dale/nmea.htm#GGA
-		memcpy(&fix, data, 1);
+		speed = data->speed;
+		mark_field(FIELD_SPEED);
 	}
-	else if (service_id == SERVICE_GPS && attr_id == ATTR_GPS_SATELLITES && length >= 1)
+}
+
+static void prv_did_write(SmartstrapAttribute *attr, SmartstrapResult result) {
+	uint16_t service_id = smartstrap_attribute_get_service_id(attr);
+	uint16_t attr_id = smartstrap_attribute_get_attribute_id(attr);
+	bus_event(BUS_WRITE_DONE, attr, result);
+
+	if (service_id == SERVICE_BAT && attr_id == ATTR_BAT_CHG)
 	{
-		//the returned value is uint8_t
-		//The number of GPS satellites (typically reported via NMEA.
-		memcpy(&sat, data, 1);
+		dialog_choice_window_pop();
 	}
-	else if (service_id == SERVICE_NFC && attr_id == ATTR_NFC_GET_UID)
+
+	//a chunk written as part of a transfer
+	struct endpoint *ep = find_endpoint(attr);
+	if (ep && ep->pending && ep->written && ep->written(attr, result))
 	{
-		//the returned data is an array of uint8_t with length indicated
-		if (length > 0)
+		bus_stats_read_done(service_id, attr_id, result, now_ms() - ep->last_read, now_ms());
+		if (result == SmartstrapResultTimeOut)
 		{
-			length = min(length, 16);
-			memcpy(tagid, data, length);
+			endpoint_rtt_timeout(ep);
 		}
 		else
 		{
-			memset(tagid, 0, sizeof(tagid));
+			endpoint_rtt_sample(ep, now_ms() - ep->last_read);
 		}
+		read_completed(ep);
+		link_run();
 	}
-
-	app_timer_register(200, prv_send_read_request, NULL);
-	update_data_text();
 }
 
-static void read_request_timeout(void *context)
+static void read_issued(struct endpoint *ep)
 {
-	read_req_pending = 0;
-	app_timer_register(100, prv_send_read_request, NULL);
-}
-
-static void prv_did_write(SmartstrapAttribute *attr, SmartstrapResult result) {
-	uint16_t service_id = smartstrap_attribute_get_service_id(attr);
-	uint16_t attr_id = smartstrap_attribute_get_attribute_id(attr);
-	APP_LOG(APP_LOG_LEVEL_DEBUG, "did_write(%04x, %04x, %s)", service_id, attr_id, smartstrap_result_to_string(result));
+	uint32_t now = now_ms();
 
-	if (service_id == SERVICE_BAT && attr_id == ATTR_BAT_CHG)
+	if (in_flight == 0 && idle_since)
 	{
-		dialog_choice_window_pop();
+		pipeline_stats.idle_ms += now - idle_since;
+	}
+	ep->pending = true;
+	ep->requested = false;
+	ep->last_read = now;
+	bus_event(BUS_READ, ep->attr, SmartstrapResultOk);
+	bus_stats_read_issued(smartstrap_attribute_get_service_id(ep->attr),
+		smartstrap_attribute_get_attribute_id(ep->attr), now);
+	if (++in_flight > pipeline_stats.max_depth)
+	{
+		pipeline_stats.max_depth = in_flight;
+	}
+	if (++pipeline_stats.reads % PIPELINE_PROBE_READS == 0 && pipeline_limit < MAX_PIPELINE_DEPTH)
+	{
+		pipeline_limit++;
+	}
+	if (pipeline_stats.reads % 256 == 0)
+	{
+		APP_LOG(APP_LOG_LEVEL_INFO, "pipeline: %lu reads, depth %d (max %d), %d refused, idle %lu ms",
+			pipeline_stats.reads, pipeline_limit, pipeline_stats.max_depth, pipeline_stats.busy, pipeline_stats.idle_ms);
 	}
 }
 
-static void prv_send_read_request(void *context) {
-	if (!connected)
+static void read_completed(struct endpoint *ep)
+{
+	if (!ep->pending)
 	{
-		app_timer_register(1, check_connection, NULL);
 		return;
 	}
+	ep->pending = false;
+	if (--in_flight == 0)
+	{
+		idle_since = now_ms();
+	}
+}
 
-	if (read_req_pending)
+static void read_pipeline_reset(void)
+{
+	for (int i = 0; i < XADOW_NUM_ATTRIBUTES; i++)
 	{
-		return;
+		readable_end_points[i].pending = false;
 	}
+	in_flight = 0;
+	idle_since = 0;
+}
 
-	struct endpoint *ep;
-	SmartstrapAttribute *attr;
+static void link_timer_fired(void *context)
+{
+	link.timer = NULL;
+	link.chains--;
+	link_run();
+}
 
-	if (nfc_valid_tagid)
+//(re)arms the one timer, an armed timer is moved rather than a second one started
+static void link_arm(uint32_t delay)
+{
+	if (link.timer && app_timer_reschedule(link.timer, delay))
 	{
-		attr = s_attr_nfc_uid;
+		return;
 	}
-	else
+	link.timer = app_timer_register(delay, link_timer_fired, NULL);
+	if (++link.chains > link.max_chains)
 	{
-		int cnt = 0;
-		do
+		link.max_chains = link.chains;
+		if (link.chains > 1)
 		{
-			ep = &readable_end_points[cur_endpoint];
-			if (cnt++ > num_endpoints)
-			{
-				app_timer_register(100, check_connection, NULL);
-				return;
-			}
-			uint16_t service_id = smartstrap_attribute_get_service_id(ep->attr);
-			uint16_t attr_id = smartstrap_attribute_get_attribute_id(ep->attr);
-			if (ep->available && !smartstrap_service_is_available(service_id))
-			{
-				APP_LOG(APP_LOG_LEVEL_DEBUG, "%04x %04x is not available", service_id, attr_id);
+			APP_LOG(APP_LOG_LEVEL_ERROR, "%d timer chains", link.chains);
+		}
+	}
+}
 
-				ep->available = false;
-			}
-			if (ep->available)
-			{
-				attr = ep->attr;
-				break;
-			}
-			else
-			{
-				if (++cur_endpoint >= num_endpoints) cur_endpoint = 0;
-			}
-		} while (1);
+static void link_disarm(void)
+{
+	if (link.timer)
+	{
+		app_timer_cancel(link.timer);
+		link.timer = NULL;
+		link.chains--;
+	}
+}
+
+//exponential backoff with jitter, so that a strap that isn't there is probed less and less
+//often and reconnect attempts don't fall into step with anything periodic on the strap
+static uint32_t link_backoff(void)
+{
+	uint32_t delay = LINK_BACKOFF_MIN << min(link.attempts, LINK_BACKOFF_MAX_SHIFT);
+	if (link.attempts < 0xff)
+	{
+		link.attempts++;
 	}
+	return delay / 2 + rand() % (delay / 2 + 1);
+}
 
+static void link_lost(void)
+{
+	if (link.state != LINK_CONNECTING)
+	{
+		APP_LOG(APP_LOG_LEVEL_DEBUG, "connection lost");
+		link.state = LINK_CONNECTING;
+		link.attempts = 0;
+	}
+	read_pipeline_reset();
+}
 
-	SmartstrapResult result = smartstrap_attribute_read(attr);
-	if (result != SmartstrapResultOk)
+//issues reads until nothing is due or the firmware doesn't accept more, returns the ms until
+//it should run again, or -1 when only a reply can make progress
+static int32_t read_pipeline_run(void)
+{
+	while (in_flight < pipeline_limit)
 	{
-		APP_LOG(APP_LOG_LEVEL_ERROR, "Read of %04x failed with result: %s", smartstrap_attribute_get_attribute_id(attr), smartstrap_result_to_string(result));
-		if (result == SmartstrapResultBusy)
+		int32_t wait;
+		struct endpoint *ep = next_due_endpoint(&wait);
+		if (!ep)
+		{
+			if (in_flight > 0)
+			{
+				//the next reply runs the pipeline again
+				return -1;
+			}
+			//with nothing readable at all, look again soon in case a service comes back
+			return wait < 0 ? MAX_POLL_WAIT : min(wait, MAX_POLL_WAIT);
+		}
+
+		if (ep->rto != strap_timeout)
 		{
-			app_timer_register(100, prv_send_read_request, NULL);
+			strap_timeout = ep->rto;
+			smartstrap_set_timeout(strap_timeout);
 		}
-		else if (result == SmartstrapResultTimeOut)
+		SmartstrapResult result = ep->issue ? ep->issue(ep->attr) : smartstrap_attribute_read(ep->attr);
+		if (result != SmartstrapResultOk)
 		{
-			app_timer_register(100, check_connection, NULL);
+			bus_stats_read_refused(smartstrap_attribute_get_service_id(ep->attr),
+				smartstrap_attribute_get_attribute_id(ep->attr), result);
 		}
-		else
+		if (result == SmartstrapResultBusy && in_flight > 0)
+		{
+			//the firmware takes no more reads in parallel, stay at this depth for a while
+			pipeline_limit = in_flight;
+			pipeline_stats.busy++;
+			return -1;
+		}
+		if (result != SmartstrapResultOk)
 		{
-			app_timer_register(1000, prv_send_read_request, NULL);
+			bus_event(BUS_READ_REFUSED, ep->attr, result);
+			if (result == SmartstrapResultTimeOut)
+			{
+				link_lost();
+				return -1;
+			}
+			uint32_t hold = result == SmartstrapResultBusy ? LINK_RETRY_BUSY : LINK_RETRY_ERROR;
+			link.state = LINK_HOLDING;
+			link.hold_until = now_ms() + hold;
+			return hold;
 		}
+		read_issued(ep);
 	}
-	else
+	return -1;
+}
+
+static void link_run(void)
+{
+	if (link.state == LINK_CONNECTING)
 	{
-		if (attr == s_attr_nfc_uid)
+		if (!smartstrap_service_is_available(SMARTSTRAP_RAW_DATA_SERVICE_ID))
 		{
-			nfc_valid_tagid = 0;
+			connected = 0;
+			APP_LOG(APP_LOG_LEVEL_DEBUG, "connecting...");
+			data_text_hide();
+			connection_status_text_show();
+			update_connection_status_text();
+			link_arm(link_backoff());
+			return;
 		}
-		else
+		connected = 1;
+		link.state = LINK_POLLING;
+		link.attempts = 0;
+		link.reconnects++;
+		backlog.checked = false;
+		APP_LOG(APP_LOG_LEVEL_DEBUG, "connection ok");
+		update_connection_status_text();
+		connection_status_text_hide();
+		data_text_show();
+	}
+
+	uint32_t now = now_ms();
+	int32_t wait;
+	read_watchdog(now);
+	if (link.state == LINK_HOLDING && (int32_t)(link.hold_until - now) > 0)
+	{
+		wait = link.hold_until - now;
+	}
+	else
+	{
+		link.state = LINK_POLLING;
+		wait = read_pipeline_run();
+		if (link.state == LINK_CONNECTING)
 		{
-			if (++cur_endpoint >= num_endpoints) cur_endpoint = 0;
+			link_arm(link_backoff());
+			return;
 		}
-		read_req_pending = 1;
-		p_timer = app_timer_register(1000, read_request_timeout, NULL);
+	}
+
+	//wake up for whichever comes first, the next poll or the next read to give up on
+	int32_t expiry = read_watchdog(now);
+	if (expiry >= 0 && (wait < 0 || expiry < wait))
+	{
+		wait = expiry;
+	}
+	if (wait >= 0)
+	{
+		link_arm(wait);
+	}
+	else
+	{
+		link_disarm();
 	}
 }
 
@@ -390,49 +1550,44 @@ static void prv_availablility_status_changed(SmartstrapServiceId service_id, boo
 
 	if (service_id == SMARTSTRAP_RAW_DATA_SERVICE_ID && !is_available)
 	{
-		read_req_pending = 0;
-		app_timer_register(1000, check_connection, NULL);
+		link_lost();
 	}
 	if (is_available)
 	{
-		for (int i = 0; i < num_endpoints; i++)
+		if (service_id == SERVICE_GPS)
+		{
+			//the strap may have been swapped, probe for the stream or the snapshot again
+			set_gps_source(preferred_gps_source());
+		}
+		for (int i = 0; i < XADOW_NUM_ATTRIBUTES; i++)
 		{
 			if (smartstrap_attribute_get_service_id(readable_end_points[i].attr) == service_id)
 			{
+				//until it proves otherwise, a strap that just showed up doesn't notify
 				readable_end_points[i].available = true;
+				readable_end_points[i].notifying = false;
 			}
 		}
 	}
+	//no need to wait for the backoff or the poll timer, react right away
+	link_run();
 }
 
 static void prv_notified(SmartstrapAttribute *attr) {
-	uint16_t service_id = smartstrap_attribute_get_service_id(attr);
-	uint16_t attr_id = smartstrap_attribute_get_attribute_id(attr);
-
-	APP_LOG(APP_LOG_LEVEL_DEBUG, "notified(%04x, %04x)", service_id, attr_id);
+	bus_event(BUS_NOTIFIED, attr, SmartstrapResultOk);
 
-	if (service_id == SERVICE_NFC && attr_id == ATTR_NFC_GET_UID)
+	//a new gps fix, a battery change or a new nfc tag: read just that attribute now, and
+	//from then on poll it only as a watchdog in case the strap stops notifying
+	struct endpoint *ep = find_endpoint(attr);
+	if (!ep || !ep->enabled)
 	{
-		nfc_valid_tagid = 1;
-	}
-}
-
-static void check_connection(void *context) {
-	if (smartstrap_service_is_available(SMARTSTRAP_RAW_DATA_SERVICE_ID)) {
-		connected = 1;
-		APP_LOG(APP_LOG_LEVEL_DEBUG, "connection ok");
-		update_connection_status_text();
-		connection_status_text_hide();
-		data_text_show();
-		app_timer_register(100, prv_send_read_request, NULL);
+		return;
 	}
-	else {
-		connected = 0;
-		APP_LOG(APP_LOG_LEVEL_DEBUG, "connecting...");
-		data_text_hide();
-		connection_status_text_show();
-		update_connection_status_text();
-		app_timer_register(1000, check_connection, NULL);
+	ep->requested = true;
+	ep->notifying = ep->interval != 0;
+	if (connected)
+	{
+		link_run();
 	}
 }
 
@@ -448,13 +1603,13 @@ static void connection_status_text_hide()
 
 static void data_text_show()
 {
-	layer_set_hidden(text_layer_get_layer(s_data_layer), false);
+	layer_set_hidden(s_data_layer, false);
 	update_data_text();
 }
 
 static void data_text_hide()
 {
-	layer_set_hidden(text_layer_get_layer(s_data_layer), true);
+	layer_set_hidden(s_data_layer, true);
 }
 
 static void prv_main_window_load(Window *window) {
@@ -470,17 +1625,25 @@ static void prv_main_window_load(Window *window) {
 	text_layer_set_overflow_mode(s_conn_status_layer, GTextOverflowModeWordWrap);
 	layer_add_child(s_window_layer, text_layer_get_layer(s_conn_status_layer));
 
-	s_data_layer = text_layer_create(GRect(0, 10, 144, 160));
-	text_layer_set_font(s_data_layer, fonts_get_system_font(FONT_KEY_GOTHIC_18));
-	text_layer_set_text_color(s_data_layer, GColorBlack);
-	text_layer_set_background_color(s_data_layer, GColorClear);
-	text_layer_set_text_alignment(s_data_layer, GTextAlignmentLeft);
-	text_layer_set_overflow_mode(s_data_layer, GTextOverflowModeWordWrap);
-	layer_add_child(s_window_layer, text_layer_get_layer(s_data_layer));
+	s_data_layer = layer_create(GRect(0, 10, 144, 160));
+	for (int field = 0; field < NUM_FIELDS; field++)
+	{
+		TextLayer *layer = text_layer_create(GRect(data_fields[field].x, data_fields[field].row * FIELD_ROW_HEIGHT,
+			data_fields[field].w, FIELD_ROW_HEIGHT));
+		text_layer_set_font(layer, fonts_get_system_font(FONT_KEY_GOTHIC_18));
+		text_layer_set_text_color(layer, GColorBlack);
+		text_layer_set_background_color(layer, GColorClear);
+		text_layer_set_text_alignment(layer, GTextAlignmentLeft);
+		text_layer_set_overflow_mode(layer, GTextOverflowModeTrailingEllipsis);
+		layer_add_child(s_data_layer, text_layer_get_layer(layer));
+		s_field_layers[field] = layer;
+	}
+	layer_add_child(s_window_layer, s_data_layer);
 
 	data_text_hide();
 	
 	// Dots for the progress indicator
+	create_dots(window_bounds);
 	s_dots_layer = layer_create(window_bounds);
 	layer_set_update_proc(s_dots_layer, dots_layer_update_proc);
 	layer_add_child(s_window_layer, s_dots_layer);
@@ -523,10 +1686,18 @@ static void prv_main_window_load(Window *window) {
 
 static void prv_main_window_unload(Window *window) {
 	text_layer_destroy(s_conn_status_layer);
-	text_layer_destroy(s_data_layer);
+	for (int field = 0; field < NUM_FIELDS; field++)
+	{
+		text_layer_destroy(s_field_layers[field]);
+	}
+	layer_destroy(s_data_layer);
 	layer_destroy(text_layer_get_layer(s_time_layer));
 	layer_destroy(text_layer_get_layer(s_step_layer));
 	layer_destroy(s_dots_layer);
+	if (s_dot_bitmap) {
+		gbitmap_destroy(s_dot_bitmap);
+		s_dot_bitmap = NULL;
+	}
 	layer_destroy(s_progress_layer);
 	layer_destroy(s_average_layer);
 }
@@ -551,14 +1722,73 @@ static void down_click_handler(ClickRecognizerRef recognizer, void *context) {
 
 static void select_click_handler(ClickRecognizerRef recognizer, void *context) {
 	if (connected) {
-		dialog_choice_window_push(s_attr_bat_chg);
+		dialog_choice_window_push(ENDPOINT(BAT_CHG)->attr);
+	}
+}
+
+//registers the tag in range as the next checkpoint of the course
+static void select_long_click_handler(ClickRecognizerRef recognizer, void *context) {
+	uint8_t checkpoint = tag_registry_highest() + 1;
+	if (!tagid_length || tag_checkpoint || !checkpoint)
+	{
+		return;
+	}
+	if (tag_registry_add((const uint8_t *)tagid, tagid_length, checkpoint))
+	{
+		APP_LOG(APP_LOG_LEVEL_INFO, "Tag registered as checkpoint %d of %d", checkpoint, tag_registry_count());
+		tag_checkpoint = checkpoint;
+		mark_field(FIELD_TAG_LABEL);
+		update_data_text();
 	}
 }
 
+//switches between streaming the receiver's sentences and reading the gps attributes
+static void up_long_click_handler(ClickRecognizerRef recognizer, void *context) {
+	gps_nmea_mode = !gps_nmea_mode;
+	persist_write_bool(PERSIST_KEY_GPS_NMEA, gps_nmea_mode);
+	set_gps_source(preferred_gps_source());
+	APP_LOG(APP_LOG_LEVEL_INFO, "GPS: %s", gps_nmea_mode ? "nmea stream" : "attributes");
+	link_run();
+}
+
+static void down_long_click_handler(ClickRecognizerRef recognizer, void *context) {
+	diagnostics_window_push();
+}
+
+static void select_double_click_handler(ClickRecognizerRef recognizer, void *context) {
+	activity_restart();
+}
+
 static void click_config_provider(void *context) {
 	window_single_click_subscribe(BUTTON_ID_UP, up_click_handler);
 	window_single_click_subscribe(BUTTON_ID_DOWN, down_click_handler);
 	window_single_click_subscribe(BUTTON_ID_SELECT, select_click_handler);
+	window_long_click_subscribe(BUTTON_ID_UP, 0, up_long_click_handler, NULL);
+	window_long_click_subscribe(BUTTON_ID_SELECT, 0, select_long_click_handler, NULL);
+	window_long_click_subscribe(BUTTON_ID_DOWN, 0, down_long_click_handler, NULL);
+	window_multi_click_subscribe(BUTTON_ID_SELECT, 2, 2, 0, true, select_double_click_handler);
+}
+
+//creates the attribute at index of the schema with a buffer of its payload's size
+static struct endpoint *add_endpoint(enum xadow_attribute index)
+{
+	const struct attribute_schema *schema = &s_schema[index];
+	struct endpoint *ep = &readable_end_points[index];
+	ep->attr = smartstrap_attribute_create(schema->service_id, schema->attr_id, schema->size);
+	ep->available = true;
+	ep->enabled = true;
+	ep->interval = schema->interval;
+	ep->priority = schema->priority;
+	ep->rto = RTO_INITIAL;
+	ep->last_read = now_ms() - schema->interval;
+
+	uint32_t slot = dispatch_slot(schema->service_id, schema->attr_id);
+	while (s_dispatch[slot])
+	{
+		slot = (slot + 1) & ((1 << DISPATCH_BITS) - 1);
+	}
+	s_dispatch[slot] = index + 1;
+	return ep;
 }
 
 static void prv_init(void) {
@@ -568,7 +1798,7 @@ static void prv_init(void) {
 	s_main_window = window_create();
 	s_window_layer = window_get_root_layer(s_main_window);
 
-	//window_set_click_config_provider_with_context(s_main_window, click_config_provider, NULL);
+	window_set_click_config_provider_with_context(s_main_window, click_config_provider, NULL);
 	window_set_window_handlers(s_main_window, (WindowHandlers) {
 		.load = prv_main_window_load,
 		.unload = prv_main_window_unload
@@ -582,40 +1812,79 @@ static void prv_init(void) {
 		.notified = prv_notified
 	};
 	smartstrap_subscribe(handlers);
-	smartstrap_set_timeout(500);
 
-	//read/write attrib - raw data service
-	s_raw_attribute = smartstrap_attribute_create(0, 0, 100);
-
-	//write attrib - enable or disable the strap charging pebble time
-	s_attr_bat_chg = smartstrap_attribute_create(0x2003, 0x1002, 4);
-
-	s_attr_nfc_uid = smartstrap_attribute_create(SERVICE_NFC, ATTR_NFC_GET_UID, 10);
-
-	//readable attrib - get the voltage of the battery of strap
-	readable_end_points[num_endpoints].attr = smartstrap_attribute_create(SERVICE_BAT, ATTR_BAT_V, 4);
-	readable_end_points[num_endpoints++].available = true;
-
-	readable_end_points[num_endpoints].attr = smartstrap_attribute_create(SERVICE_GPS, ATTR_GPS_LOCATION, 16);
-	readable_end_points[num_endpoints++].available = true;
-
-	readable_end_points[num_endpoints].attr = smartstrap_attribute_create(SERVICE_GPS, ATTR_GPS_SPEED, 4);
-	readable_end_points[num_endpoints++].available = true;
+	for (int i = 0; i < XADOW_NUM_ATTRIBUTES; i++)
+	{
+		add_endpoint(i);
+	}
 
-	readable_end_points[num_endpoints].attr = smartstrap_attribute_create(SERVICE_GPS, ATTR_GPS_ALTITUDE, 4);
-	readable_end_points[num_endpoints++].available = true;
+	//enables or disables the strap charging the watch, only ever written from the dialog
+	ENDPOINT(BAT_CHG)->enabled = false;
 
-	readable_end_points[num_endpoints].attr = smartstrap_attribute_create(SERVICE_GPS, ATTR_GPS_FIX_QUALITY, 2);
-	readable_end_points[num_endpoints++].available = true;
+	//the strap timestamp changes with every fix, only the fix itself counts as the value
+	ENDPOINT(GPS_SNAPSHOT)->compare_len = offsetof(xadow_gps_snapshot, timestamp);
+	nmea_parser_init(&s_nmea, nmea_sentence, NULL);
+	gps_nmea_mode = persist_read_bool(PERSIST_KEY_GPS_NMEA);
 
-	readable_end_points[num_endpoints].attr = smartstrap_attribute_create(SERVICE_GPS, ATTR_GPS_SATELLITES, 2);
-	readable_end_points[num_endpoints++].available = true;
+	//ndef transfers, a chunk at a time whenever one is due
+	for (int i = XADOW_NFC_READ_NDEF; i <= XADOW_NFC_ERASE_NDEF; i++)
+	{
+		readable_end_points[i].due = ndef_transfer_due;
+		readable_end_points[i].issue = ndef_transfer_issue;
+		readable_end_points[i].written = ndef_transfer_did_write;
+	}
+	ndef_transfer_set_handler(ndef_transfer_done);
+
+	//bulk fetches of the strap's log of fixes over the raw data service
+	ENDPOINT(RAW)->due = bulk_transfer_due;
+	ENDPOINT(RAW)->issue = bulk_transfer_issue;
+	ENDPOINT(RAW)->written = bulk_transfer_did_write;
+	bulk_transfer_set_handlers(record_backlog_fix, backlog_done);
+	tag_registry_init();
+
+	set_gps_source(preferred_gps_source());
+
+	//carry on with the track recorded before the app was last closed; workers can't talk to
+	//the strap, so recording only ever happens while the app is open
+	fix_log_set_sealed_handler(track_store_append);
+	track_store_init();
+	track_simplify_init(store_fix);
+	fix_log_iter it;
+	gps_fix stored;
+	fix_log_iter_init(&it);
+	while (fix_log_iter_next(&it, &stored))
+	{
+		geo_odometer_add(&odometer, stored.time, (geo_point){ stored.lat, stored.lon });
+		recorded_time = stored.time;
+	}
+	track_export_init();
+	if (step_data_is_available())
+	{
+		track_fusion_init();
+	}
 
-	app_timer_register(1000, check_connection, NULL);
+	srand(time(NULL));
+	link_arm(1000);
 	tick_timer_service_subscribe(MINUTE_UNIT, tick_handler);
 }
 
 static void prv_deinit(void) {
+	track_simplify_flush();
+	const simplify_stats *simplified = track_simplify_stats();
+	APP_LOG(APP_LOG_LEVEL_INFO, "Simplify: kept %lu of %lu fixes", simplified->out, simplified->in);
+	track_store_checkpoint(fix_log_open_block(), true);
+#if BUS_TRACE
+	for (uint16_t i = 0; i < bus_trace_count(); i++)
+	{
+		const bus_trace_record *record = bus_trace_get(i);
+		APP_LOG(APP_LOG_LEVEL_INFO, "trace %lu %d %04x %04x %d", record->time, record->event, record->service_id,
+			record->attr_id, record->result);
+	}
+#endif
+	const fusion_stats *fused = track_fusion_stats();
+	APP_LOG(APP_LOG_LEVEL_INFO, "Fusion: %lu fixes, %lu steps from %lu minutes in %lu queries", fused->fixes,
+		fused->steps, fused->minutes, fused->queries);
+	link_disarm();
 	window_destroy(s_main_window);
 	smartstrap_unsubscribe();
 }
@@ -624,51 +1893,61 @@ int main(void) {
 	prv_init();
 	app_event_loop();
 	prv_deinit();
+	return 0;
 }
 
-uint32_t upow(int p)
+static const uint32_t powers_of_ten[] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+//writes at least width digits, each one found by subtracting its power of ten
+static char *format_digits(char *output, uint32_t value, int width)
 {
-	uint32_t ret = 1;
-	for (int i = 0; i < p; i++)
+	int n = 1;
+	while (n < 10 && value >= powers_of_ten[n])
 	{
-		ret *= 10;
+		n++;
 	}
-	return ret;
+	n = max(n, width);
+	while (n--)
+	{
+		char digit = '0';
+		while (value >= powers_of_ten[n])
+		{
+			value -= powers_of_ten[n];
+			digit++;
+		}
+		*(output++) = digit;
+	}
+	*output = '\0';
+	return output;
 }
 
-void format_number(int32_t input, int input_precision, char *output, int output_precision)
+//writes a fixed point number with input_precision decimals as one with output_precision
+//decimals, rounded half up; returns the end of the output
+char *format_number(int32_t input, int input_precision, char *output, int output_precision)
 {
-	if (input < 0)
-	{
-		*(output++) = '-';
-		input = -input;
-	}
-	uint32_t round = input / upow(input_precision);
-	uint32_t fraction = input % upow(input_precision);
+	uint32_t value = input < 0 ? -(uint32_t)input : (uint32_t)input;
 
-	if (output_precision >= input_precision)
+	if (output_precision < input_precision)
 	{
-		fraction = fraction * upow((output_precision - input_precision));
+		uint32_t divisor = powers_of_ten[input_precision - output_precision];
+		value = (value + divisor / 2) / divisor;
 	}
 	else
 	{
-		fraction = fraction / upow((input_precision - output_precision));
-		if (fraction % upow(input_precision - output_precision) >= upow(input_precision - output_precision) / 2)
-		{
-			fraction += 1;
-			round += fraction / upow(output_precision);
-			fraction = fraction % upow(output_precision);
-		}
+		value *= powers_of_ten[output_precision - input_precision];
 	}
 
-	snprintf(output, 6, "%lu", round);
-	output += strlen(output);
-
+	if (input < 0 && value)
+	{
+		*(output++) = '-';
+	}
+	output = format_digits(output, value / powers_of_ten[output_precision], 1);
 	if (output_precision > 0)
 	{
 		*(output++) = '.';
-		snprintf(output, 6, "%lu", fraction);
-		output += strlen(output);
+		output = format_digits(output, value % powers_of_ten[output_precision], output_precision);
 	}
-	*output = '\0';
-}
\ No newline at end of file
+	return output;
+}